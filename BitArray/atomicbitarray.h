@@ -0,0 +1,161 @@
+// atomicbitarray.h: a BitArray that threads can update at once
+#ifndef ATOMIC_BIT_ARRAY_H
+#define ATOMIC_BIT_ARRAY_H
+#include <array>
+#include <atomic>
+#include <bit>
+#include <climits>
+#include <memory>
+#include <stdexcept>
+#include "bitarray.h"
+
+// A BitArray that any number of threads can update at once, e.g. the visited set of a
+// parallel graph traversal. Every word is a `std::atomic<IType>` and each bit op is a single
+// lock-free `fetch_or`/`fetch_and`, so threads writing different bits of the same word never
+// lose each other's updates.
+//
+// The size is fixed at construction unless `grow` is called, and `grow` may run concurrently
+// with everything else: the words live in segments that never move. Segment 0 holds the
+// words the array was built with and segment k > 0 adds `first << ( k - 1 )` more, so the
+// capacity at least doubles per segment and a word index maps to its segment with one
+// `bit_width`. A new segment is published with a compare-exchange, and the size only moves
+// past a segment once it is published, so a position below `size ()` is always backed.
+template <class IType = size_t>
+class AtomicBitArray
+{
+	using Word = std::atomic<IType>;
+	static_assert ( Word::is_always_lock_free, "AtomicBitArray needs a lock-free word type" );
+
+	enum { BITS_PER_WORD = CHAR_BIT * sizeof ( IType ) };
+	static constexpr size_t MAX_SEGMENTS = CHAR_BIT * sizeof ( size_t );
+
+	size_t first_words_;                // the words in segment 0, at least one
+	std::unique_ptr<Word[]> first_;     // segment 0, which never changes
+	std::array<std::atomic<Word*>, MAX_SEGMENTS> segments_ {}; // segments 1 and up, published by `grow`
+	std::atomic<size_t> nbits_;
+
+	static size_t words_needed( size_t const nbits ) { return ( nbits + BITS_PER_WORD - 1 ) / BITS_PER_WORD; }
+
+	static IType mask1( size_t const bitpos ) { return IType ( IType ( 1 ) << bitpos % BITS_PER_WORD ); }
+
+	size_t segment_words( size_t const k ) const { return first_words_ << ( k - 1 ); } // also where segment k starts
+
+	Word& word_at( size_t const w ) const
+	{
+		if ( w < first_words_ ) { return first_[w]; }
+		auto const k = size_t ( std::bit_width ( w / first_words_ ) );
+		return segments_[k].load ( std::memory_order_acquire )[w - segment_words ( k )];
+	}
+
+	size_t check_index( size_t const bitpos ) const
+	{
+		if ( bitpos >= size () ) { throw std::out_of_range ( "bit position out of range" ); }
+		return bitpos;
+	}
+
+public:
+	explicit AtomicBitArray( size_t const nbits = 0 )
+		: first_words_ { std::max<size_t> ( 1, words_needed ( nbits ) ) }, first_ { new Word[first_words_] {} }, nbits_ { nbits } {}
+
+	template <class Allocator, class Instrumentation>
+	explicit AtomicBitArray( BitArray<IType, Allocator, Instrumentation> const& b ) : AtomicBitArray ( b.size () )
+	{
+		BitSpan<IType> const bits = b;
+		for ( size_t i {}; i < bits.nwords (); ++i ) { first_[i].store ( bits.word ( i ), std::memory_order_relaxed ); }
+	}
+
+	AtomicBitArray( AtomicBitArray const& ) = delete;
+	auto operator=( AtomicBitArray const& ) -> AtomicBitArray& = delete;
+
+	~AtomicBitArray()
+	{
+		for ( auto& segment : segments_ ) { delete[] segment.load ( std::memory_order_relaxed ); }
+	}
+
+	// Extends the array to `nbits` bits, all zero, if it is shorter; safe to call from any thread
+	// at any time, and the words already in use stay where they are
+	void grow( size_t const nbits )
+	{
+		auto const needed = words_needed ( nbits );
+		for ( size_t k { 1 }; k < MAX_SEGMENTS && segment_words ( k ) < needed; ++k )
+		{
+			if ( segments_[k].load ( std::memory_order_acquire ) ) { continue; }
+			auto* fresh = new Word[segment_words ( k )] {};
+			Word* expected {};
+			if ( !segments_[k].compare_exchange_strong ( expected, fresh, std::memory_order_acq_rel ) ) { delete[] fresh; }
+		}
+		auto current = nbits_.load ( std::memory_order_relaxed );
+		while ( current < nbits && !nbits_.compare_exchange_weak ( current, nbits, std::memory_order_release, std::memory_order_relaxed ) ) {}
+	}
+
+	size_t size() const { return nbits_.load ( std::memory_order_acquire ); }
+
+	// Bit ops; each is one atomic instruction on the word holding the bit
+	bool test( size_t const bitpos, std::memory_order const order = std::memory_order_acquire ) const
+	{
+		return ( word_at ( check_index ( bitpos ) / BITS_PER_WORD ).load ( order ) & mask1 ( bitpos ) ) != 0;
+	}
+
+	bool operator[]( size_t const bitpos ) const { return test ( bitpos ); }
+
+	void set( size_t const bitpos, std::memory_order const order = std::memory_order_acq_rel )
+	{
+		word_at ( check_index ( bitpos ) / BITS_PER_WORD ).fetch_or ( mask1 ( bitpos ), order );
+	}
+
+	void reset( size_t const bitpos, std::memory_order const order = std::memory_order_acq_rel )
+	{
+		word_at ( check_index ( bitpos ) / BITS_PER_WORD ).fetch_and ( IType ( ~mask1 ( bitpos ) ), order );
+	}
+
+	// sets the bit and reports whether it was already set; exactly one of any number of racing
+	// callers sees `false`, which is what claims a vertex in a traversal
+	bool test_and_set( size_t const bitpos, std::memory_order const order = std::memory_order_acq_rel )
+	{
+		auto const mask = mask1 ( bitpos );
+		return ( word_at ( check_index ( bitpos ) / BITS_PER_WORD ).fetch_or ( mask, order ) & mask ) != 0;
+	}
+
+	// ORs `mask` into word `word_index` (bits [word_index * BITS_PER_WORD, ...)) and returns the
+	// word as it was; mask bits past the end of the array are ignored
+	IType fetch_or_word( size_t const word_index, IType mask, std::memory_order const order = std::memory_order_acq_rel )
+	{
+		auto const nbits = size ();
+		if ( word_index >= words_needed ( nbits ) ) { throw std::out_of_range ( "word index out of range" ); }
+		if ( auto const used = nbits - word_index * BITS_PER_WORD; used < BITS_PER_WORD ) { mask &= IType ( ( IType ( 1 ) << used ) - 1 ); }
+		return word_at ( word_index ).fetch_or ( mask, order );
+	}
+
+	// Counting ops
+	// Reads each word once with relaxed loads: exact when no thread is writing, otherwise some
+	// mix of the values the words held while it ran.
+	size_t count() const
+	{
+		size_t ones {};
+		for ( size_t w {}, n = words_needed ( size () ); w < n; ++w )
+		{
+			ones += size_t ( std::popcount ( word_at ( w ).load ( std::memory_order_relaxed ) ) );
+		}
+		return ones;
+	}
+
+	bool any() const
+	{
+		for ( size_t w {}, n = words_needed ( size () ); w < n; ++w )
+		{
+			if ( word_at ( w ).load ( std::memory_order_relaxed ) ) { return true; }
+		}
+		return false;
+	}
+
+	bool none() const { return !any (); }
+
+	// Copies the bits into a BitArray, word by word, with the same caveat as `count`
+	BitArray<IType> snapshot() const
+	{
+		BitArray<IType> b { size () };
+		for ( size_t w {}, n = b.bits_.size (); w < n; ++w ) { b.bits_[w] = word_at ( w ).load ( std::memory_order_acquire ); }
+		return b;
+	}
+};
+#endif // ATOMIC_BIT_ARRAY_H
@@ -0,0 +1,282 @@
+// bbitarray.cpp: A timing harness for the BitArray class
+#include <chrono>
+#include <cstddef>
+#include <iomanip>
+#include <iostream>
+#include <memory_resource>
+#include <sstream>
+#include <thread>
+#include <vector>
+#include "atomicbitarray.h"
+#include "bitarray.h"
+#include "bitarrayview.h"
+#include "compressedbitarray.h"
+#include "staticbitarray.h"
+using namespace std;
+
+namespace {
+	using clock_type = chrono::steady_clock;
+
+	// runs `op` `reps` times and reports the cost per bit touched
+	template <class Op>
+	double time_per_bit( char const* name, size_t nbits, size_t reps, Op op )
+	{
+		auto const start = clock_type::now ();
+		for ( size_t i {}; i < reps; ++i ) { op (); }
+		auto const elapsed = chrono::duration<double, nano> ( clock_type::now () - start ).count ();
+		auto const ns_per_bit = elapsed / ( double ( reps ) * double ( nbits ) );
+		cout << left << setw ( 28 ) << name << right << setw ( 12 ) << nbits << " bits "
+			<< setw ( 12 ) << fixed << setprecision ( 4 ) << ns_per_bit << " ns/bit" << endl;
+		return ns_per_bit;
+	}
+
+	// runs `op ( q )` for `queries` queries and reports the cost of each
+	template <class Op>
+	double time_per_query( char const* name, size_t queries, Op op )
+	{
+		auto const start = clock_type::now ();
+		for ( size_t q {}; q < queries; ++q ) { op ( q ); }
+		auto const elapsed = chrono::duration<double, nano> ( clock_type::now () - start ).count ();
+		auto const ns_per_query = elapsed / double ( queries );
+		cout << left << setw ( 28 ) << name << right << setw ( 12 ) << queries << " queries "
+			<< setw ( 9 ) << fixed << setprecision ( 4 ) << ns_per_query << " ns/query" << endl;
+		return ns_per_query;
+	}
+
+	// the one-bit-per-iteration shift the engine replaced, kept as the point of comparison
+	void bit_serial_left_shift( vector<size_t>& words, size_t nbits, size_t shift_amt )
+	{
+		auto constexpr width = CHAR_BIT * sizeof ( size_t );
+		for ( size_t i {}; i < nbits; ++i )
+		{
+			auto const from = i + shift_amt;
+			bool const bit = from < nbits && ( words.at ( from / width ) >> ( from % width ) & 1u );
+			auto& word = words.at ( i / width );
+			word = bit ? word | size_t ( 1 ) << ( i % width ) : word & ~( size_t ( 1 ) << ( i % width ) );
+		}
+	}
+
+	BitArray<> patterned( size_t nbits )
+	{
+		BitArray<> b { nbits };
+		for ( size_t i {}; i < nbits; i += 3 ) { b.toggle ( i ); }
+		return b;
+	}
+}
+
+int main()
+{
+	for ( size_t const nbits : { size_t ( 1 ) << 16, size_t ( 1 ) << 20, size_t ( 1 ) << 24 } )
+	{
+		auto const reps = ( size_t ( 1 ) << 26 ) / nbits;
+		auto b = patterned ( nbits );
+		vector<size_t> words ( ( nbits + 63 ) / 64, 0x9249249249249249ull );
+
+		auto const serial = time_per_bit ( "bit-serial shift (old)", nbits, 1,
+			[&] { bit_serial_left_shift ( words, nbits, 5 ); } );
+		auto const shift = time_per_bit ( "operator<<= (5)", nbits, reps, [&] { b <<= 5; } );
+		time_per_bit ( "operator>>= (5)", nbits, reps, [&] { b >>= 5; } );
+		time_per_bit ( "operator<<= (128, memmove)", nbits, reps, [&] { b <<= 128; } );
+		time_per_bit ( "insert(0, bit)", nbits, reps, [&] { b.insert ( 0, true ); } );
+		time_per_bit ( "erase(0)", nbits, reps, [&] { b.erase ( 0 ); } );
+
+		b = patterned ( nbits );
+		size_t volatile sink {};
+
+		auto const text = b.to_string ();
+		time_per_bit ( "BitArray(string)", nbits, reps, [&] { sink = BitArray<> { text }.size (); } );
+		time_per_bit ( "to_string()", nbits, reps, [&] { sink = b.to_string ().size (); } );
+		stringstream image;
+		b.write_binary ( image );
+		auto const raw = image.str ();
+		time_per_bit ( "read_binary()", nbits, reps, [&]
+		{
+			istringstream is { raw };
+			sink = BitArray<>::read_binary ( is ).size ();
+		} );
+		auto const path = filesystem::temp_directory_path () / "bbitarray.bin";
+		save_binary ( b, path );
+		time_per_bit ( "BitArrayView (mmap open)", nbits, reps, [&] { sink = BitArrayView<> { path }.size (); } );
+		filesystem::remove ( path );
+		time_per_bit ( "operator>>", nbits, reps, [&]
+		{
+			istringstream is { text };
+			BitArray<> read;
+			is >> read;
+			sink = read.size ();
+		} );
+
+		time_per_bit ( "count()", nbits, reps, [&] { sink = b.count (); } );
+		time_per_bit ( "any() on all zeros", nbits, reps, [&, zeros = BitArray<> { nbits }] { sink = zeros.any (); } );
+		time_per_bit ( "all()", nbits, reps, [&] { sink = b.all (); } );
+
+		BitArray<> const mask = ~b; // a copy, not a lazy view of `b`
+		time_per_bit ( "operator&=", nbits, reps, [&] { b &= mask; } );
+		time_per_bit ( "operator^=", nbits, reps, [&] { b ^= mask; } );
+		time_per_bit ( "count_and (fused)", nbits, reps, [&] { sink = count_and ( b, mask ); } );
+		time_per_bit ( "( a & b ).count ()", nbits, reps, [&] { sink = ( b & mask ).count (); } );
+
+		auto const same = b;
+		time_per_bit ( "operator== (equal)", nbits, reps, [&] { sink = b == same; } );
+		time_per_bit ( "operator< (equal)", nbits, reps, [&] { sink = b < same; } );
+		time_per_bit ( "std::hash", nbits, reps, [&] { sink = hash<BitArray<>> {} ( b ); } );
+
+		// sparse scans: one bit in a thousand is set
+		BitArray<> sparse { nbits };
+		for ( size_t i {}; i < nbits; i += 1000 ) { sparse[i] = true; }
+		time_per_bit ( "set_bits() sparse", nbits, reps, [&] { for ( auto const pos : sparse.set_bits () ) { sink = pos; } } );
+		time_per_bit ( "find_next() sparse", nbits, reps, [&]
+		{
+			for ( auto pos = sparse.find_first (); pos != BitArray<>::npos; pos = sparse.find_next ( pos ) ) { sink = pos; }
+		} );
+		// log ingest: the array is rebuilt from 37-bit pieces
+		auto const piece = patterned ( 37 );
+		time_per_bit ( "operator+= (37-bit pieces)", nbits, reps, [&]
+		{
+			BitArray<> log;
+			for ( size_t i {}; i < nbits / 37; ++i ) { log += piece; }
+			sink = log.size ();
+		} );
+		time_per_bit ( "insert(middle, 37 bits)", nbits, reps, [&] { b.insert ( nbits / 2 + 5, piece ); b.erase ( 0, 37 ); } );
+
+		// windows: the middle half, starting off a word boundary
+		time_per_bit ( "slice() aligned", nbits / 2, reps, [&] { sink = b.slice ( nbits / 4, nbits / 2 ).size (); } );
+		time_per_bit ( "slice() unaligned", nbits / 2, reps, [&] { sink = b.slice ( nbits / 4 + 3, nbits / 2 ).size (); } );
+		time_per_bit ( "span().count() unaligned", nbits / 2, reps, [&] { sink = b.span ( nbits / 4 + 3, nbits / 2 ).count (); } );
+		time_per_bit ( "operator&= span unaligned", nbits / 2, reps, [&] { BitArray<> window { nbits / 2 }; sink = ( window &= b.span ( 3, nbits / 2 ) ).size (); } );
+
+		// rank/select at scattered positions of a fresh pattern
+		auto ranked = patterned ( nbits );
+		auto const ones = ranked.count ();
+		time_per_query ( "rank1() scan", 256, [&]( size_t q ) { sink = ranked.rank1 ( q * 40961 % nbits ); } );
+		time_per_query ( "select1() scan", 256, [&]( size_t q ) { sink = ranked.select1 ( q * 40961 % ones ); } );
+		time_per_bit ( "build_rank_index()", nbits, reps, [&] { ranked.build_rank_index (); } );
+		cout << "rank index overhead: " << setprecision ( 2 )
+			<< 100.0 * double ( ranked.rank_index_bytes () ) / double ( nbits / CHAR_BIT ) << "%" << endl;
+		time_per_query ( "rank1() indexed", 1 << 20, [&]( size_t q ) { sink = ranked.rank1 ( q * 40961 % nbits ); } );
+		time_per_query ( "select1() indexed", 1 << 20, [&]( size_t q ) { sink = ranked.select1 ( q * 40961 % ones ); } );
+
+		cout << "speedup over bit-serial shift: " << setprecision ( 1 ) << serial / shift << "x\n" << endl;
+	}
+
+	// a shared visited set: every thread claims scattered vertices with test_and_set
+	{
+		auto const nbits = size_t ( 1 ) << 24;
+		auto const claims = size_t ( 1 ) << 24; // in total, split between the threads
+		for ( unsigned nthreads { 1 }; nthreads <= 64; nthreads *= 2 )
+		{
+			AtomicBitArray<> visited { nbits };
+			string const name = "test_and_set, " + std::to_string ( nthreads ) + " threads";
+			time_per_bit ( name.c_str (), claims, 1, [&]
+			{
+				vector<thread> threads;
+				for ( unsigned t {}; t < nthreads; ++t )
+				{
+					threads.emplace_back ( [&, t]
+					{
+						for ( auto i = size_t ( t ); i < claims; i += nthreads ) { visited.test_and_set ( i * 0x9E3779B1 % nbits ); }
+					} );
+				}
+				for ( auto& th : threads ) { th.join (); }
+			} );
+		}
+		cout << "(cores available: " << thread::hardware_concurrency () << ")\n" << endl;
+	}
+
+	// parallel bulk ops: the same ops on pools of 1 to 8 threads at 2^28 bits, then `par` against
+	// `seq` across sizes with no cutoff, which shows where splitting starts to pay
+	{
+		size_t volatile sink {};
+		auto b = patterned ( size_t ( 1 ) << 28 );
+		for ( size_t nthreads { 1 }; nthreads <= 8; nthreads *= 2 )
+		{
+			bitkernels::thread_pool pool { nthreads };
+			bitkernels::parallel_policy const policy { &pool, 0 };
+			cout << nthreads << " thread(s):" << endl;
+			time_per_bit ( "  count(par)", b.size (), 8, [&] { sink = b.count ( policy ); } );
+			time_per_bit ( "  toggle(par)", b.size (), 8, [&] { b.toggle ( policy ); } );
+			time_per_bit ( "  shift_left(par, 37)", b.size (), 4, [&] { b.shift_left ( policy, 37 ); } );
+			time_per_bit ( "  to_string(par)", b.size (), 1, [&] { sink = b.to_string ( policy ).size (); } );
+		}
+		cout << "(cores available: " << thread::hardware_concurrency () << ")" << endl;
+
+		bitkernels::parallel_policy const eager { nullptr, 0 };
+		for ( size_t nbits { 1 << 16 }; nbits <= size_t ( 1 ) << 28; nbits <<= 4 )
+		{
+			auto c = patterned ( nbits );
+			auto const reps = ( size_t ( 1 ) << 30 ) / nbits;
+			auto const serial = time_per_bit ( "count(seq)", nbits, reps, [&] { sink = c.count ( bitkernels::seq ); } );
+			auto const split = time_per_bit ( "count(par), no cutoff", nbits, reps, [&] { sink = c.count ( eager ); } );
+			cout << "  par/seq: " << setprecision ( 2 ) << split / serial << endl;
+		}
+		cout << "(default cutoff: " << bitkernels::par.min_bytes << " bytes)\n" << endl;
+	}
+
+	// fixed-size masks: the same 256-bit test with the size known at compile time and not
+	{
+		size_t volatile sink {};
+		StaticBitArray<256> fixed_a, fixed_b;
+		BitArray<> dynamic_a { 256 }, dynamic_b { 256 };
+		for ( size_t i {}; i < 256; i += 3 ) { fixed_a[i] = dynamic_a[i] = true; }
+		for ( size_t i {}; i < 256; i += 5 ) { fixed_b[i] = dynamic_b[i] = true; }
+		time_per_query ( "Static<256> (a & b).count", 1 << 22, [&]( size_t ) { sink = ( fixed_a & fixed_b ).count (); } );
+		time_per_query ( "BitArray(256) count_and", 1 << 22, [&]( size_t ) { sink = count_and ( dynamic_a, dynamic_b ); } );
+		time_per_query ( "Static<256> <<= 1", 1 << 22, [&]( size_t ) { fixed_a <<= 1; } );
+		time_per_query ( "BitArray(256) <<= 1", 1 << 22, [&]( size_t ) { dynamic_a <<= 1; } );
+		cout << endl;
+	}
+
+	// instrumentation: a short op with the default policy, which compiles to nothing, and with `counting`
+	{
+		size_t volatile sink {};
+		using Counted = BitArray<size_t, allocator<size_t>, bitstats::counting>;
+		BitArray<> plain { 4096 };
+		Counted counted { 4096 };
+		time_per_query ( "count(4096), bitstats::off", 1 << 22, [&]( size_t ) { sink = plain.count (); } );
+		time_per_query ( "count(4096), counting", 1 << 22, [&]( size_t ) { sink = counted.count (); } );
+		cout << Counted::stats () << endl;
+	}
+
+	// short-lived bitmaps: build, fill and drop one per query
+	{
+		size_t volatile sink {};
+		auto const churn = [&]<class Array>( Array&& b )
+		{
+			b[0] = b[b.size () / 2] = true;
+			sink = b.count ();
+		};
+		time_per_query ( "200 bits, inline", 1 << 20, [&]( size_t ) { churn ( BitArray<> { 200 } ); } );
+		time_per_query ( "1000 bits, std::allocator", 1 << 20, [&]( size_t ) { churn ( BitArray<> { 1000 } ); } );
+		std::pmr::unsynchronized_pool_resource pool;
+		time_per_query ( "1000 bits, pmr pool", 1 << 20, [&]( size_t ) { churn ( PmrBitArray<> { 1000, &pool } ); } );
+		std::pmr::monotonic_buffer_resource arena;
+		time_per_query ( "1000 bits, pmr arena", 1 << 20, [&]( size_t q )
+		{
+			churn ( PmrBitArray<> { 1000, &arena } );
+			if ( q % 1024 == 1023 ) { arena.release (); } // one request's worth
+		} );
+		cout << endl;
+	}
+
+	// dense versus compressed on a sparse bitmap: 2^28 ids, one in 200 set in clustered bands
+	{
+		auto const nbits = size_t ( 1 ) << 28;
+		BitArray<> dense_a { nbits }, dense_b { nbits };
+		for ( size_t i {}; i < nbits; i += 200 ) { dense_a[i] = true; }
+		for ( size_t i {}; i < nbits; i += 1 << 20 ) { for ( size_t j {}; j < 4096; ++j ) { dense_b[i + j] = true; } }
+		CompressedBitArray compressed_a { dense_a }, compressed_b { dense_b };
+		compressed_b.optimize ();
+
+		cout << "dense bytes: " << nbits / CHAR_BIT << ", compressed bytes: "
+			<< compressed_a.memory_usage () + compressed_b.memory_usage () << " for both operands" << endl;
+		size_t volatile sink {};
+		time_per_bit ( "dense count()", nbits, 4, [&] { sink = dense_a.count (); } );
+		time_per_bit ( "compressed count()", nbits, 4, [&] { sink = compressed_a.count (); } );
+		time_per_bit ( "dense a & b", nbits, 4, [&] { sink = BitArray<> ( dense_a & dense_b ).size (); } );
+		time_per_bit ( "compressed a & b", nbits, 4, [&] { sink = ( compressed_a & compressed_b ).size (); } );
+		time_per_bit ( "dense a | b", nbits, 4, [&] { sink = BitArray<> ( dense_a | dense_b ).size (); } );
+		time_per_bit ( "compressed a | b", nbits, 4, [&] { sink = ( compressed_a | compressed_b ).size (); } );
+		time_per_bit ( "dense set_bits()", nbits, 4, [&] { for ( auto const pos : dense_a.set_bits () ) { sink = pos; } } );
+		time_per_bit ( "compressed set_bits()", nbits, 4, [&] { for ( auto const pos : compressed_a.set_bits () ) { sink = pos; } } );
+	}
+}
@@ -0,0 +1,264 @@
+#ifndef BENCH_H
+#define BENCH_H
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <ctime>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <regex>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+// Benchmark Scaffolding: a small harness in the shape of Google Benchmark, so its JSON
+// can be compared with the usual tools (e.g. benchmark's compare.py).
+// Register a case with `bench::add`, then time its body with a range-for over the state:
+//    bench::add ( "count/4096", []( bench::state& s )
+//    {
+//       auto b = ...;               // setup, not timed
+//       for ( auto _ : s ) { bench::do_not_optimize ( b.count () ); }
+//       s.set_bits ( 4096 );        // bits touched per iteration
+//    } );
+//    return bench::run ( argc, argv );
+// Each case is rerun with more iterations until one run lasts the minimum time. The report
+// gives the time per iteration and per bit and the throughput of the packed bits, and
+// `--benchmark_out=<file>` writes the same numbers as JSON.
+// Flags: --benchmark_filter=<regex> --benchmark_min_time=<seconds> --benchmark_out=<file>
+
+namespace bench
+{
+	using clock_type = std::chrono::steady_clock;
+
+	// keeps the compiler from discarding a result that is never used
+	template <class T>
+	inline void do_not_optimize( T const& value )
+	{
+#if defined( __GNUC__ ) || defined( __clang__ )
+		asm volatile ( "" : : "r,m" ( value ) : "memory" );
+#else
+		static_cast<void> ( *static_cast<char const volatile*> ( static_cast<void const*> ( &value ) ) );
+#endif
+	}
+
+	class state
+	{
+		size_t iterations_;
+		size_t bits_ {};
+		clock_type::time_point start_ {};
+		std::clock_t cpu_start_ {};
+		double real_ns_ {};
+		double cpu_ns_ {};
+
+		void start()
+		{
+			start_ = clock_type::now ();
+			cpu_start_ = std::clock ();
+		}
+
+		void stop()
+		{
+			real_ns_ += std::chrono::duration<double, std::nano> ( clock_type::now () - start_ ).count ();
+			cpu_ns_ += double ( std::clock () - cpu_start_ ) * 1e9 / CLOCKS_PER_SEC;
+		}
+
+	public:
+		explicit state( size_t const iterations ) : iterations_ { iterations } {}
+
+		// counts down the iterations; the clock runs from the first `begin` to the final `!=`
+		class iterator
+		{
+			state* s_;
+			size_t left_;
+		public:
+			iterator( state* s, size_t left ) : s_ { s }, left_ { left } {}
+			struct value { ~value() {} }; // not trivial, so an unused loop variable draws no warning
+			value operator*() const { return {}; }
+			iterator& operator++()
+			{
+				--left_;
+				return *this;
+			}
+			bool operator!=( iterator const& ) const
+			{
+				if ( left_ ) { return true; }
+				s_->stop ();
+				return false;
+			}
+		};
+
+		iterator begin()
+		{
+			start ();
+			return { this, iterations_ };
+		}
+
+		iterator end() { return { this, 0 }; }
+
+		// leaves the work between the two out of the timing, e.g. undoing what an iteration did
+		void pause_timing() { stop (); }
+		void resume_timing() { start (); }
+
+		void set_bits( size_t const bits ) { bits_ = bits; } // bits touched by one iteration
+
+		size_t iterations() const { return iterations_; }
+		size_t bits() const { return bits_; }
+		double real_ns() const { return real_ns_; }
+		double cpu_ns() const { return cpu_ns_; }
+	};
+
+	struct result
+	{
+		std::string name;
+		size_t iterations;
+		double real_ns;   // per iteration
+		double cpu_ns;    // per iteration
+		size_t bits;      // per iteration
+	};
+
+	namespace detail
+	{
+		struct entry
+		{
+			std::string name;
+			std::function<void( state& )> body;
+		};
+
+		inline std::vector<entry>& registry()
+		{
+			static std::vector<entry> entries;
+			return entries;
+		}
+
+		inline std::string json_escape( std::string_view const text )
+		{
+			std::string out;
+			for ( auto const c : text )
+			{
+				if ( c == '"' || c == '\\' ) { out += '\\'; }
+				out += c;
+			}
+			return out;
+		}
+
+		// the first run that lasts `min_time`, growing the iteration count from a single one
+		inline result measure( entry const& e, double const min_time )
+		{
+			for ( size_t n { 1 };; )
+			{
+				state s { n };
+				e.body ( s );
+				auto const seconds = s.real_ns () * 1e-9;
+				if ( seconds >= min_time || n >= size_t ( 1 ) << 40 )
+				{
+					return { e.name, n, s.real_ns () / double ( n ), s.cpu_ns () / double ( n ), s.bits () };
+				}
+				// aim a little past the minimum, but never grow more than a hundredfold at once
+				auto const scale = seconds > 0 ? 1.4 * min_time / seconds : 100.0;
+				n = std::max ( n + 1, size_t ( double ( n ) * std::min ( scale, 100.0 ) ) );
+			}
+		}
+
+		inline void write_json( std::ostream& os, std::vector<result> const& results, char const* executable, std::string_view const context )
+		{
+			auto const now = std::time ( nullptr );
+			char date[32];
+			std::strftime ( date, sizeof date, "%Y-%m-%dT%H:%M:%S", std::localtime ( &now ) );
+			os << "{\n  \"context\": {\n"
+				<< "    \"date\": \"" << date << "\",\n"
+				<< "    \"executable\": \"" << json_escape ( executable ) << "\",\n"
+				<< "    \"num_cpus\": " << std::thread::hardware_concurrency () << ",\n"
+				<< context
+#ifdef NDEBUG
+				<< "    \"library_build_type\": \"release\"\n"
+#else
+				<< "    \"library_build_type\": \"debug\"\n"
+#endif
+				<< "  },\n  \"benchmarks\": [";
+			os << std::setprecision ( 10 );
+			for ( size_t i {}; i < results.size (); ++i )
+			{
+				auto const& r = results[i];
+				os << ( i ? ",\n" : "\n" ) << "    {\n"
+					<< "      \"name\": \"" << json_escape ( r.name ) << "\",\n"
+					<< "      \"run_name\": \"" << json_escape ( r.name ) << "\",\n"
+					<< "      \"run_type\": \"iteration\",\n"
+					<< "      \"iterations\": " << r.iterations << ",\n"
+					<< "      \"real_time\": " << r.real_ns << ",\n"
+					<< "      \"cpu_time\": " << r.cpu_ns << ",\n"
+					<< "      \"time_unit\": \"ns\"";
+				if ( r.bits )
+				{
+					os << ",\n      \"bytes_per_second\": " << double ( r.bits ) / 8 / ( r.real_ns * 1e-9 )
+						<< ",\n      \"ns_per_bit\": " << r.real_ns / double ( r.bits );
+				}
+				os << "\n    }";
+			}
+			os << "\n  ]\n}\n";
+		}
+	}
+
+	inline void add( std::string name, std::function<void( state& )> body )
+	{
+		detail::registry ().push_back ( { std::move ( name ), std::move ( body ) } );
+	}
+
+	// Runs every registered case whose name matches the filter and prints a table; returns
+	// the exit code for `main`. `context` is extra JSON lines for the "context" object,
+	// each of the form `    "key": value,\n`.
+	inline int run( int argc, char** argv, std::string_view const context = {} )
+	{
+		std::regex filter { ".*" };
+		double min_time { 0.1 };
+		std::string out_path;
+		for ( int i { 1 }; i < argc; ++i )
+		{
+			std::string_view const arg { argv[i] };
+			auto const value = [&]( std::string_view flag ) { return std::string ( arg.substr ( flag.size () ) ); };
+			if ( arg.starts_with ( "--benchmark_filter=" ) ) { filter = std::regex { value ( "--benchmark_filter=" ) }; }
+			else if ( arg.starts_with ( "--benchmark_min_time=" ) ) { min_time = std::stod ( value ( "--benchmark_min_time=" ) ); }
+			else if ( arg.starts_with ( "--benchmark_out=" ) ) { out_path = value ( "--benchmark_out=" ); }
+			else
+			{
+				std::cerr << "unknown flag: " << arg << '\n';
+				return 1;
+			}
+		}
+
+		std::cout << std::left << std::setw ( 36 ) << "Benchmark" << std::right << std::setw ( 14 ) << "Time (ns)"
+			<< std::setw ( 14 ) << "CPU (ns)" << std::setw ( 14 ) << "Iterations" << std::setw ( 12 ) << "ns/bit"
+			<< std::setw ( 10 ) << "GB/s" << '\n' << std::string ( 100, '-' ) << std::endl;
+		std::vector<result> results;
+		for ( auto const& e : detail::registry () )
+		{
+			if ( !std::regex_search ( e.name, filter ) ) { continue; }
+			auto const r = detail::measure ( e, min_time );
+			std::cout << std::left << std::setw ( 36 ) << r.name << std::right << std::fixed << std::setprecision ( 1 )
+				<< std::setw ( 14 ) << r.real_ns << std::setw ( 14 ) << r.cpu_ns << std::setw ( 14 ) << r.iterations;
+			if ( r.bits )
+			{
+				std::cout << std::setprecision ( 4 ) << std::setw ( 12 ) << r.real_ns / double ( r.bits )
+					<< std::setprecision ( 2 ) << std::setw ( 10 ) << double ( r.bits ) / 8 / r.real_ns;
+			}
+			std::cout << std::endl;
+			results.push_back ( r );
+		}
+
+		if ( !out_path.empty () )
+		{
+			std::ofstream os { out_path };
+			detail::write_json ( os, results, argv[0], context );
+			if ( !os )
+			{
+				std::cerr << "could not write " << out_path << '\n';
+				return 1;
+			}
+		}
+		return 0;
+	}
+}
+#endif
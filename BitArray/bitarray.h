@@ -15,40 +15,93 @@
 #define BIT_ARRAY_H
 #include <vector>
 #include <climits>
+#include <cstring>
+#include <stdexcept>
 #include <ostream>
 #include <string>
 #include <algorithm>
+#include <atomic>
 #include <sstream>
 #include <iterator>
+#include <limits>
 #include <locale>
 #include <iostream>
-
-template <class IType = size_t>
+#include <bit>
+#include <compare>
+#include <cstdint>
+#include <functional>
+#include <memory_resource>
+#include <mutex>
+#include <string_view>
+#include <utility>
+#include "bitexpr.h"
+#include "bitkernels.h"
+#include "bitspan.h"
+#include "bitstats.h"
+#include "bitstorage.h"
+#include "bitword.h"
+#include "rankindex.h"
+
+class CompressedBitArray;
+template <class> class BitmapQuery;
+namespace bloom { template <class, class> class blocked_filter; }
+template <class> class BitWriter;
+template <class> class BitReader;
+
+// `IType` is any unsigned integer or a `BitBlock` (see bitword.h); `Instrumentation` is one
+// of the policies in bitstats.h, and the default records nothing
+template <class IType = size_t, class Allocator = std::allocator<IType>, class Instrumentation = bitstats::off>
 // throw `logic_error` if any out-of-range indexing is attempted anywhere
 class BitArray
 {
 	class Bitproxy final
 	{
 		// Bitproxy is called 'reference' in `bits.cpp
-		size_t pos_;
-		BitArray b_;
+		// holds the word that contains the bit and the bit's mask, so a read is one load and a
+		// write one load and store; `rank_` is the array's rank directory, which a write drops.
+		// Like any reference into the array, it is invalidated by anything that changes the size.
+		IType* word_;
+		IType mask_;
+		RankIndex<Allocator>** rank_;
 	public:
-		Bitproxy( BitArray& bit_array, size_t const& pos ) : b_ { bit_array } { pos_ = pos; }
-		Bitproxy& operator=( bool const bit )
+		Bitproxy( BitArray& bit_array, size_t const& pos ) noexcept
+			: word_ { bit_array.bits_.data () + word_offset ( pos ) }, mask_ { mask1 ( bit_offset ( pos ) ) },
+			rank_ { &bit_array.rank_ } {}
+		Bitproxy( Bitproxy const& other ) = default;
+
+		Bitproxy& operator=( bool const bit ) noexcept
 		{
 			// set the bit in position pos to true or false; per bit
-			b_.assign_bit ( pos_, bit );
+			auto const before = *word_;
+			*word_ = bit ? IType ( before | mask_ ) : IType ( before & ~mask_ );
+			if ( *word_ != before && *rank_ ) { ( *rank_ )->invalidate (); }
 			return *this;
 		}
 
-		operator bool() const
+		// `b[i] = b[j]` copies the bit, not the proxy
+		Bitproxy& operator=( Bitproxy const& other ) noexcept { return *this = bool ( other ); }
+
+		operator bool() const noexcept
+		{
+			// return true or false per the bit under `mask_`
+			return ( *word_ & mask_ ) != 0;
+		}
+
+		// `swap ( b[i], b[j] )` exchanges the bits
+		friend void swap( Bitproxy a, Bitproxy b ) noexcept
 		{
-			// return true or false per the bit in position pos_
-			// return b_.data & (1u << pos);
-			return b_.read_bit ( pos_ );
+			bool const bit = a;
+			a = bool ( b );
+			b = bit;
 		}
 	};
 
+	size_t check_index( size_t const& bitpos ) const
+	{
+		if ( bitpos >= nbits_ ) { throw std::out_of_range ( "bit position out of range" ); }
+		return bitpos;
+	}
+
 	IType wrap_index(size_t const& index)
 	{
 		return index % nbits_;
@@ -61,19 +114,94 @@ class BitArray
 
 	void grow(size_t const& nbits)
 	{
+		drop_rank (); // the size is changing, so the rank directory no longer fits
 		auto space_required = words_needed ( nbits );
 		if (space_required > bits_.size ())
 		{
+			// at least double the allocation, so a run of appends reallocates O(log n) times
+			if ( space_required > bits_.capacity () )
+			{
+				bits_.reserve ( std::max ( space_required, 2 * bits_.capacity () ) );
+				note_allocation ( 0 );
+			}
 			bits_.resize ( space_required );
 		}
 	}
 
+	bitexpr::words<IType> leaf() const { return { bits_.data (), nbits_ }; } // this array as an expression operand
+
+	using probe = bitstats::probe<Instrumentation>; // times the public op it is declared in
+
+	// reports a new heap buffer to the instrumentation when the capacity is no longer `old_capacity`
+	void note_allocation( size_t const old_capacity )
+	{
+		if constexpr ( Instrumentation::enabled )
+		{
+			auto const capacity = bits_.capacity ();
+			if ( capacity != old_capacity && capacity > BitStorage<IType, Allocator>::INLINE_WORDS )
+			{
+				Instrumentation::reallocated ( capacity * sizeof ( IType ) );
+			}
+		}
+	}
+
+	// ORs the bits of `s` into [bitpos, bitpos + s.size ()), which must be all zeros;
+	// each word of `s` lands in at most two words here
+	void deposit( size_t const& bitpos, BitSpan<IType> const& s )
+	{
+		auto const first = word_offset ( bitpos );
+		auto const shift = bit_offset ( bitpos );
+		auto const n = s.nwords ();
+		if ( n == 0 ) { return; }
+		if ( shift == 0 )
+		{
+			// the words line up: all but the last are copied, and the last may share its word
+			// with the bits after the gap
+			if ( auto const* aligned = s.aligned_words () ) { std::memcpy ( bits_.data () + first, aligned, ( n - 1 ) * sizeof ( IType ) ); }
+			else { for ( size_t i {}; i + 1 < n; ++i ) { bits_[first + i] = s.word ( i ); } }
+			bits_[first + n - 1] |= s.word ( n - 1 );
+			return;
+		}
+		for ( size_t i {}; i < n; ++i )
+		{
+			auto const word = s.word ( i );
+			bits_[first + i] |= IType ( word << shift );
+			if ( IType const spill = IType ( word >> ( BITS_PER_WORD - shift ) ) ) { bits_[first + i + 1] |= spill; }
+		}
+	}
+
 	enum { BITS_PER_WORD = CHAR_BIT * sizeof ( IType ) };
 
-	std::vector<IType> bits_ {}; // a collection to store our bits
+	BitStorage<IType, Allocator> bits_ {}; // a collection to store our bits; small arrays stay inside the object
 
 	size_t nbits_ {}; // the number of bits currently in use
 
+	// the rank directory, created by `build_rank_index` from the array's allocator, so an array
+	// that is never indexed holds none. Only `build_rank_index` fills it, so the const queries
+	// never write to it
+	RankIndex<Allocator>* rank_ {};
+
+	using rank_allocator = typename std::allocator_traits<Allocator>::template rebind_alloc<RankIndex<Allocator>>;
+	using rank_traits = std::allocator_traits<rank_allocator>;
+
+	bool indexed() const { return rank_ && rank_->built (); }
+
+	// the bits are changing wholesale, so the directory no longer fits; its tables are kept for
+	// the next build
+	void drop_rank()
+	{
+		if ( rank_ ) { rank_->clear (); }
+	}
+
+	void free_rank() noexcept
+	{
+		if ( !rank_ ) { return; }
+		rank_allocator alloc { get_allocator () };
+		rank_traits::destroy ( alloc, rank_ );
+		rank_traits::deallocate ( alloc, rank_, 1 );
+		rank_ = nullptr;
+	}
+
 protected:
 	bool read_bit( size_t const& bitpos ) const
 	{
@@ -84,7 +212,7 @@ protected:
 		auto const offset = bit_offset ( bitpos ); // 18 = 50 % 32
 
 		// get a 1s mask at our bit location and & with it in order to only get that single bit value
-		return word &= mask1 ( offset );
+		return static_cast<bool> ( word & mask1 ( offset ) );
 	}
 
 	void assign_bit( size_t const& bitpos, bool bit )
@@ -93,6 +221,7 @@ protected:
 		// depending ont the value of `bit`
 		
 		auto word = read_word ( bitpos );
+		auto const before = word;
 		auto const offset = bit_offset ( bitpos ); // 18 = 50 % 32
 
 		// if we are setting the bit then we want a 1 mask
@@ -111,6 +240,7 @@ protected:
 		}
 
 		set_word ( word, bitpos );
+		if ( word != before && rank_ ) { rank_->invalidate (); }
 	}
 
 	// how big does the vector need to be
@@ -119,7 +249,7 @@ protected:
 /// </summary>
 /// <param name="nbits">The number of bits.</param>
 /// <returns>The number of words required.</returns>
-	static size_t words_needed ( size_t const& nbits ) { return word_offset ( nbits ); }
+	static size_t words_needed ( size_t const& nbits ) { return ( nbits + BITS_PER_WORD - 1 ) / BITS_PER_WORD; }
 
 	// which word in vector for given offset
 /// <summary>
@@ -148,128 +278,789 @@ protected:
 		bits_[block] = word;
 	}
 
-	static IType mask1( size_t const& bitpos ) { return 1u << bitpos; } // returns a 1 mask shifted properly
+	static IType mask1( size_t const& bitpos ) { return IType ( 1 ) << bitpos; } // returns a 1 mask shifted properly
 
 	static IType mask0( size_t const& bitpos ) { return ~mask1 ( bitpos ); } // returns a 0 mask shifted properly
+
+	// returns a mask with the lowest `nbits` bits set
+	static IType low_mask( size_t const& nbits )
+	{
+		return nbits ? IType ( IType ( ~IType ( 0 ) ) >> ( BITS_PER_WORD - nbits ) ) : IType ( 0 );
+	}
 	
 	// counts bits set in bitarray
-	size_t count_ones( IType word ) const
+	static size_t count_ones( IType word ) { return bitword::popcount ( word ); }
+
+	static IType clean_word( IType word, size_t nbits ) // reset unused bits in last word
+	{
+		auto used_bits = nbits % BITS_PER_WORD;
+		if (used_bits)
+		{
+			IType mask = ( IType ( 1 ) << used_bits ) - 1;
+			word &= mask;
+		}
+		return word;
+	} 
+
+	// keeps the storage bits at or past `nbits_` zeroed so whole words can be shifted and compared
+	void clean_tail()
+	{
+		auto const used = words_needed ( nbits_ );
+		if ( used ) { bits_[used - 1] = clean_word ( bits_[used - 1], nbits_ ); }
+	}
+
+	// the position of the first 1-bit at or after `bitpos`, or `npos`
+	size_t find_from( size_t const& bitpos ) const
+	{
+		probe const timing { bitstats::op::find };
+		auto const nwords = words_needed ( nbits_ );
+		auto i = word_offset ( bitpos );
+		if ( i >= nwords ) { return npos; }
+
+		// the first word is masked so the bits before `bitpos` are ignored
+		IType word = IType ( bits_[i] & ~low_mask ( bit_offset ( bitpos ) ) );
+		while ( !word )
+		{
+			if ( ++i == nwords ) { return npos; }
+			word = bits_[i];
+		}
+		return i * BITS_PER_WORD + size_t ( bitword::countr_zero ( word ) );
+	}
+
+	// throws `out_of_range` unless [bitpos, bitpos + count) is inside the array
+	void check_range( size_t const& bitpos, size_t const& count ) const
+	{
+		if ( bitpos > nbits_ || count > nbits_ - bitpos ) { throw std::out_of_range ( "range out of bounds" ); }
+	}
+
+	// Applies a range edit: `edit ( word, mask )` on the first and last words of
+	// [bitpos, bitpos + count), masked to the bits of the range they hold, and
+	// `fill ( words, n )` on the whole words in between
+	template <class Edit, class Fill>
+	void edit_range( size_t const& bitpos, size_t const& count, Edit edit, Fill fill )
+	{
+		probe const timing { bitstats::op::range };
+		check_range ( bitpos, count );
+		drop_rank ();
+		if ( !count ) { return; }
+		auto const first = word_offset ( bitpos );
+		auto const last = word_offset ( bitpos + count - 1 );
+		auto const head = IType ( ~low_mask ( bit_offset ( bitpos ) ) );
+		auto const tail = low_mask ( bit_offset ( bitpos + count - 1 ) + 1 );
+		if ( first == last )
+		{
+			edit ( bits_[first], IType ( head & tail ) );
+			return;
+		}
+		edit ( bits_[first], head );
+		fill ( bits_.data () + first + 1, last - first - 1 );
+		edit ( bits_[last], tail );
+	}
+
+	// resets every bit in [bitpos, nbits_)
+	void clear_from( size_t const& bitpos )
+	{
+		drop_rank ();
+		auto const first = word_offset ( bitpos );
+		auto const last = words_needed ( nbits_ );
+		if ( first >= last ) { return; }
+		bits_[first] &= low_mask ( bit_offset ( bitpos ) );
+		std::fill ( bits_.begin () + first + 1, bits_.begin () + last, IType ( 0 ) );
+	}
+
+	// Shift engine
+	// Logical bit `i` lives in word `i / BITS_PER_WORD` at machine bit `i % BITS_PER_WORD`,
+	// so sliding bits toward bit 0 is a machine right shift across the words and sliding them
+	// away from bit 0 is a machine left shift. Whole-word offsets are a single `memmove`;
+	// the remaining offset is applied one word at a time, carrying in from the neighbour.
+
+/// <summary>
+/// Slides the bits in [bitpos, nbits_) toward bit 0 by shift_amt positions.
+/// The bits in [bitpos, bitpos + shift_amt) are discarded and the vacated tail is zero filled.
+/// </summary>
+/// <param name="bitpos">The first bit that takes part in the shift.</param>
+/// <param name="shift_amt">The number of positions to slide.</param>
+	void left_shift_at( size_t const& bitpos, size_t const& shift_amt = 1 )
+	{
+		drop_rank ();
+		if ( shift_amt == 0 || bitpos >= nbits_ ) { return; }
+		if ( shift_amt >= nbits_ - bitpos )
+		{
+			clear_from ( bitpos );
+			return;
+		}
+
+		auto const first = word_offset ( bitpos );
+		auto const last = words_needed ( nbits_ );
+		auto const keep = low_mask ( bit_offset ( bitpos ) ); // bits below `bitpos` in the first word stay put
+		IType const saved = bits_[first] & keep;
+
+		auto const word_shift = word_offset ( shift_amt );
+		auto const bit_shift = bit_offset ( shift_amt );
+		auto const moved = last - first - word_shift; // words that receive shifted content
+		auto* const data = bits_.data ();
+
+		if ( bit_shift == 0 )
+		{
+			std::memmove ( data + first, data + first + word_shift, moved * sizeof ( IType ) );
+		}
+		else
+		{
+			bitword::shift_run_down ( data + first, data + first + word_shift, IType ( 0 ), moved, unsigned ( bit_shift ) );
+		}
+		std::fill ( data + first + moved, data + last, IType ( 0 ) );
+		data[first] = IType ( data[first] & ~keep ) | saved;
+	}
+
+/// <summary>
+/// Slides the bits in [bitpos, nbits_) away from bit 0 by shift_amt positions.
+/// Bits pushed past nbits_ are discarded and [bitpos, bitpos + shift_amt) is zero filled.
+/// </summary>
+/// <param name="bitpos">The first bit that takes part in the shift.</param>
+/// <param name="shift_amt">The number of positions to slide.</param>
+	void right_shift_at( size_t const& bitpos, size_t const& shift_amt = 1 )
+	{
+		drop_rank ();
+		if ( shift_amt == 0 || bitpos >= nbits_ ) { return; }
+		if ( shift_amt >= nbits_ - bitpos )
+		{
+			clear_from ( bitpos );
+			return;
+		}
+
+		auto const first = word_offset ( bitpos );
+		auto const last = words_needed ( nbits_ );
+		auto const keep = low_mask ( bit_offset ( bitpos ) ); // bits below `bitpos` in the first word stay put
+		IType const saved = bits_[first] & keep;
+
+		auto const word_shift = word_offset ( shift_amt );
+		auto const bit_shift = bit_offset ( shift_amt );
+		auto* const data = bits_.data ();
+
+		// the bits being kept must not be carried along with the rest
+		data[first] = IType ( data[first] & ~keep );
+
+		if ( bit_shift == 0 )
+		{
+			std::memmove ( data + first + word_shift, data + first, ( last - first - word_shift ) * sizeof ( IType ) );
+		}
+		else
+		{
+			bitword::shift_run_up ( data + first + word_shift, data + first, IType ( 0 ), last - first - word_shift, unsigned ( bit_shift ) );
+		}
+		std::fill ( data + first, data + first + word_shift, IType ( 0 ) );
+		data[first] |= saved;
+		clean_tail ();
+	}
+
+	// applies `Op` word by word with the `nbits` bits stored in `words`; the shorter operand is
+	// treated as zero extended, so the result is as long as the longer one
+	template <bitkernels::bitop Op>
+	BitArray& combine( IType const* words, size_t const nbits )
+	{
+		probe const timing { bitstats::op::combine };
+		drop_rank ();
+		if ( nbits > nbits_ )
+		{
+			grow ( nbits );
+			nbits_ = nbits;
+		}
+		if ( nbits ) { bitkernels::combine<Op> ( bits_.data (), words, words_needed ( nbits ) * sizeof ( IType ) ); }
+
+		// everything past the end of the other operand was ANDed with zero
+		if constexpr ( Op == bitkernels::bitop::and_op ) { clear_from ( nbits ); }
+		return *this;
+	}
+
+	template <bitkernels::bitop Op>
+	BitArray& combine( BitArray const& b ) { return combine<Op> ( b.bits_.data (), b.nbits_ ); }
+
+	// as above for a window at any offset: it is realigned a buffer at a time and the buffer
+	// goes to the same kernel, so only the realigning is extra work
+	template <bitkernels::bitop Op>
+	BitArray& combine( BitSpan<IType> const& s )
 	{
-		// clean the last word
-		bits_[bits_.size() - 1] = clean_word ( bits_.back () );
+		// a window that starts and ends on word boundaries is used in place
+		auto const* aligned = s.aligned_words ();
+		if ( aligned && bit_offset ( s.size () ) == 0 ) { return combine<Op> ( aligned, s.size () ); }
 
-		auto count { 0 };
-		std::for_each ( bits_.begin (), bits_.end (), [&count]( auto const& item )
+		probe const timing { bitstats::op::combine };
+		drop_rank ();
+		if ( s.size () > nbits_ )
 		{
-			auto temp = item;
-			for ( auto i { 0 }; i < BITS_PER_WORD; ++i )
+			grow ( s.size () );
+			nbits_ = s.size ();
+		}
+		IType buffer[64];
+		for ( size_t first {}, n = s.nwords (); first < n; first += std::size ( buffer ) )
+		{
+			auto const m = std::min ( std::size ( buffer ), n - first );
+			for ( size_t i {}; i < m; ++i ) { buffer[i] = s.word ( first + i ); }
+			bitkernels::combine<Op> ( bits_.data () + first, buffer, m * sizeof ( IType ) );
+		}
+		if constexpr ( Op == bitkernels::bitop::and_op ) { clear_from ( s.size () ); }
+		return *this;
+	}
+
+	// whether writing `e` into this array block by block would change what `e` reads: it reads
+	// these words through a shift, or reads them at all and the words must move to hold it
+	template <bitexpr::expression_of<IType> E>
+	bool aliases( E const& e ) const
+	{
+		if ( e.reads_shifted ( bits_.data () ) ) { return true; }
+		return words_needed ( e.size () ) > bits_.capacity () && e.reads ( bits_.data () );
+	}
+
+	// as above for a lazy expression, which is evaluated a block at a time into the kernel
+	template <bitkernels::bitop Op, bitexpr::expression_of<IType> E>
+	BitArray& combine( E const& e )
+	{
+		if ( aliases ( e ) ) { return combine<Op> ( BitArray ( e, get_allocator () ) ); }
+		probe const timing { bitstats::op::combine };
+		drop_rank ();
+		if ( e.size () > nbits_ )
+		{
+			grow ( e.size () );
+			nbits_ = e.size ();
+		}
+		auto* const words = bits_.data ();
+		e.for_each_block ( [words]( size_t first, IType const* block, size_t n ) { bitkernels::combine<Op> ( words + first, block, n * sizeof ( IType ) ); } );
+		if constexpr ( Op == bitkernels::bitop::and_op ) { clear_from ( e.size () ); }
+		return *this;
+	}
+
+	// as `combine ( b )`, with the words split into pieces by `policy`
+	template <bitkernels::bitop Op, class Policy>
+	BitArray& combine( Policy const& policy, BitArray const& b )
+	{
+		probe const timing { bitstats::op::combine };
+		drop_rank ();
+		if ( b.nbits_ > nbits_ )
+		{
+			grow ( b.nbits_ );
+			nbits_ = b.nbits_;
+		}
+		auto* const dst = reinterpret_cast<unsigned char*> ( bits_.data () );
+		auto const* const src = reinterpret_cast<unsigned char const*> ( b.bits_.data () );
+		bitkernels::for_each_chunk ( policy, words_needed ( b.nbits_ ) * sizeof ( IType ), [&]( size_t first, size_t last )
+		{
+			bitkernels::combine<Op> ( dst + first, src + first, last - first );
+		} );
+		if constexpr ( Op == bitkernels::bitop::and_op ) { clear_from ( b.nbits_ ); }
+		return *this;
+	}
+
+	// Whole-array shifts for `par`. Each output word is built from the (at most) two source words
+	// it takes bits from, so a piece never depends on what another piece writes, and the carry
+	// across a piece boundary is just a read of the neighbouring source word. The words are
+	// written to fresh storage, since shifting in place would overwrite words other pieces read.
+	template <class Policy>
+	void shift_whole( Policy const& policy, size_t const shift_amt, bool const toward_zero )
+	{
+		probe const timing { bitstats::op::shift };
+		auto const nwords = words_needed ( nbits_ );
+		drop_rank ();
+		if ( shift_amt == 0 ) { return; }
+		if ( shift_amt >= nbits_ )
+		{
+			clear_from ( 0 );
+			return;
+		}
+
+		auto const word_shift = word_offset ( shift_amt );
+		auto const bit_shift = bit_offset ( shift_amt );
+		BitStorage<IType, Allocator> shifted ( bits_.get_allocator () );
+		shifted.resize ( bits_.size () );
+		auto const* const src = bits_.data ();
+		auto* const dst = shifted.data ();
+		bitkernels::for_each_chunk ( policy, nwords * sizeof ( IType ), [&]( size_t first, size_t last )
+		{
+			for ( auto i { first / sizeof ( IType ) }; i < last / sizeof ( IType ); ++i )
 			{
-				count += temp & 1u;
-				temp >>= 1u;
+				IType word, carry;
+				if ( toward_zero )
+				{
+					word = i + word_shift < nwords ? src[i + word_shift] : IType ( 0 );
+					carry = i + word_shift + 1 < nwords ? src[i + word_shift + 1] : IType ( 0 );
+					dst[i] = bit_shift ? IType ( word >> bit_shift | carry << ( BITS_PER_WORD - bit_shift ) ) : word;
+				}
+				else
+				{
+					word = i >= word_shift ? src[i - word_shift] : IType ( 0 );
+					carry = i > word_shift ? src[i - word_shift - 1] : IType ( 0 );
+					dst[i] = bit_shift ? IType ( word << bit_shift | carry >> ( BITS_PER_WORD - bit_shift ) ) : word;
+				}
 			}
 		} );
-		return count;
+		bits_ = std::move ( shifted );
+		note_allocation ( 0 );
+		clean_tail ();
 	}
 
-	IType clean_word( IType word, size_t nbits ) // reset unused bits in last word
+	// the number of words both operands have in use
+	static size_t shared_words( BitArray const& a, BitArray const& b )
 	{
-		auto used_bits = nbits % BITS_PER_WORD;
-		if (used_bits)
+		return words_needed ( std::min ( a.nbits_, b.nbits_ ) );
+	}
+
+	// Text conversion works on 64-bit chunks: bits [64 * k, 64 * k + 64) form chunk `k`.
+	// Inputs of at least this many characters are parsed and formatted on every core.
+	static constexpr size_t PARALLEL_TEXT_MIN = size_t ( 1 ) << 24;
+	static constexpr bitkernels::parallel_policy TEXT_POLICY { nullptr, PARALLEL_TEXT_MIN / CHAR_BIT };
+
+	std::uint64_t read_chunk( size_t const& k ) const
+	{
+		if constexpr ( BITS_PER_WORD == 64 ) { return bits_[k]; }
+		else if constexpr ( BITS_PER_WORD > 64 )
 		{
-			IType mask = ( IType ( 1 ) << used_bits ) - 1;
-			word &= mask;
+			auto constexpr per_word = BITS_PER_WORD / 64;
+			return std::uint64_t ( bits_[k / per_word] >> ( k % per_word * 64 ) );
 		}
-		return word;
-	} 
+		else
+		{
+			auto constexpr per_chunk = 64 / BITS_PER_WORD;
+			std::uint64_t chunk {};
+			// the last chunk may run past the storage when the words are narrower than a chunk
+			auto const words = std::min ( size_t ( per_chunk ), bits_.size () - k * per_chunk );
+			for ( size_t i {}; i < words; ++i ) { chunk |= std::uint64_t ( bits_[k * per_chunk + i] ) << ( i * BITS_PER_WORD ); }
+			return chunk;
+		}
+	}
+
+	void set_chunk( size_t const& k, std::uint64_t const chunk )
+	{
+		if constexpr ( BITS_PER_WORD == 64 ) { bits_[k] = IType ( chunk ); }
+		else if constexpr ( BITS_PER_WORD > 64 )
+		{
+			auto constexpr per_word = BITS_PER_WORD / 64;
+			auto const shift = k % per_word * 64;
+			auto& word = bits_[k / per_word];
+			word = IType ( ( word & ~( IType ( ~std::uint64_t ( 0 ) ) << shift ) ) | IType ( chunk ) << shift );
+		}
+		else
+		{
+			auto constexpr per_chunk = 64 / BITS_PER_WORD;
+			for ( size_t i {}; i < per_chunk; ++i ) { bits_[k * per_chunk + i] = IType ( chunk >> ( i * BITS_PER_WORD ) ); }
+		}
+	}
 
-	std::string to_string( IType word )
+	// replaces the contents with `text`; throws `runtime_error` on anything but '0' or '1'
+	void assign_text( std::string_view const text )
 	{
-		std::stringstream ss;
-		// logic might need to be reversed
-		// for ( auto i = sizeof ( IType ) - 1; i >= 0 ; --i) {
-		for ( auto i = 0; i < sizeof ( IType ) - 1; ++i )
+		probe const timing { bitstats::op::parse };
+		drop_rank ();
+		auto const old_capacity = bits_.capacity ();
+		bits_.assign ( words_needed ( text.size () ), IType ( 0 ) );
+		nbits_ = text.size ();
+		note_allocation ( old_capacity );
+
+		// whole chunks are converted 64 characters at a time, split across threads for large inputs;
+		// the pieces are whole words (several chunks to a word wider than 64 bits), so they never
+		// share a word
+		auto const nchunks = nbits_ / 64;
+		auto constexpr word_chunks = BITS_PER_WORD > 64 ? size_t ( BITS_PER_WORD / 64 ) : size_t ( 1 );
+		std::vector<size_t> bad_chunks;
+		std::mutex bad_lock;
+		auto const units = ( nchunks + word_chunks - 1 ) / word_chunks;
+		bitkernels::parallel_for ( units, PARALLEL_TEXT_MIN / 64 / word_chunks, [&]( size_t first_unit, size_t last_unit )
 		{
-			// shifts word to the right by the amount indicated by i
-			// then ANDs with 1 to remove everything but the least significant bit
-			ss << ( ( word >> i ) & 1 );
+			auto const first = first_unit * word_chunks, last = std::min ( last_unit * word_chunks, nchunks );
+			auto const stop = bitkernels::parse_text ( text.data (), first, last,
+				[this]( size_t k, std::uint64_t bits ) { set_chunk ( k, bits ); } );
+			if ( stop != last )
+			{
+				std::lock_guard<std::mutex> const guard ( bad_lock );
+				bad_chunks.push_back ( stop );
+			}
+		} );
+
+		// the characters checked last are the first bad chunk, or the tail when every chunk parsed
+		auto const from = bad_chunks.empty () ? nchunks * 64 : *std::min_element ( bad_chunks.begin (), bad_chunks.end () ) * 64;
+		for ( auto i { from }; i < nbits_; ++i )
+		{
+			auto const c = text[i];
+			if ( c != '0' && c != '1' ) { throw std::runtime_error ( std::string ( "invalid character found: '" ) + c + "'" ); }
+			if ( c == '1' ) { bits_[word_offset ( i )] |= mask1 ( bit_offset ( i ) ); }
 		}
-		return ss.str ();
 	}
 
 public:
+	static constexpr size_t npos = static_cast<size_t> ( -1 ); // returned by the find ops when nothing is found
+
+	// Forward iterator over the positions of the 1-bits, in increasing order.
+	// Keeps the unvisited bits of the current word, so each step is a countr_zero
+	// and empty words cost one load.
+	class set_bit_iterator final
+	{
+		IType const* words_ {};
+		size_t index_ {};  // word being visited
+		size_t nwords_ {};
+		IType word_ {};    // its bits that have not been visited yet
+
+		void skip_empty()
+		{
+			while ( !word_ && ++index_ < nwords_ ) { word_ = words_[index_]; }
+		}
+
+	public:
+		using iterator_category = std::forward_iterator_tag;
+		using value_type = size_t;
+		using difference_type = std::ptrdiff_t;
+		using pointer = size_t const*;
+		using reference = size_t;
+
+		set_bit_iterator() = default;
+		set_bit_iterator( IType const* words, size_t nwords, size_t index )
+			: words_ { words }, index_ { index }, nwords_ { nwords }
+		{
+			if ( index_ < nwords_ )
+			{
+				word_ = words_[index_];
+				skip_empty ();
+			}
+		}
+
+		size_t operator*() const { return index_ * BITS_PER_WORD + size_t ( bitword::countr_zero ( word_ ) ); }
+
+		set_bit_iterator& operator++()
+		{
+			word_ &= IType ( word_ - 1 ); // drop the lowest set bit
+			skip_empty ();
+			return *this;
+		}
+
+		set_bit_iterator operator++( int )
+		{
+			auto old = *this;
+			++*this;
+			return old;
+		}
+
+		friend bool operator==( set_bit_iterator const& a, set_bit_iterator const& b )
+		{
+			return a.index_ == b.index_ && a.word_ == b.word_;
+		}
+	};
+
+	struct set_bit_range
+	{
+		set_bit_iterator first, last;
+		set_bit_iterator begin() const { return first; }
+		set_bit_iterator end() const { return last; }
+	};
+
 	// Object Management
 
-	explicit BitArray( size_t const nbits = 0 ) // create an object of nbits if argument > 0
+	friend struct std::hash<BitArray>;
+	template <class, class, class> friend class BitArray;
+	template <class> friend class BitArrayView;
+	template <class> friend class AtomicBitArray;
+	friend class CompressedBitArray;
+	template <class> friend class BitmapQuery;
+	template <class, class> friend class bloom::blocked_filter;
+	template <class> friend class BitWriter;
+	template <class> friend class BitReader;
+
+	// Binary format: a 32 byte header followed by the words in use, exactly as they sit in memory.
+	//    0  magic "BITARRAY"
+	//    8  format version (uint16)
+	//   10  word width in bytes (uint8)
+	//   11  byte order of the words: 1 little endian, 2 big endian (uint8)
+	//   12  reserved, zero (uint32)
+	//   16  number of bits (uint64)
+	//   24  checksum of the words: `bitkernels::hash` seeded with the number of bits (uint64)
+	// The header fields themselves are always little endian.
+	struct binary_header
+	{
+		static constexpr size_t SIZE = 32;
+		static constexpr std::uint16_t VERSION = 1;
+		static constexpr std::uint8_t LITTLE = 1, BIG = 2;
+		static constexpr std::uint8_t NATIVE = std::endian::native == std::endian::little ? LITTLE : BIG;
+		// the largest size whose payload, rounded up to any word width, has a byte count in `size_t`
+		static constexpr std::uint64_t MAX_BITS = std::uint64_t ( std::numeric_limits<size_t>::max () / CHAR_BIT / 1024 * 1024 );
+
+		std::uint16_t version { VERSION };
+		std::uint8_t word_bytes { sizeof ( IType ) };
+		std::uint8_t byte_order { NATIVE };
+		std::uint64_t nbits {};
+		std::uint64_t checksum {};
+
+		// the number of payload bytes that follow the header
+		size_t payload_bytes() const
+		{
+			auto const word_bits = size_t ( word_bytes ) * CHAR_BIT;
+			return ( size_t ( nbits ) + word_bits - 1 ) / word_bits * word_bytes;
+		}
+
+		// true when the payload can be used as `IType` words without conversion
+		bool native_layout() const { return word_bytes == sizeof ( IType ) && byte_order == NATIVE; }
+
+		void encode( unsigned char* out ) const
+		{
+			auto const put = [out]( size_t offset, std::uint64_t value, size_t nbytes )
+			{
+				for ( size_t i {}; i < nbytes; ++i ) { out[offset + i] = static_cast<unsigned char> ( value >> ( 8 * i ) ); }
+			};
+			std::memcpy ( out, "BITARRAY", 8 );
+			put ( 8, version, 2 );
+			put ( 10, word_bytes, 1 );
+			put ( 11, byte_order, 1 );
+			put ( 12, 0, 4 );
+			put ( 16, nbits, 8 );
+			put ( 24, checksum, 8 );
+		}
+
+		// throws `runtime_error` unless `in` starts with a header this version can read
+		static binary_header decode( unsigned char const* in )
+		{
+			auto const get = [in]( size_t offset, size_t nbytes )
+			{
+				std::uint64_t value {};
+				for ( size_t i {}; i < nbytes; ++i ) { value |= std::uint64_t ( in[offset + i] ) << ( 8 * i ); }
+				return value;
+			};
+			if ( std::memcmp ( in, "BITARRAY", 8 ) != 0 ) { throw std::runtime_error ( "not a BitArray binary image" ); }
+
+			binary_header header;
+			header.version = static_cast<std::uint16_t> ( get ( 8, 2 ) );
+			header.word_bytes = static_cast<std::uint8_t> ( get ( 10, 1 ) );
+			header.byte_order = static_cast<std::uint8_t> ( get ( 11, 1 ) );
+			header.nbits = get ( 16, 8 );
+			header.checksum = get ( 24, 8 );
+			if ( header.version != VERSION ) { throw std::runtime_error ( "unsupported BitArray binary version" ); }
+			if ( !std::has_single_bit ( unsigned ( header.word_bytes ) ) || ( header.byte_order != LITTLE && header.byte_order != BIG )
+				|| header.nbits > MAX_BITS )
+			{
+				throw std::runtime_error ( "corrupt BitArray binary header" );
+			}
+			return header;
+		}
+	};
+
+	// Every constructor takes an optional allocator last, so a BitArray can be built in place
+	// by allocator-aware containers; up to `INLINE_BITS` bits need no allocation at all.
+	using allocator_type = Allocator;
+	static constexpr size_t INLINE_BITS = BitStorage<IType, Allocator>::INLINE_WORDS * BITS_PER_WORD;
+
+	explicit BitArray( size_t const nbits = 0, Allocator const& alloc = Allocator () ) // create an object of nbits if argument > 0
+		: bits_ ( alloc ), nbits_ ( nbits )
 	{
 		if ( nbits > 0 ) { grow ( nbits ); }
 	};
 
-	explicit BitArray( const std::string& str )
+	explicit BitArray( Allocator const& alloc ) : bits_ ( alloc ) {}
+
+	explicit BitArray( std::string_view const str, Allocator const& alloc = Allocator () ) : bits_ ( alloc )
 	{
 		// expects a string of `0` or `1`. Any other character (including whitespace) gets `runtime_error`
-		auto iter = std::find_if ( str.begin (), str.end (), []( int const c ) { return c != '1' && c != '0'; } );
-		// if iter is not the end of str then a character other than `0` or `1` was found
-		if ( iter != str.end () ) { throw std::runtime_error ( "invalid character found: '" + to_string ( *iter ) + "'" ); }
+		assign_text ( str );
+	}
+
+	explicit BitArray( BitSpan<IType> const& s, Allocator const& alloc = Allocator () ) // Copies a window, allocating once
+		: bits_ ( alloc ), nbits_ ( s.size () )
+	{
+		grow ( nbits_ );
+		s.copy_to ( bits_.data () );
 	}
 
-	BitArray( BitArray const& other ) = default; // Copy Constructor
+	// Evaluates a lazy expression such as `a & ~b` straight into the new words, allocating once
+	template <bitexpr::expression_of<IType> E>
+	BitArray( E const& e, Allocator const& alloc = Allocator () ) : bits_ ( alloc ), nbits_ ( e.size () )
+	{
+		probe const timing { bitstats::op::evaluate };
+		grow ( nbits_ );
+		e.evaluate_into ( bits_.data () );
+	}
+
+	// Copies an array of another word width (or allocator). In little endian memory bit `i` is
+	// at the same byte whatever the width, so that is a copy of the bytes in use.
+	template <class J, class A, class I>
+		requires ( !std::same_as<BitArray<J, A, I>, BitArray> )
+	explicit BitArray( BitArray<J, A, I> const& other, Allocator const& alloc = Allocator () )
+		: bits_ ( alloc ), nbits_ ( other.nbits_ )
+	{
+		grow ( nbits_ );
+		if constexpr ( std::endian::native == std::endian::little )
+		{
+			auto const nbytes = std::min ( words_needed ( nbits_ ) * sizeof ( IType ), other.words_needed ( nbits_ ) * sizeof ( J ) );
+			if ( nbytes ) { std::memcpy ( static_cast<void*> ( bits_.data () ), other.bits_.data (), nbytes ); }
+		}
+		else
+		{
+			for ( auto const pos : other.set_bits () ) { bits_[word_offset ( pos )] |= mask1 ( bit_offset ( pos ) ); }
+		}
+	}
 
-	auto operator=( BitArray const& other ) -> BitArray& = default; // Copy assignment
+	~BitArray() { free_rank (); }
+
+	BitArray( BitArray const& other ) // Copy Constructor, which leaves the rank directory behind
+		: bits_ ( other.bits_ ), nbits_ ( other.nbits_ )
+	{
+		Instrumentation::copied ();
+		note_allocation ( 0 );
+	}
+
+	BitArray( BitArray const& other, Allocator const& alloc ) // Copies onto another allocator
+		: bits_ ( other.bits_, alloc ), nbits_ ( other.nbits_ )
+	{
+		Instrumentation::copied ();
+		note_allocation ( 0 );
+	}
+
+	auto operator=( BitArray const& other ) -> BitArray& // Copy assignment
+	{
+		Instrumentation::copied ();
+		auto const old_capacity = bits_.capacity ();
+		free_rank ();
+		bits_ = other.bits_;
+		nbits_ = other.nbits_;
+		note_allocation ( old_capacity );
+		return *this;
+	}
 
 	BitArray( BitArray&& other ) noexcept // Move Constructor
-		: bits_ ( std::move ( other.bits_ ), nbits_ (std::move ( other.nbits_ )) ) { std::cout << "move constructor" << std::endl; }
+		: bits_ ( std::move ( other.bits_ ) ), nbits_ ( std::exchange ( other.nbits_, 0 ) ), rank_ ( std::exchange ( other.rank_, nullptr ) )
+	{
+		Instrumentation::moved ( false );
+	}
 
-	auto operator=( BitArray&& other ) noexcept -> BitArray& // Move Assignment	
+	BitArray( BitArray&& other, Allocator const& alloc ) // Moves onto another allocator, copying if it cannot take the words
+		: bits_ ( std::move ( other.bits_ ), alloc ),
+		nbits_ ( alloc == other.get_allocator () ? std::exchange ( other.nbits_, 0 ) : other.nbits_ ),
+		rank_ ( alloc == other.get_allocator () ? std::exchange ( other.rank_, nullptr ) : nullptr )
 	{
-		std::cout << "move assignment" << std::endl;
+		Instrumentation::moved ( false );
+	}
+
+	// only throws when the allocators differ and do not propagate, so the words must be copied
+	auto operator=( BitArray&& other ) noexcept ( std::is_nothrow_move_assignable_v<BitStorage<IType, Allocator>> ) -> BitArray& // Move Assignment	
+	{
+		Instrumentation::moved ( true );
 		if ( this == &other ) { return *this; }
+		free_rank ();
 		bits_ = std::move ( other.bits_ );
-		nbits_ = std::move ( other.nbits_ );
+		nbits_ = std::exchange ( other.nbits_, 0 );
+		other.bits_.resize ( 0 ); // words that were copied rather than taken must not reappear when `other` grows
+		// the directory comes along when it was made by an allocator that can free it here
+		if ( get_allocator () == other.get_allocator () ) { rank_ = std::exchange ( other.rank_, nullptr ); }
+		else { other.free_rank (); } // it indexes words `other` no longer has
 		return *this;
 	}
 
+	// Evaluates into the existing words when they are large enough. A block of the value is
+	// computed before it is stored, so the expression may read this array, except through a
+	// shift, which reads words that earlier blocks have already overwritten, or when the words
+	// must move to make room; those cases are evaluated into fresh words (see `aliases`).
+	template <bitexpr::expression_of<IType> E>
+	auto operator=( E const& e ) -> BitArray&
+	{
+		if ( aliases ( e ) ) { return *this = BitArray ( e, get_allocator () ); }
+		probe const timing { bitstats::op::evaluate };
+		auto const old_words = words_needed ( nbits_ );
+		grow ( e.size () );
+		nbits_ = e.size ();
+		auto* const words = bits_.data ();
+		e.for_each_block ( [words]( size_t first, IType const* block, size_t n ) { std::memcpy ( words + first, block, n * sizeof ( IType ) ); } );
+		auto const new_words = words_needed ( nbits_ );
+		if ( old_words > new_words ) { std::fill ( words + new_words, words + old_words, IType ( 0 ) ); }
+		return *this;
+	}
+
+	// exchanges the contents without allocating or copying the words
+	void swap( BitArray& other ) noexcept
+	{
+		bits_.swap ( other.bits_ );
+		std::swap ( nbits_, other.nbits_ );
+		std::swap ( rank_, other.rank_ );
+	}
+
+	friend void swap( BitArray& a, BitArray& b ) noexcept { a.swap ( b ); }
+
+	// The tallies of the `Instrumentation` policy, shared by every array that uses it
+	static bitstats::snapshot stats() { return Instrumentation::stats (); }
+	static void reset_stats() { Instrumentation::reset (); }
+
+	Allocator get_allocator() const { return bits_.get_allocator (); }
+
 	// Mutators
 	BitArray& operator+=( bool const val )          // Append a bit
 	{
-		// increase our bit storage capacity
-		grow ( ++nbits_ );
+		probe const timing { bitstats::op::append };
+		// increase our bit storage capacity, then the size once the room is there
+		grow ( nbits_ + 1 );
+		++nbits_;
 
 		// assign the new bit to the new spot
-		assign_bit ( nbits_, val );
+		assign_bit ( nbits_ - 1, val );
 		return *this;
 	}
 	BitArray& operator+=( const BitArray& b ) // Append a BitArray
-	{		
-		// increase our count of bits by how many bits we are inserting
-		for ( auto i {}; i < b.size (); ++i )
-		{
-			*this += b [i];
-		}
+	{
+		probe const timing { bitstats::op::append };
+		// the bits past the end are already zero, so `b` is ORed in word by word; `b` is read
+		// after the growth since it may be this array
+		auto const end = nbits_;
+		auto const n = b.nbits_;
+		grow ( end + n );
+		nbits_ += n;
+		deposit ( end, BitSpan<IType> ( b.bits_.data (), 0, n ) );
 		return *this;
 	}
 
-	void erase( size_t bitpos, size_t nbits = 1 ) {} // Remove "nbits" bits at a position
+	void erase( size_t bitpos, size_t nbits = 1 ) // Remove "nbits" bits at a position
+	{
+		probe const timing { bitstats::op::erase };
+		if ( bitpos >= nbits_ || nbits > nbits_ - bitpos ) { throw std::out_of_range ( "erase: range out of bounds" ); }
+
+		// slide everything after the erased range over it; the vacated tail is zero filled
+		left_shift_at ( bitpos, nbits );
+		nbits_ -= nbits;
+	}
+
 	void insert( size_t bitpos, bool val )           // Insert a bit at a position (slide "right")
 	{
-		// if insert at end, just append bit and increment `nbits_`
+		probe const timing { bitstats::op::insert };
+		if ( bitpos > nbits_ ) { throw std::out_of_range ( "insert: position out of bounds" ); }
 
-		// if insert at beginning or somewhere else, slide all bits one to the right,
-		// to the right of that spot, insert bit, then increment `nbits_`
-		grow ( ++nbits_ );
-		left_shift_at ( bitpos );
+		// open a one bit gap at `bitpos` and drop the new bit into it
+		grow ( nbits_ + 1 );
+		++nbits_;
+		right_shift_at ( bitpos, 1 );
 		assign_bit ( bitpos, val );
 	}
 
-	void insert( size_t bitpos, const BitArray& b )
+	void insert( size_t bitpos, const BitArray& b ) // Insert an entire BitArray object
 	{
-		auto additional_size = b.size ();
-		nbits_ += additional_size;
-		grow ();
-		for ( auto i {}; i < additional_size; ++i)
+		probe const timing { bitstats::op::insert };
+		if ( bitpos > nbits_ ) { throw std::out_of_range ( "insert: position out of bounds" ); }
+		if ( &b == this )
 		{
-			
+			insert ( bitpos, BitArray ( b, get_allocator () ) );
+			return;
 		}
-	} // Insert an entire BitArray object
+
+		// open a gap as wide as `b` in one pass, then fill it a word at a time
+		auto const additional_size = b.size ();
+		grow ( nbits_ + additional_size );
+		nbits_ += additional_size;
+		right_shift_at ( bitpos, additional_size );
+		deposit ( bitpos, b );
+	}
+
+	void reserve( size_t const& nbits ) // Allocates room for `nbits` bits without changing the size
+	{
+		auto const old_capacity = bits_.capacity ();
+		bits_.reserve ( words_needed ( nbits ) );
+		note_allocation ( old_capacity );
+	}
+
+	void resize( size_t const& nbits ) // Adds zero bits at the end or drops the bits past `nbits`
+	{
+		// the words past the end are already zero, so growing only makes room for them
+		if ( nbits < nbits_ ) { clear_from ( nbits ); }
+		else { grow ( nbits ); }
+		nbits_ = nbits;
+	}
 
 	void shrink_to_fit()
 	{
@@ -280,172 +1071,627 @@ public:
 
 		// just call vector::resize
 		// determine how many words are being used
-		bits_.resize (size ());
+		auto const old_capacity = bits_.capacity ();
+		bits_.resize ( words_needed ( nbits_ ) );
+		bits_.shrink_to_fit ();
+		note_allocation ( old_capacity );
 	}
 
 	// Bitwise ops	
-	Bitproxy operator[]( size_t bitpos ) { return Bitproxy ( *this, bitpos ); }
+	Bitproxy operator[]( size_t bitpos ) { return Bitproxy ( *this, check_index ( bitpos ) ); }
 
-	bool operator[]( size_t const& bitpos ) const { return read_bit ( bitpos ); }
+	bool operator[]( size_t const& bitpos ) const { return read_bit ( check_index ( bitpos ) ); }
 
-	bool at( size_t const& bitpos ) const { return read_bit ( bitpos ); }
+	bool at( size_t const& bitpos ) const { return read_bit ( check_index ( bitpos ) ); }
 
 	void toggle( size_t const& bitpos )
 	{
 		// get a 1 mask at the bit position
 		// XOR the word with the mask
-		assign_bit ( bitpos, !read_bit ( bitpos ) );
+		bits_[word_offset ( check_index ( bitpos ) )] ^= mask1 ( bit_offset ( bitpos ) );
+		if ( rank_ ) { rank_->invalidate (); }
 	}
 
 	void toggle() // Toggles all bits
 	{
+		probe const timing { bitstats::op::toggle };
 		// for each word XOR it with a full one mask
-		auto mask { ~0u };
-		std::transform ( bits_.begin (), bits_.end (), bits_.begin (),
-			[&mask]( auto const& word ) { return word ^= mask; } );
+		auto const mask { IType ( ~IType ( 0 ) ) };
+		drop_rank ();
+		// only the words in use; spare words left by `erase` must stay zero
+		auto const end = bits_.begin () + words_needed ( nbits_ );
+		std::transform ( bits_.begin (), end, bits_.begin (),
+			[&mask]( auto const& word ) { return IType ( word ^ mask ); } );
+		clean_tail ();
 	}
 
-	BitArray operator~() const
+	// Parallel forms
+	// Each whole-array op below also takes an execution policy, `bitkernels::seq` or
+	// `bitkernels::par` (or a `parallel_policy` naming its own pool and size cutoff):
+	//    b.toggle ( bitkernels::par );
+	//    auto const ones = b.count ( bitkernels::par );
+	// `par` only pays off for large arrays; below `min_bytes` of words it runs sequentially.
+	template <bitkernels::execution_policy Policy>
+	void toggle( Policy const& policy )
 	{
-		auto new_b { *this };
-		new_b.toggle ();
-		return new_b;
+		probe const timing { bitstats::op::toggle };
+		drop_rank ();
+		auto* const words = bits_.data ();
+		bitkernels::for_each_chunk ( policy, words_needed ( nbits_ ) * sizeof ( IType ), [words]( size_t first, size_t last )
+		{
+			for ( auto i { first / sizeof ( IType ) }; i < last / sizeof ( IType ); ++i ) { words[i] = IType ( ~words[i] ); }
+		} );
+		clean_tail ();
 	}
 
-	void left_shift_at( size_t const& bitpos ) const
+	template <bitkernels::execution_policy Policy>
+	BitArray& and_assign( Policy const& policy, BitArray const& b ) { return combine<bitkernels::bitop::and_op> ( policy, b ); } // &=
+	template <bitkernels::execution_policy Policy>
+	BitArray& or_assign( Policy const& policy, BitArray const& b ) { return combine<bitkernels::bitop::or_op> ( policy, b ); } // |=
+	template <bitkernels::execution_policy Policy>
+	BitArray& xor_assign( Policy const& policy, BitArray const& b ) { return combine<bitkernels::bitop::xor_op> ( policy, b ); } // ^=
+	template <bitkernels::execution_policy Policy>
+	BitArray& and_not( Policy const& policy, BitArray const& b ) { return combine<bitkernels::bitop::and_not_op> ( policy, b ); }
+
+	template <bitkernels::execution_policy Policy>
+	BitArray& shift_left( Policy const& policy, size_t const shift_amt ) // <<=
 	{
-		for ( auto i { bitpos }; i < nbits_; ++i ) {
-			assign_bit ( wrap_index ( i ), read_bit ( wrap_index ( i + 1 ) ) );
-		}
+		if ( !bitkernels::runs_parallel ( policy, words_needed ( nbits_ ) * sizeof ( IType ) ) ) { left_shift_at ( 0, shift_amt ); }
+		else { shift_whole ( policy, shift_amt, true ); }
+		return *this;
 	}
 
-	void right_shift_at(size_t const& bitpos) const
+	template <bitkernels::execution_policy Policy>
+	BitArray& shift_right( Policy const& policy, size_t const shift_amt ) // >>=
 	{
-		for ( auto i { bitpos }; i < nbits_; ++i ) {
-			assign_bit ( wrap_index ( i + 1 ), read_bit ( wrap_index ( i ) ) );
-		}
+		if ( !bitkernels::runs_parallel ( policy, words_needed ( nbits_ ) * sizeof ( IType ) ) ) { right_shift_at ( 0, shift_amt ); }
+		else { shift_whole ( policy, shift_amt, false ); }
+		return *this;
 	}
 
-	// Shift operators
-	BitArray operator<<( unsigned int shift_amt ) const // shift temp left
+	// Range ops on [bitpos, bitpos + count), which must be inside the array (`out_of_range`
+	// otherwise). Only the two end words are masked; the words in between are filled with
+	// `memset` (or flipped, counted or scanned whole), so a range costs about as much as
+	// touching its bytes once.
+	void set_range( size_t const& bitpos, size_t const& count )
 	{
-		auto temp = *this;
-		return temp << shift_amt;
+		edit_range ( bitpos, count, []( IType& word, IType const mask ) { word |= mask; },
+			[]( IType* words, size_t const n ) { std::memset ( static_cast<void*> ( words ), 0xFF, n * sizeof ( IType ) ); } );
 	}
-	BitArray operator>>( unsigned int shift_amt ) const // shift temp right
+
+	void reset_range( size_t const& bitpos, size_t const& count )
 	{
-		auto temp = *this;
-		return temp >> shift_amt;
+		edit_range ( bitpos, count, []( IType& word, IType const mask ) { word &= IType ( ~mask ); },
+			[]( IType* words, size_t const n ) { std::memset ( static_cast<void*> ( words ), 0, n * sizeof ( IType ) ); } );
 	}
-	BitArray& operator<<=( unsigned int shift_amt ) const // shift self left
+
+	void flip_range( size_t const& bitpos, size_t const& count )
 	{
-		left_shift_at ( 0 );
+		edit_range ( bitpos, count, []( IType& word, IType const mask ) { word ^= mask; },
+			[]( IType* words, size_t const n ) { for ( size_t i {}; i < n; ++i ) { words[i] = IType ( ~words[i] ); } } );
+	}
+
+	size_t count_range( size_t const& bitpos, size_t const& count ) const
+	{
+		probe const timing { bitstats::op::range };
+		return span ( bitpos, count ).count ();
+	}
+
+	bool any_range( size_t const& bitpos, size_t const& count ) const
+	{
+		probe const timing { bitstats::op::range };
+		check_range ( bitpos, count );
+		if ( !count ) { return false; }
+		auto const first = word_offset ( bitpos );
+		auto const last = word_offset ( bitpos + count - 1 );
+		auto const head = IType ( ~low_mask ( bit_offset ( bitpos ) ) );
+		auto const tail = low_mask ( bit_offset ( bitpos + count - 1 ) + 1 );
+		if ( first == last ) { return ( bits_[first] & head & tail ) != 0; }
+		return ( bits_[first] & head ) || ( bits_[last] & tail )
+			|| bitkernels::any ( bits_.data () + first + 1, ( last - first - 1 ) * sizeof ( IType ) );
+	}
+
+	void fill( bool const bit ) // Sets every bit to `bit`
+	{
+		drop_rank ();
+		std::memset ( static_cast<void*> ( bits_.data () ), bit ? 0xFF : 0, words_needed ( nbits_ ) * sizeof ( IType ) );
+		clean_tail ();
+	}
+
+	// On an lvalue the operators below build a lazy expression (see bitexpr.h), which is
+	// evaluated in one pass when it is assigned, counted or compared; on a temporary they work
+	// in place and hand its words on.
+	bitexpr::complement<bitexpr::words<IType>> operator~() const& { return bitexpr::complement { leaf () }; }
+
+	BitArray operator~() && // a temporary is toggled in place and its words handed on
+	{
+		toggle ();
+		return std::move ( *this );
+	}
+
+	// Bitwise algebra
+	// Operands of different sizes are combined as if the shorter one were padded with zeros,
+	// so the result always has the size of the longer operand.
+	BitArray& operator&=( BitArray const& b ) { return combine<bitkernels::bitop::and_op> ( b ); }
+	BitArray& operator|=( BitArray const& b ) { return combine<bitkernels::bitop::or_op> ( b ); }
+	BitArray& operator^=( BitArray const& b ) { return combine<bitkernels::bitop::xor_op> ( b ); }
+	BitArray& and_not( BitArray const& b ) { return combine<bitkernels::bitop::and_not_op> ( b ); } // reset every bit set in `b`
+
+	BitArray& operator&=( BitSpan<IType> const& s ) { return combine<bitkernels::bitop::and_op> ( s ); }
+	BitArray& operator|=( BitSpan<IType> const& s ) { return combine<bitkernels::bitop::or_op> ( s ); }
+	BitArray& operator^=( BitSpan<IType> const& s ) { return combine<bitkernels::bitop::xor_op> ( s ); }
+	BitArray& and_not( BitSpan<IType> const& s ) { return combine<bitkernels::bitop::and_not_op> ( s ); }
+
+	template <bitexpr::expression_of<IType> E>
+	BitArray& operator&=( E const& e ) { return combine<bitkernels::bitop::and_op> ( e ); }
+	template <bitexpr::expression_of<IType> E>
+	BitArray& operator|=( E const& e ) { return combine<bitkernels::bitop::or_op> ( e ); }
+	template <bitexpr::expression_of<IType> E>
+	BitArray& operator^=( E const& e ) { return combine<bitkernels::bitop::xor_op> ( e ); }
+
+	// two lvalues, or an lvalue and an expression, make an expression
+	using and_expr = bitexpr::binary<bitkernels::bitop::and_op, bitexpr::words<IType>, bitexpr::words<IType>>;
+	using or_expr = bitexpr::binary<bitkernels::bitop::or_op, bitexpr::words<IType>, bitexpr::words<IType>>;
+	using xor_expr = bitexpr::binary<bitkernels::bitop::xor_op, bitexpr::words<IType>, bitexpr::words<IType>>;
+	friend and_expr operator&( BitArray const& a, BitArray const& b ) { return { a.leaf (), b.leaf () }; }
+	friend or_expr operator|( BitArray const& a, BitArray const& b ) { return { a.leaf (), b.leaf () }; }
+	friend xor_expr operator^( BitArray const& a, BitArray const& b ) { return { a.leaf (), b.leaf () }; }
+	template <bitexpr::expression_of<IType> E>
+	friend auto operator&( BitArray const& a, E const& e ) { return bitexpr::binary<bitkernels::bitop::and_op, bitexpr::words<IType>, E> { a.leaf (), e }; }
+	template <bitexpr::expression_of<IType> E>
+	friend auto operator|( BitArray const& a, E const& e ) { return bitexpr::binary<bitkernels::bitop::or_op, bitexpr::words<IType>, E> { a.leaf (), e }; }
+	template <bitexpr::expression_of<IType> E>
+	friend auto operator^( BitArray const& a, E const& e ) { return bitexpr::binary<bitkernels::bitop::xor_op, bitexpr::words<IType>, E> { a.leaf (), e }; }
+	template <bitexpr::expression_of<IType> E>
+	friend auto operator&( E const& e, BitArray const& b ) { return bitexpr::binary<bitkernels::bitop::and_op, E, bitexpr::words<IType>> { e, b.leaf () }; }
+	template <bitexpr::expression_of<IType> E>
+	friend auto operator|( E const& e, BitArray const& b ) { return bitexpr::binary<bitkernels::bitop::or_op, E, bitexpr::words<IType>> { e, b.leaf () }; }
+	template <bitexpr::expression_of<IType> E>
+	friend auto operator^( E const& e, BitArray const& b ) { return bitexpr::binary<bitkernels::bitop::xor_op, E, bitexpr::words<IType>> { e, b.leaf () }; }
+
+	// a temporary operand is combined into in place and its storage reused for the result,
+	// rather than referred to by an expression that would outlive it
+	friend BitArray operator&( BitArray&& a, BitArray const& b ) { return std::move ( a &= b ); }
+	friend BitArray operator|( BitArray&& a, BitArray const& b ) { return std::move ( a |= b ); }
+	friend BitArray operator^( BitArray&& a, BitArray const& b ) { return std::move ( a ^= b ); }
+	friend BitArray operator&( BitArray const& a, BitArray&& b ) { return std::move ( b &= a ); }
+	friend BitArray operator|( BitArray const& a, BitArray&& b ) { return std::move ( b |= a ); }
+	friend BitArray operator^( BitArray const& a, BitArray&& b ) { return std::move ( b ^= a ); }
+	friend BitArray operator&( BitArray&& a, BitArray&& b ) { return std::move ( a &= b ); }
+	friend BitArray operator|( BitArray&& a, BitArray&& b ) { return std::move ( a |= b ); }
+	friend BitArray operator^( BitArray&& a, BitArray&& b ) { return std::move ( a ^= b ); }
+	template <bitexpr::expression_of<IType> E>
+	friend BitArray operator&( BitArray&& a, E const& e ) { return std::move ( a &= e ); }
+	template <bitexpr::expression_of<IType> E>
+	friend BitArray operator|( BitArray&& a, E const& e ) { return std::move ( a |= e ); }
+	template <bitexpr::expression_of<IType> E>
+	friend BitArray operator^( BitArray&& a, E const& e ) { return std::move ( a ^= e ); }
+	template <bitexpr::expression_of<IType> E>
+	friend BitArray operator&( E const& e, BitArray&& b ) { return std::move ( b &= e ); }
+	template <bitexpr::expression_of<IType> E>
+	friend BitArray operator|( E const& e, BitArray&& b ) { return std::move ( b |= e ); }
+	template <bitexpr::expression_of<IType> E>
+	friend BitArray operator^( E const& e, BitArray&& b ) { return std::move ( b ^= e ); }
+
+	// the left operand is taken by value so a temporary's storage is reused for the result
+	friend BitArray and_not( BitArray a, BitArray const& b ) { return std::move ( a.and_not ( b ) ); }
+
+	// Fused forms that never materialize the combined array
+	friend size_t count_and( BitArray const& a, BitArray const& b ) // ( a & b ).count ()
+	{
+		return bitkernels::popcount_combined<bitkernels::bitop::and_op> ( a.bits_.data (), b.bits_.data (),
+			shared_words ( a, b ) * sizeof ( IType ) );
+	}
+
+	friend bool any_and( BitArray const& a, BitArray const& b ) // ( a & b ).any ()
+	{
+		return bitkernels::any_combined<bitkernels::bitop::and_op> ( a.bits_.data (), b.bits_.data (),
+			shared_words ( a, b ) * sizeof ( IType ) );
+	}
+
+	// Shift operators
+	bitexpr::shifted<bitexpr::words<IType>> operator<<( unsigned int shift_amt ) const& { return { leaf (), shift_amt, true }; } // lazy shift left
+	bitexpr::shifted<bitexpr::words<IType>> operator>>( unsigned int shift_amt ) const& { return { leaf (), shift_amt, false }; } // lazy shift right
+	BitArray operator<<( unsigned int shift_amt ) && { return std::move ( *this <<= shift_amt ); } // shifts a temporary in place
+	BitArray operator>>( unsigned int shift_amt ) && { return std::move ( *this >>= shift_amt ); }
+	BitArray& operator<<=( unsigned int shift_amt ) // shift self left
+	{
+		probe const timing { bitstats::op::shift };
+		left_shift_at ( 0, shift_amt );
 		return *this;
 	}
-	BitArray& operator>>=( unsigned int shift_amt ) const // shift self right
+	BitArray& operator>>=( unsigned int shift_amt ) // shift self right
 	{
-		right_shift_at ( 0 );
+		probe const timing { bitstats::op::shift };
+		right_shift_at ( 0, shift_amt );
 		return *this;
 	}
 
 	// Extraction ops
-	BitArray slice( size_t const& bitpos, size_t const& count ) // Extracts a new sub-array
+	// both throw `out_of_range` unless [bitpos, bitpos + count) is inside the array
+	BitArray slice( size_t const& bitpos, size_t const& count ) const // Extracts a new sub-array
 	{
-		BitArray new_array {};
-		auto current { bitpos };
+		probe const timing { bitstats::op::slice };
+		return BitArray ( span ( bitpos, count ), get_allocator () );
+	}
 
-		// start at bitpos and end at bitpos + count
-		while (current != bitpos + count)
-		{
-		// read each bit from `*this` and copy it to `new_array`
-			new_array += read_bit ( current++ );
-		}		
-		
-		// return `new_array`		
-		return new_array;
+	// A window onto [bitpos, bitpos + count) that shares this array's words; it is
+	// invalidated by anything that changes the size
+	BitSpan<IType> span( size_t const& bitpos, size_t const& count ) const
+	{
+		if ( bitpos > nbits_ || count > nbits_ - bitpos ) { throw std::out_of_range ( "slice: range out of bounds" ); }
+		return { bits_.data (), bitpos, count };
 	}
 
+	operator BitSpan<IType>() const { return { bits_.data (), 0, nbits_ }; } // the whole array as a span
+
 	// Comparison ops
 	// these should compare the objects lexicographically
 	// (as if they were strings, in dictionary order)
-	auto operator==( BitArray<IType> const& b ) -> bool { return to_string () == b.to_string (); }
-	auto operator!=( BitArray const& b ) -> bool { return !( operator==(b) ); }
-	auto operator<( BitArray const& b ) -> bool { return to_string () < b.to_string (); }
-	auto operator<=( BitArray const& b ) -> bool { return operator<( b ) || operator==( b ); }
-	auto operator>( BitArray const& b ) -> bool { return to_string () > b.to_string (); }
-	auto operator>=( BitArray const& b ) -> bool { return operator>( b ) || operator==( b ); }
+	// `!=`, `<`, `<=`, `>` and `>=` are rewritten by the compiler in terms of these two
+	friend auto operator==( BitArray const& a, BitArray const& b ) -> bool
+	{
+		probe const timing { bitstats::op::compare };
+		// the unused tail bits are always zero, so equal arrays have identical words
+		return a.nbits_ == b.nbits_
+			&& ( a.nbits_ == 0 || std::memcmp ( a.bits_.data (), b.bits_.data (), words_needed ( a.nbits_ ) * sizeof ( IType ) ) == 0 );
+	}
+
+	// against a lazy expression, which is evaluated a block at a time and never stored;
+	// `e == a` and `!=` are rewritten in terms of this
+	template <bitexpr::expression_of<IType> E>
+	friend auto operator==( BitArray const& a, E const& e ) -> bool
+	{
+		probe const timing { bitstats::op::compare };
+		if ( a.nbits_ != e.size () ) { return false; }
+		bool equal { true };
+		auto const* const words = a.bits_.data ();
+		e.for_each_block ( [&equal, words]( size_t first, IType const* block, size_t n )
+		{
+			return equal = std::memcmp ( words + first, block, n * sizeof ( IType ) ) == 0;
+		} );
+		return equal;
+	}
+
+	friend auto operator<=>( BitArray const& a, BitArray const& b ) -> std::strong_ordering
+	{
+		probe const timing { bitstats::op::compare };
+		auto const common = std::min ( a.nbits_, b.nbits_ );
+		auto const full_words = word_offset ( common );
+		auto const* pa = a.bits_.data ();
+		auto const* pb = b.bits_.data ();
+
+		// skip the shared prefix with memcmp; only a differing word needs a closer look
+		size_t word {};
+		if ( full_words && std::memcmp ( pa, pb, full_words * sizeof ( IType ) ) != 0 )
+		{
+			while ( pa[word] == pb[word] ) { ++word; }
+		}
+		else
+		{
+			word = full_words;
+		}
+
+		// the partial word at the end of the common prefix only counts up to `common`
+		IType diff = word < full_words ? IType ( pa[word] ^ pb[word] )
+			: bit_offset ( common ) ? IType ( ( pa[word] ^ pb[word] ) & low_mask ( bit_offset ( common ) ) ) : IType ( 0 );
+		if ( diff )
+		{
+			// the lowest differing bit is the first differing character; the array with the 1 there sorts later
+			auto const first = size_t ( bitword::countr_zero ( diff ) );
+			return ( pa[word] >> first & 1u ) ? std::strong_ordering::greater : std::strong_ordering::less;
+		}
+
+		// one is a prefix of the other: the shorter one sorts first
+		return a.nbits_ <=> b.nbits_;
+	}
+
+	// Search ops
+	// each one skips whole words that cannot contain a match and returns `npos` if there is none
+
+	set_bit_range set_bits() const // the positions of the 1-bits, e.g. `for ( auto pos : b.set_bits () )`
+	{
+		auto const nwords = words_needed ( nbits_ );
+		return { set_bit_iterator ( bits_.data (), nwords, 0 ), set_bit_iterator ( bits_.data (), nwords, nwords ) };
+	}
+
+	size_t find_first() const { return find_from ( 0 ); } // The position of the first 1-bit
+
+	size_t find_next( size_t const& bitpos ) const // The position of the first 1-bit after `bitpos`
+	{
+		return bitpos + 1 < nbits_ ? find_from ( bitpos + 1 ) : npos;
+	}
+
+	size_t find_last() const // The position of the last 1-bit
+	{
+		for ( auto i { words_needed ( nbits_ ) }; i-- > 0; )
+		{
+			if ( bits_[i] ) { return i * BITS_PER_WORD + BITS_PER_WORD - 1 - size_t ( bitword::countl_zero ( bits_[i] ) ); }
+		}
+		return npos;
+	}
+
+	size_t find_first_zero() const // The position of the first 0-bit
+	{
+		auto const nwords = words_needed ( nbits_ );
+		for ( size_t i {}; i < nwords; ++i )
+		{
+			if ( IType const inverted = IType ( ~bits_[i] ) )
+			{
+				// the clean tail reads as zeros, so a hit past the end means every bit is set
+				auto const pos = i * BITS_PER_WORD + size_t ( bitword::countr_zero ( inverted ) );
+				return pos < nbits_ ? pos : npos;
+			}
+		}
+		return npos;
+	}
+
+	// Rank/select
+	// `rank1 ( pos )` counts the 1-bits in [0, pos) and `select1 ( k )` finds the position of 1-bit
+	// number `k`, counting from 0. Without an index both scan the words; `build_rank_index` adds
+	// a directory of about 3% of the size that makes rank constant time and select a short search.
+	// Any write drops the directory, keeping its space, and the queries scan until the next
+	// `build_rank_index`. The queries never rebuild it themselves: they are const, so threads
+	// may run them on the same array at once. Build the index after the last write.
+	void build_rank_index()
+	{
+		if ( !rank_ )
+		{
+			rank_allocator alloc { get_allocator () };
+			auto* const index = rank_traits::allocate ( alloc, 1 );
+			rank_traits::construct ( alloc, index, get_allocator () );
+			rank_ = index;
+		}
+		rank_->build ( nbits_, [this]( size_t k ) { return read_chunk ( k ); } );
+	}
+
+	bool has_rank_index() const { return indexed (); }
+
+	size_t rank_index_bytes() const { return rank_ ? rank_->memory_usage () : 0; } // the space the directory takes
+
+	size_t rank1( size_t const& bitpos ) const
+	{
+		probe const timing { bitstats::op::rank };
+		if ( bitpos > nbits_ ) { throw std::out_of_range ( "rank position out of range" ); }
+		if ( indexed () )
+		{
+			return rank_->rank1 ( bitpos, [this]( size_t k ) { return read_chunk ( k ); } );
+		}
+
+		auto const full_words = word_offset ( bitpos );
+		auto rank = bitkernels::popcount ( bits_.data (), full_words * sizeof ( IType ) );
+		if ( bit_offset ( bitpos ) ) { rank += count_ones ( IType ( bits_[full_words] & low_mask ( bit_offset ( bitpos ) ) ) ); }
+		return rank;
+	}
+
+	size_t rank0( size_t const& bitpos ) const { return bitpos - rank1 ( bitpos ); } // The 0-bits in [0, pos)
+
+	size_t select1( size_t k ) const // The position of 1-bit number `k`, or `npos`
+	{
+		probe const timing { bitstats::op::select };
+		if ( indexed () )
+		{
+			return rank_->select1 ( k, [this]( size_t c ) { return read_chunk ( c ); }, npos );
+		}
+
+		auto const nwords = words_needed ( nbits_ );
+		for ( size_t i {}; i < nwords; ++i )
+		{
+			auto const ones = count_ones ( bits_[i] );
+			if ( k < ones ) { return select_in_word ( i, k ); }
+			k -= ones;
+		}
+		return npos;
+	}
+
+	// the position of 1-bit number `k` of word `i`, which has more than `k`; a word wider than
+	// 64 bits is searched a lane at a time
+	size_t select_in_word( size_t const i, size_t k ) const
+	{
+		if constexpr ( BITS_PER_WORD > 64 )
+		{
+			for ( auto c { i * ( BITS_PER_WORD / 64 ) }; ; ++c )
+			{
+				auto const lane = read_chunk ( c );
+				auto const ones = size_t ( std::popcount ( lane ) );
+				if ( k < ones ) { return c * 64 + bitkernels::select64 ( lane, unsigned ( k ) ); }
+				k -= ones;
+			}
+		}
+		else { return i * BITS_PER_WORD + bitkernels::select64 ( std::uint64_t ( bits_[i] ), unsigned ( k ) ); }
+	}
 
 	// Counting ops
 	size_t size() const { return nbits_; } // Number of bits in use in the vector
 
-	size_t capacity() const { return words_needed ( nbits_ ); } // # of bits the current allocation can hold
+	size_t capacity() const { return bits_.capacity () * BITS_PER_WORD; } // # of bits the current allocation can hold
+
+	// The counting ops read only the words in use. The mutators keep the bits past `nbits_`
+	// zeroed (see `clean_tail`), so the last word never needs to be cleaned here.
 
 	size_t count() const // The number of 1-bits present
 	{
-		auto count { 0 };
-		for ( auto const& word : bits_ ) { count += count_ones ( word ); }
-		return count;
+		probe const timing { bitstats::op::count };
+		return bitkernels::popcount ( bits_.data (), words_needed ( nbits_ ) * sizeof ( IType ) );
 	}
 
 	bool any() const // Optimized version of count() > 0
 	{
-		for ( auto const& item : bits_ ) { if ( item ) { return true; } }
-		return false;
+		return bitkernels::any ( bits_.data (), words_needed ( nbits_ ) * sizeof ( IType ) );
+	}
+
+	bool none() const { return !any (); } // Optimized version of count() == 0
+
+	// each piece is counted on its own and added to the total once
+	template <bitkernels::execution_policy Policy>
+	size_t count( Policy const& policy ) const
+	{
+		probe const timing { bitstats::op::count };
+		std::atomic<size_t> ones {};
+		auto const* const words = reinterpret_cast<unsigned char const*> ( bits_.data () );
+		bitkernels::for_each_chunk ( policy, words_needed ( nbits_ ) * sizeof ( IType ), [&]( size_t first, size_t last )
+		{
+			ones.fetch_add ( bitkernels::popcount ( words + first, last - first ), std::memory_order_relaxed );
+		} );
+		return ones.load ();
+	}
+
+	// pieces that start after a 1-bit has been found are skipped
+	template <bitkernels::execution_policy Policy>
+	bool any( Policy const& policy ) const
+	{
+		std::atomic<bool> found {};
+		auto const* const words = reinterpret_cast<unsigned char const*> ( bits_.data () );
+		bitkernels::for_each_chunk ( policy, words_needed ( nbits_ ) * sizeof ( IType ), [&]( size_t first, size_t last )
+		{
+			if ( !found.load ( std::memory_order_relaxed ) && bitkernels::any ( words + first, last - first ) )
+			{
+				found.store ( true, std::memory_order_relaxed );
+			}
+		} );
+		return found.load ();
+	}
+
+	bool all() const // Optimized version of count() == size()
+	{
+		auto const full_words = word_offset ( nbits_ );
+		if ( !bitkernels::all_ones ( bits_.data (), full_words * sizeof ( IType ) ) ) { return false; }
+
+		auto const used_bits = bit_offset ( nbits_ );
+		return !used_bits || bits_[full_words] == low_mask ( used_bits );
 	}
 
 	// Stream I/O (define these in situ)
 	friend auto operator<<( std::ostream& os, BitArray const& obj ) -> std::ostream&
 	{
-		return os << "bits_: " << obj.to_string ();
+		return os << obj.to_string ();
 	}
 
 	// overwrites it's bitarray argument's container
+	// skips leading whitespace, then reads '0'/'1' characters up to the first other character,
+	// which is left in the stream. If no bits are read the stream fails and `obj` is unchanged.
 	friend auto operator>>( std::istream& is, BitArray& obj ) -> std::istream&
 	{
-		IType word {};
-		bits_.clear ();
-		bits_.shrink_to_fit ();
-
-		auto count { 0 };
-		auto const max_size { sizeof ( IType ) };
-
-		while ( is )
+		std::istream::sentry const ok ( is ); // skips whitespace using the stream's own locale
+		if ( !ok ) { return is; }
+
+		// collect the run straight from the buffer a block at a time, then convert it in bulk
+		using traits = std::istream::traits_type;
+		std::string text;
+		char block[4096];
+		size_t used {};
+		auto* const buf = is.rdbuf ();
+		auto next = buf->sgetc ();
+		for ( ; next == '0' || next == '1'; next = buf->snextc () )
 		{
-			auto const next_char = is.peek ();
-			if ( next_char == static_cast<int> ( is.eof () ) ) { break; }
-			if ( next_char != '0' && next_char != '1' ) // it's okay if the character is a whitespace
+			block[used++] = char ( next );
+			if ( used == sizeof block )
 			{
-				if ( !std::isspace ( next_char, std::locale ( "en_US.UTF8" ) ) ) { break; } // illegal character found
-				is.seekg ( 1 );                                                             // skip whitespace character
-				continue;
+				text.append ( block, used );
+				used = 0;
 			}
+		}
+		text.append ( block, used );
 
-			if ( count == max_size )
-			{
-				obj.bits_.push_back ( word );
-				word = 0;
-				count = 0;
-			}
-			else { word <<= 1; }
+		if ( traits::eq_int_type ( next, traits::eof () ) ) { is.setstate ( std::ios::eofbit ); }
+		if ( text.empty () )
+		{
+			is.setstate ( std::ios::failbit );
+			return is;
+		}
+		obj.assign_text ( text );
+		return is;
+	}
+
+	// Binary I/O
+	void write_binary( std::ostream& os ) const // Writes the header and the words in use
+	{
+		auto const nbytes = words_needed ( nbits_ ) * sizeof ( IType );
+		binary_header header;
+		header.nbits = nbits_;
+		header.checksum = bitkernels::hash ( bits_.data (), nbytes, nbits_ );
+
+		unsigned char raw[binary_header::SIZE];
+		header.encode ( raw );
+		os.write ( reinterpret_cast<char const*> ( raw ), sizeof raw );
+		if ( nbytes ) { os.write ( reinterpret_cast<char const*> ( bits_.data () ), std::streamsize ( nbytes ) ); }
+	}
 
-			if ( is.get () == '1' )
+	// Reads an image written by `write_binary`; throws `runtime_error` if it is truncated, fails its
+	// checksum, or uses a layout that cannot be converted (only a different word width is converted,
+	// and only between little endian images and hosts)
+	static BitArray read_binary( std::istream& is )
+	{
+		unsigned char raw[binary_header::SIZE];
+		if ( !is.read ( reinterpret_cast<char*> ( raw ), sizeof raw ) ) { throw std::runtime_error ( "truncated BitArray binary header" ); }
+		auto const header = binary_header::decode ( raw );
+
+		// read a bounded piece at a time, so a header claiming more than the stream holds fails at
+		// the end of the stream rather than allocating its claim up front
+		constexpr size_t piece = size_t ( 1 ) << 20;
+		std::vector<unsigned char> payload;
+		for ( auto const total = header.payload_bytes (); payload.size () < total; )
+		{
+			auto const have = payload.size ();
+			payload.resize ( have + std::min ( total - have, piece ) );
+			if ( !is.read ( reinterpret_cast<char*> ( payload.data () + have ), std::streamsize ( payload.size () - have ) ) )
 			{
-				// if is.get() == '0' then it doesn't matter as it has already been 
-				// shifted and so a zero is already in the least significant spot
-				word |= 1u;
+				throw std::runtime_error ( "truncated BitArray binary payload" );
 			}
-			count++;
+		}
+		if ( bitkernels::hash ( payload.data (), payload.size (), header.nbits ) != header.checksum )
+		{
+			throw std::runtime_error ( "BitArray binary checksum mismatch" );
+		}
+		if ( !header.native_layout ()
+			&& !( header.byte_order == binary_header::LITTLE && binary_header::NATIVE == binary_header::LITTLE ) )
+		{
+			throw std::runtime_error ( "BitArray binary byte order is not supported on this host" );
 		}
 
-		return is;
+		// in little endian memory bit `i` is bit `i % 8` of byte `i / 8` whatever the word width
+		BitArray b ( static_cast<size_t> ( header.nbits ) );
+		if ( !payload.empty () )
+		{
+			std::memcpy ( b.bits_.data (), payload.data (), std::min ( payload.size (), b.bits_.size () * sizeof ( IType ) ) );
+		}
+		b.clean_tail ();
+		return b;
 	}
 
 	// String conversion
-	std::string to_string() const
+	std::string to_string() const { return to_string ( TEXT_POLICY ); }
+
+	template <bitkernels::execution_policy Policy>
+	std::string to_string( Policy const& policy ) const
 	{
-		std::ostringstream ss;
-		if ( !bits_.empty () ) { for ( auto const& item : bits_ ) { ss << to_string ( item ); } }
-		return ss.str ();
+		probe const timing { bitstats::op::format };
+		// one preallocated buffer; whole chunks are expanded 64 characters at a time, and a piece
+		// of the words (a multiple of 64 bytes) is a whole number of chunks
+		std::string text ( nbits_, '0' );
+		auto const nchunks = nbits_ / 64;
+		bitkernels::for_each_chunk ( policy, nchunks * 8, [&]( size_t first, size_t last )
+		{
+			bitkernels::format_text ( text.data (), first / 8, last / 8, [this]( size_t k ) { return read_chunk ( k ); } );
+		} );
+		for ( auto i { nchunks * 64 }; i < nbits_; ++i ) { text[i] = read_bit ( i ) ? '1' : '0'; }
+		return text;
 	}
 };
+
+// Hashes the words in use together with the size, so "0" and "00" hash differently
+template <class IType, class Allocator, class Instrumentation>
+struct std::hash<BitArray<IType, Allocator, Instrumentation>>
+{
+	size_t operator()( BitArray<IType, Allocator, Instrumentation> const& b ) const noexcept
+	{
+		return bitkernels::hash ( b.bits_.data (), BitArray<IType, Allocator, Instrumentation>::words_needed ( b.nbits_ ) * sizeof ( IType ), b.nbits_ );
+	}
+};
+
+// A BitArray whose words come from a `std::pmr::memory_resource`, such as a per-request arena:
+//    std::pmr::monotonic_buffer_resource arena;
+//    PmrBitArray<> b { 4096, &arena };
+template <class IType = size_t>
+using PmrBitArray = BitArray<IType, std::pmr::polymorphic_allocator<IType>>;
 #endif //BIT_ARRAY_H
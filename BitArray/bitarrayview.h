@@ -0,0 +1,244 @@
+// bitarrayview.h: read-only BitArray views and file mappings
+#ifndef BIT_ARRAY_VIEW_H
+#define BIT_ARRAY_VIEW_H
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include "bitarray.h"
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// A read-only file mapping; the pages are shared with every other process mapping the same file
+class MappedFile final
+{
+	void const* data_ {};
+	size_t size_ {};
+#ifdef _WIN32
+	HANDLE file_ { INVALID_HANDLE_VALUE };
+	HANDLE mapping_ {};
+#endif
+
+public:
+	explicit MappedFile( std::filesystem::path const& path )
+	{
+#ifdef _WIN32
+		file_ = CreateFileW ( path.c_str (), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr );
+		if ( file_ == INVALID_HANDLE_VALUE ) { throw std::runtime_error ( "cannot open " + path.string () ); }
+		LARGE_INTEGER size {};
+		GetFileSizeEx ( file_, &size );
+		size_ = static_cast<size_t> ( size.QuadPart );
+		if ( size_ )
+		{
+			mapping_ = CreateFileMappingW ( file_, nullptr, PAGE_READONLY, 0, 0, nullptr );
+			data_ = mapping_ ? MapViewOfFile ( mapping_, FILE_MAP_READ, 0, 0, 0 ) : nullptr;
+			if ( !data_ )
+			{
+				release ();
+				throw std::runtime_error ( "cannot map " + path.string () );
+			}
+		}
+#else
+		auto const fd = ::open ( path.c_str (), O_RDONLY );
+		if ( fd < 0 ) { throw std::runtime_error ( "cannot open " + path.string () ); }
+		struct stat info {};
+		if ( ::fstat ( fd, &info ) != 0 )
+		{
+			::close ( fd );
+			throw std::runtime_error ( "cannot stat " + path.string () );
+		}
+		size_ = static_cast<size_t> ( info.st_size );
+		if ( size_ )
+		{
+			auto* const mapped = ::mmap ( nullptr, size_, PROT_READ, MAP_SHARED, fd, 0 );
+			if ( mapped == MAP_FAILED )
+			{
+				::close ( fd );
+				throw std::runtime_error ( "cannot map " + path.string () );
+			}
+			data_ = mapped;
+		}
+		::close ( fd ); // the mapping keeps the file alive
+#endif
+	}
+
+	MappedFile( MappedFile const& ) = delete;
+	auto operator=( MappedFile const& ) -> MappedFile& = delete;
+
+	~MappedFile() { release (); }
+
+	unsigned char const* data() const { return static_cast<unsigned char const*> ( data_ ); }
+	size_t size() const { return size_; }
+
+private:
+	void release()
+	{
+#ifdef _WIN32
+		if ( data_ ) { UnmapViewOfFile ( data_ ); }
+		if ( mapping_ ) { CloseHandle ( mapping_ ); }
+		if ( file_ != INVALID_HANDLE_VALUE ) { CloseHandle ( file_ ); }
+		mapping_ = nullptr;
+		file_ = INVALID_HANDLE_VALUE;
+#else
+		if ( data_ ) { ::munmap ( const_cast<void*> ( data_ ), size_ ); }
+#endif
+		data_ = nullptr;
+	}
+};
+
+// A read-only BitArray that does not own its words. It either looks at an existing BitArray
+// or maps a file written by `BitArray::write_binary`, in which case opening it costs one mmap
+// and the words are shared with every other process reading the same file.
+// Copies are cheap and share the mapping.
+template <class IType = size_t>
+class BitArrayView
+{
+	using Array = BitArray<IType>;
+	using Bits = bitkernels::bitop;
+	enum { BITS_PER_WORD = CHAR_BIT * sizeof ( IType ) };
+
+	std::shared_ptr<MappedFile const> file_ {}; // keeps a mapping alive, if this view has one
+	IType const* words_ {};
+	size_t nbits_ {};
+
+	size_t nwords() const { return Array::words_needed ( nbits_ ); }
+
+	size_t check_index( size_t const& bitpos ) const
+	{
+		if ( bitpos >= nbits_ ) { throw std::out_of_range ( "bit position out of range" ); }
+		return bitpos;
+	}
+
+	template <Bits Op>
+	static Array& combine_into( Array& a, BitArrayView const& v ) { return a.template combine<Op> ( v.words_, v.nbits_ ); }
+
+	static size_t shared_bytes( BitArrayView const& a, BitArrayView const& b )
+	{
+		return Array::words_needed ( std::min ( a.nbits_, b.nbits_ ) ) * sizeof ( IType );
+	}
+
+public:
+	static constexpr size_t npos = Array::npos;
+
+	BitArrayView() = default;
+
+	template <class Allocator, class Instrumentation>
+	BitArrayView( BitArray<IType, Allocator, Instrumentation> const& b ) : words_ { b.bits_.data () }, nbits_ { b.nbits_ } {} // views `b` without copying it
+
+	// Maps a binary image. The image must use this view's word width and the host byte order;
+	// the checksum costs a full read, so it is only verified on request.
+	explicit BitArrayView( std::filesystem::path const& path, bool const verify_checksum = false )
+		: file_ { std::make_shared<MappedFile const> ( path ) }
+	{
+		if ( file_->size () < Array::binary_header::SIZE ) { throw std::runtime_error ( "truncated BitArray binary header" ); }
+		auto const header = Array::binary_header::decode ( file_->data () );
+		if ( !header.native_layout () ) { throw std::runtime_error ( "BitArray binary layout does not match this view" ); }
+		// the words the view will read are exactly the payload, which holds every bit
+		if ( header.payload_bytes () != Array::words_needed ( size_t ( header.nbits ) ) * sizeof ( IType )
+			|| header.nbits > std::uint64_t ( header.payload_bytes () ) * CHAR_BIT )
+		{
+			throw std::runtime_error ( "corrupt BitArray binary header" );
+		}
+		if ( file_->size () - Array::binary_header::SIZE < header.payload_bytes () )
+		{
+			throw std::runtime_error ( "truncated BitArray binary payload" );
+		}
+
+		auto const* payload = file_->data () + Array::binary_header::SIZE;
+		if ( verify_checksum && bitkernels::hash ( payload, header.payload_bytes (), header.nbits ) != header.checksum )
+		{
+			throw std::runtime_error ( "BitArray binary checksum mismatch" );
+		}
+		// the header is 32 bytes and the mapping is page aligned, so the words are aligned too
+		words_ = reinterpret_cast<IType const*> ( payload );
+		nbits_ = static_cast<size_t> ( header.nbits );
+	}
+
+	Array to_bitarray() const // Copies the viewed bits into an owning BitArray
+	{
+		Array b { nbits_ };
+		if ( nbits_ ) { std::memcpy ( b.bits_.data (), words_, nwords () * sizeof ( IType ) ); }
+		b.clean_tail ();
+		return b;
+	}
+
+	// Bit access
+	bool operator[]( size_t const& bitpos ) const { return at ( bitpos ); }
+
+	bool at( size_t const& bitpos ) const
+	{
+		check_index ( bitpos );
+		return ( words_[bitpos / BITS_PER_WORD] >> ( bitpos % BITS_PER_WORD ) & 1u ) != IType ( 0 );
+	}
+
+	// Counting ops
+	size_t size() const { return nbits_; }
+
+	size_t count() const { return bitkernels::popcount ( words_, nwords () * sizeof ( IType ) ); }
+
+	bool any() const { return bitkernels::any ( words_, nwords () * sizeof ( IType ) ); }
+
+	bool none() const { return !any (); }
+
+	// Search ops
+	size_t find_first() const { return find_from ( 0 ); }
+
+	size_t find_next( size_t const& bitpos ) const { return bitpos + 1 < nbits_ ? find_from ( bitpos + 1 ) : npos; }
+
+	// Bitwise algebra into an owning BitArray; sizes combine as they do between BitArrays
+	friend Array& operator&=( Array& a, BitArrayView const& v ) { return combine_into<Bits::and_op> ( a, v ); }
+	friend Array& operator|=( Array& a, BitArrayView const& v ) { return combine_into<Bits::or_op> ( a, v ); }
+	friend Array& operator^=( Array& a, BitArrayView const& v ) { return combine_into<Bits::xor_op> ( a, v ); }
+	friend Array& and_not( Array& a, BitArrayView const& v ) { return combine_into<Bits::and_not_op> ( a, v ); }
+
+	friend Array operator&( BitArrayView const& v, BitArrayView const& w ) { auto a = v.to_bitarray (); return std::move ( a &= w ); }
+	friend Array operator|( BitArrayView const& v, BitArrayView const& w ) { auto a = v.to_bitarray (); return std::move ( a |= w ); }
+	friend Array operator^( BitArrayView const& v, BitArrayView const& w ) { auto a = v.to_bitarray (); return std::move ( a ^= w ); }
+
+	// Fused forms that never materialize the combined array
+	friend size_t count_and( BitArrayView const& a, BitArrayView const& b )
+	{
+		return bitkernels::popcount_combined<Bits::and_op> ( a.words_, b.words_, shared_bytes ( a, b ) );
+	}
+
+	friend bool any_and( BitArrayView const& a, BitArrayView const& b )
+	{
+		return bitkernels::any_combined<Bits::and_op> ( a.words_, b.words_, shared_bytes ( a, b ) );
+	}
+
+private:
+	size_t find_from( size_t const& bitpos ) const
+	{
+		auto const n = nwords ();
+		auto i = bitpos / BITS_PER_WORD;
+		if ( i >= n ) { return npos; }
+		IType word = IType ( words_[i] & ~Array::low_mask ( bitpos % BITS_PER_WORD ) );
+		while ( !word )
+		{
+			if ( ++i == n ) { return npos; }
+			word = words_[i];
+		}
+		return i * BITS_PER_WORD + size_t ( bitword::countr_zero ( word ) );
+	}
+};
+
+// Writes `b` in the binary format a BitArrayView can map
+template <class IType, class Allocator, class Instrumentation>
+void save_binary( BitArray<IType, Allocator, Instrumentation> const& b, std::filesystem::path const& path )
+{
+	std::ofstream os ( path, std::ios::binary | std::ios::trunc );
+	b.write_binary ( os );
+	if ( !os.flush () ) { throw std::runtime_error ( "cannot write " + path.string () ); }
+}
+#endif // BIT_ARRAY_VIEW_H
@@ -0,0 +1,324 @@
+// bitexpr.h: lazy BitArray expressions
+#ifndef BIT_EXPR_H
+#define BIT_EXPR_H
+#include <algorithm>
+#include <bit>
+#include <climits>
+#include <concepts>
+#include <cstddef>
+#include <cstring>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include "bitkernels.h"
+#include "bitword.h"
+
+// Lazy BitArray expressions. `~`, `<<`, `>>`, `&`, `|` and `^` on BitArray lvalues build a
+// small tree of these nodes instead of a new array:
+//    auto const e = ( a << 6 ) & ~b ^ c;   // nothing is computed yet
+//    BitArray<> r = e;                      // one pass over a, b and c, one allocation
+//    size_t const n = ( a & ~b ).count ();  // one pass, no allocation at all
+// A node computes its value a block of words at a time, into a buffer small enough to stay in
+// the L1 cache, so a chain of any length reads each operand once and writes the result once.
+// An expression is evaluated when it is assigned to (or used to build) a BitArray, counted,
+// compared or indexed. It refers to its operands, so it must not outlive them, and it sees
+// any change made to them before it is evaluated, like a view.
+// Every node produces clean words: bits at or past its size are zero, whatever the word
+// index, so the shorter operand of a binary node reads as padded with zeros, as in BitArray.
+namespace bitexpr
+{
+	// the members every node shares; `Derived` supplies `size ()`, `eval ( first, n, out )`,
+	// `direct ( first, n )`, `reads ( words )` and `reads_shifted ( words )`
+	template <class Derived, class IType>
+	struct node
+	{
+		using word_type = IType;
+		static constexpr size_t BITS_PER_WORD = CHAR_BIT * sizeof ( IType );
+		static constexpr size_t BLOCK_WORDS = 2048 / sizeof ( IType ); // 2 KiB per tree level
+
+		static size_t words_for( size_t const nbits ) { return ( nbits + BITS_PER_WORD - 1 ) / BITS_PER_WORD; }
+
+		// the 1 bits of the last word, given the size
+		static IType tail_mask( size_t const nbits )
+		{
+			auto const used = nbits % BITS_PER_WORD;
+			constexpr IType ones = IType ( ~IType ( 0 ) ); // narrow words would be promoted to int by `~`
+			return used ? IType ( ones >> ( BITS_PER_WORD - used ) ) : ones;
+		}
+
+		// zeroes what lies at or past the end in the block [first, first + n), for the nodes
+		// that can set bits there
+		void clean( size_t const first, size_t const n, IType* const out ) const
+		{
+			auto const nbits = self ().size ();
+			auto const last = words_for ( nbits );
+			if ( first + n < last ) { return; }
+			auto const keep = first < last ? last - first : 0;
+			if ( keep ) { out[keep - 1] &= tail_mask ( nbits ); }
+			std::fill ( out + keep, out + n, IType ( 0 ) );
+		}
+
+		Derived const& self() const { return static_cast<Derived const&> ( *this ); }
+
+		size_t nwords() const { return words_for ( self ().size () ); }
+
+		// calls `sink ( first, block, n )` for the value's words, a block at a time and in order;
+		// stops early when the sink returns false
+		template <class Sink>
+		void for_each_block( Sink&& sink ) const
+		{
+			IType block[BLOCK_WORDS];
+			for ( size_t first {}, nwords = this->nwords (); first < nwords; first += BLOCK_WORDS )
+			{
+				auto const n = std::min ( BLOCK_WORDS, nwords - first );
+				self ().eval ( first, n, block );
+				if constexpr ( std::is_void_v<decltype ( sink ( first, block, n ) )> ) { sink ( first, block, n ); }
+				else if ( !sink ( first, block, n ) ) { return; }
+			}
+		}
+
+		// writes the whole value to `dst`, which must not be read by the expression
+		void evaluate_into( IType* const dst ) const
+		{
+			for ( size_t first {}, nwords = this->nwords (); first < nwords; first += BLOCK_WORDS )
+			{
+				self ().eval ( first, std::min ( BLOCK_WORDS, nwords - first ), dst + first );
+			}
+		}
+
+		size_t count() const
+		{
+			size_t total {};
+			for_each_block ( [&total]( size_t, IType const* block, size_t n ) { total += bitkernels::popcount ( block, n * sizeof ( IType ) ); } );
+			return total;
+		}
+
+		bool any() const
+		{
+			bool found {};
+			for_each_block ( [&found]( size_t, IType const* block, size_t n ) { return !( found = bitkernels::any ( block, n * sizeof ( IType ) ) ); } );
+			return found;
+		}
+
+		bool none() const { return !any (); }
+
+		// throws `out_of_range` past the end; computes just the word that holds the bit
+		bool operator[]( size_t const bitpos ) const
+		{
+			if ( bitpos >= self ().size () ) { throw std::out_of_range ( "bit position out of range" ); }
+			IType word {};
+			self ().eval ( bitpos / BITS_PER_WORD, 1, &word );
+			return ( ( word >> ( bitpos % BITS_PER_WORD ) ) & IType ( 1 ) ) != IType ( 0 );
+		}
+
+		std::string to_string() const
+		{
+			std::string text ( self ().size (), '0' );
+			for_each_block ( [&text]( size_t first, IType const* block, size_t n )
+			{
+				for ( size_t i {}; i < n; ++i )
+				{
+					for ( auto word { block[i] }; word; word &= IType ( word - 1 ) )
+					{
+						text[( first + i ) * BITS_PER_WORD + size_t ( bitword::countr_zero ( word ) )] = '1';
+					}
+				}
+			} );
+			return text;
+		}
+
+		friend std::ostream& operator<<( std::ostream& os, Derived const& e ) { return os << e.to_string (); }
+	};
+
+	template <class E>
+	concept expression = std::derived_from<E, node<E, typename E::word_type>>;
+
+	template <class E, class IType>
+	concept expression_of = expression<E> && std::same_as<typename E::word_type, IType>;
+
+	// the words [first, first + n) of `e`: its own storage when it has them all, or else
+	// evaluated into `buffer`
+	template <class E, class IType>
+	IType const* read( E const& e, size_t const first, size_t const n, IType* const buffer )
+	{
+		if ( auto const* const words = e.direct ( first, n ) ) { return words; }
+		e.eval ( first, n, buffer );
+		return buffer;
+	}
+
+	// a BitArray (or any other run of words) read as it is
+	template <class IType>
+	struct words : node<words<IType>, IType>
+	{
+		IType const* data;
+		size_t nbits;
+
+		words( IType const* const d, size_t const n ) : data { d }, nbits { n } {}
+
+		size_t size() const { return nbits; }
+
+		void eval( size_t const first, size_t const n, IType* const out ) const
+		{
+			auto const stored = this->nwords ();
+			auto const have = first < stored ? std::min ( n, stored - first ) : 0;
+			if ( have ) { std::memcpy ( out, data + first, have * sizeof ( IType ) ); }
+			std::fill ( out + have, out + n, IType ( 0 ) );
+		}
+
+		// the stored words are used in place rather than copied into a buffer
+		IType const* direct( size_t const first, size_t const n ) const { return first + n <= this->nwords () ? data + first : nullptr; }
+
+		// a block reads only the same block of its operands, so only a shift makes writing
+		// the result over an operand unsafe
+		bool reads( void const* const p ) const { return p == data; }
+		bool reads_shifted( void const* ) const { return false; }
+	};
+
+	template <bitkernels::bitop Op, class L, class R>
+	struct binary : node<binary<Op, L, R>, typename L::word_type>
+	{
+		using IType = typename L::word_type;
+		L left;
+		R right;
+
+		binary( L const& l, R const& r ) : left { l }, right { r } {}
+
+		size_t size() const { return std::max ( left.size (), right.size () ); }
+
+		void eval( size_t const first, size_t const n, IType* const out ) const
+		{
+			IType scratch[binary::BLOCK_WORDS];
+			auto const* const a = read ( left, first, n, out );
+			auto const* const b = read ( right, first, n, scratch );
+			for ( size_t i {}; i < n; ++i ) { out[i] = bitkernels::apply<Op> ( a[i], b[i] ); }
+		}
+
+		IType const* direct( size_t, size_t ) const { return nullptr; }
+		bool reads( void const* const p ) const { return left.reads ( p ) || right.reads ( p ); }
+		bool reads_shifted( void const* const p ) const { return left.reads_shifted ( p ) || right.reads_shifted ( p ); }
+	};
+
+	template <class E>
+	struct complement : node<complement<E>, typename E::word_type>
+	{
+		using IType = typename E::word_type;
+		E inner;
+
+		explicit complement( E const& e ) : inner { e } {}
+
+		size_t size() const { return inner.size (); }
+
+		void eval( size_t const first, size_t const n, IType* const out ) const
+		{
+			auto const* const a = read ( inner, first, n, out );
+			for ( size_t i {}; i < n; ++i ) { out[i] = IType ( ~a[i] ); }
+			this->clean ( first, n, out );
+		}
+
+		IType const* direct( size_t, size_t ) const { return nullptr; }
+		bool reads( void const* const p ) const { return inner.reads ( p ); }
+		bool reads_shifted( void const* const p ) const { return inner.reads_shifted ( p ); }
+	};
+
+	// `toward_zero` is BitArray's `<<`: bit i of the result is bit i + amount of the operand
+	template <class E>
+	struct shifted : node<shifted<E>, typename E::word_type>
+	{
+		using IType = typename E::word_type;
+		static constexpr size_t W = shifted::BITS_PER_WORD;
+		E inner;
+		size_t amount;
+		bool toward_zero;
+
+		shifted( E const& e, size_t const shift_amt, bool const toward ) : inner { e }, amount { shift_amt }, toward_zero { toward } {}
+
+		size_t size() const { return inner.size (); }
+
+		void eval( size_t const first, size_t const n, IType* const out ) const
+		{
+			if ( amount >= size () )
+			{
+				std::fill ( out, out + n, IType ( 0 ) );
+				return;
+			}
+			auto const q = amount / W;
+			auto const r = unsigned ( amount % W );
+			IType scratch[shifted::BLOCK_WORDS];
+			if ( toward_zero )
+			{
+				// out[i] takes the high bits of source word i + q and the low bits of i + q + 1;
+				// the result is clean already, as bit j comes from bit j + amount
+				auto const* const a = read ( inner, first + q, n, scratch );
+				if ( r == 0 )
+				{
+					std::memcpy ( out, a, n * sizeof ( IType ) );
+					return;
+				}
+				IType next {};
+				inner.eval ( first + q + n, 1, &next );
+				bitword::shift_run_down ( out, a, next, n, r );
+				return;
+			}
+
+			// out[i] takes the low bits of source word i - q and the high bits of i - q - 1,
+			// with the words before the start reading as zero
+			IType const* a = scratch;
+			if ( first >= q ) { a = read ( inner, first - q, n, scratch ); }
+			else
+			{
+				auto const skip = std::min ( n, q - first );
+				std::fill ( scratch, scratch + skip, IType ( 0 ) );
+				if ( skip < n ) { inner.eval ( 0, n - skip, scratch + skip ); }
+			}
+			if ( r == 0 ) { std::memcpy ( out, a, n * sizeof ( IType ) ); }
+			else
+			{
+				IType previous {};
+				if ( first > q ) { inner.eval ( first - q - 1, 1, &previous ); }
+				bitword::shift_run_up ( out, a, previous, n, r );
+			}
+			this->clean ( first, n, out );
+		}
+
+		IType const* direct( size_t, size_t ) const { return nullptr; }
+		bool reads( void const* const p ) const { return inner.reads ( p ); }
+		bool reads_shifted( void const* const p ) const { return inner.reads ( p ); }
+	};
+
+	// Operators on nodes; the ones with a BitArray operand are BitArray's own
+	template <expression E>
+	complement<E> operator~( E const& e ) { return complement<E> { e }; }
+
+	template <expression E>
+	shifted<E> operator<<( E const& e, size_t const shift_amt ) { return { e, shift_amt, true }; }
+
+	template <expression E>
+	shifted<E> operator>>( E const& e, size_t const shift_amt ) { return { e, shift_amt, false }; }
+
+	template <expression L, expression_of<typename L::word_type> R>
+	binary<bitkernels::bitop::and_op, L, R> operator&( L const& l, R const& r ) { return { l, r }; }
+
+	template <expression L, expression_of<typename L::word_type> R>
+	binary<bitkernels::bitop::or_op, L, R> operator|( L const& l, R const& r ) { return { l, r }; }
+
+	template <expression L, expression_of<typename L::word_type> R>
+	binary<bitkernels::bitop::xor_op, L, R> operator^( L const& l, R const& r ) { return { l, r }; }
+
+	// equal when the sizes and every bit match; neither side is materialized
+	template <expression L, expression_of<typename L::word_type> R>
+	bool operator==( L const& l, R const& r )
+	{
+		using IType = typename L::word_type;
+		if ( l.size () != r.size () ) { return false; }
+		IType other[L::BLOCK_WORDS];
+		bool equal { true };
+		l.for_each_block ( [&]( size_t first, IType const* block, size_t n )
+		{
+			r.eval ( first, n, other );
+			return equal = std::memcmp ( block, other, n * sizeof ( IType ) ) == 0;
+		} );
+		return equal;
+	}
+}
+#endif // BIT_EXPR_H
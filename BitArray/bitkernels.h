@@ -0,0 +1,864 @@
+// bitkernels.h: the whole-buffer kernels behind BitArray
+#ifndef BIT_KERNELS_H
+#define BIT_KERNELS_H
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <concepts>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// Whole-buffer kernels used by BitArray. Every kernel works on the raw bytes of the word
+// storage, so the result does not depend on the word type. The x86 kernels are compiled
+// with per-function target attributes and picked at runtime from the CPU features, so the
+// header still builds without -mavx2 and still runs on machines without AVX2.
+// Define BITARRAY_NO_SIMD to compile the portable kernels only.
+
+#if !defined( BITARRAY_NO_SIMD ) && ( defined( __x86_64__ ) || defined( _M_X64 ) )
+#define BITARRAY_X86_SIMD 1
+#include <immintrin.h>
+#if defined( _MSC_VER ) && !defined( __clang__ )
+#include <intrin.h>
+#define BITARRAY_TARGET( isa )
+#else
+#define BITARRAY_TARGET( isa ) __attribute__ ( ( target ( isa ) ) )
+#endif
+#endif
+
+namespace bitkernels
+{
+	enum class isa { portable, avx2, avx512 };
+
+	// the word-wise operation applied by the binary kernels; `and_not` computes a & ~b
+	enum class bitop { and_op, or_op, xor_op, and_not_op };
+
+	// Portable kernels
+
+	// asks for the cache line holding `p` ahead of a read, or of a write when `for_write`
+	inline void prefetch( void const* p, bool const for_write = false )
+	{
+#if defined( __GNUC__ ) || defined( __clang__ )
+		if ( for_write ) { __builtin_prefetch ( p, 1 ); }
+		else { __builtin_prefetch ( p, 0 ); }
+#elif defined( BITARRAY_X86_SIMD )
+		static_cast<void> ( for_write );
+		_mm_prefetch ( static_cast<char const*> ( p ), _MM_HINT_T0 );
+#else
+		static_cast<void> ( p );
+		static_cast<void> ( for_write );
+#endif
+	}
+
+	inline std::uint64_t load_u64( unsigned char const* p )
+	{
+		std::uint64_t word;
+		std::memcpy ( &word, p, sizeof word );
+		return word;
+	}
+
+	inline size_t popcount_portable( unsigned char const* p, size_t nbytes )
+	{
+		size_t count {};
+		size_t i {};
+		for ( ; i + 8 <= nbytes; i += 8 ) { count += std::popcount ( load_u64 ( p + i ) ); }
+		for ( ; i < nbytes; ++i ) { count += std::popcount ( p[i] ); }
+		return count;
+	}
+
+	inline bool any_portable( unsigned char const* p, size_t nbytes )
+	{
+		size_t i {};
+		for ( ; i + 8 <= nbytes; i += 8 ) { if ( load_u64 ( p + i ) ) { return true; } }
+		for ( ; i < nbytes; ++i ) { if ( p[i] ) { return true; } }
+		return false;
+	}
+
+	inline bool all_ones_portable( unsigned char const* p, size_t nbytes )
+	{
+		size_t i {};
+		for ( ; i + 8 <= nbytes; i += 8 ) { if ( ~load_u64 ( p + i ) ) { return false; } }
+		for ( ; i < nbytes; ++i ) { if ( p[i] != 0xFF ) { return false; } }
+		return true;
+	}
+
+	// 64-bit multiply-xorshift hash of a byte buffer, eight bytes per step
+	inline size_t hash( void const* data, size_t nbytes, std::uint64_t seed )
+	{
+		auto constexpr multiplier = 0x9E3779B97F4A7C15ull;
+		auto const* p = static_cast<unsigned char const*> ( data );
+		auto h = ( seed + nbytes ) * multiplier;
+		auto const mix = [&h]( std::uint64_t word )
+		{
+			h = ( h ^ word ) * multiplier;
+			h ^= h >> 32;
+		};
+
+		size_t i {};
+		for ( ; i + 8 <= nbytes; i += 8 ) { mix ( load_u64 ( p + i ) ); }
+		if ( i < nbytes )
+		{
+			std::uint64_t tail {};
+			std::memcpy ( &tail, p + i, nbytes - i );
+			mix ( tail );
+		}
+		return size_t ( h ^ h >> 29 );
+	}
+
+	// the position of the 1-bit of rank `rank` (counting from 0) in `word`, which must have more
+	// than `rank` bits set; whole bytes are skipped by their popcount, then the byte is walked
+	inline unsigned select64( std::uint64_t word, unsigned rank )
+	{
+		unsigned shift {};
+		for ( ;; shift += 8 )
+		{
+			auto const ones = unsigned ( std::popcount ( word >> shift & 0xFF ) );
+			if ( rank < ones ) { break; }
+			rank -= ones;
+		}
+		auto byte = word >> shift & 0xFF;
+		for ( ; rank; --rank ) { byte &= byte - 1; }
+		return shift + unsigned ( std::countr_zero ( byte ) );
+	}
+
+	// Text kernels
+	// A chunk is 64 bits; character `i` of a 64 character block of '0'/'1' text is bit `i` of its chunk.
+
+	// one 8 character pattern per byte value, laid out so a single store writes the characters in order
+	inline constexpr auto text_table = []
+	{
+		std::array<std::uint64_t, 256> table {};
+		for ( unsigned byte {}; byte < 256; ++byte )
+		{
+			for ( unsigned j {}; j < 8; ++j )
+			{
+				auto const digit = std::uint64_t ( '0' + ( byte >> j & 1u ) );
+				auto const lane = std::endian::native == std::endian::little ? j : 7 - j;
+				table[byte] |= digit << ( 8 * lane );
+			}
+		}
+		return table;
+	}();
+
+	// converts 64 characters to a chunk; returns false if any of them is not '0' or '1'
+	inline bool parse64_portable( char const* text, std::uint64_t& bits )
+	{
+		bits = 0;
+		if constexpr ( std::endian::native == std::endian::little )
+		{
+			auto const* p = reinterpret_cast<unsigned char const*> ( text );
+			for ( unsigned k {}; k < 8; ++k )
+			{
+				// '0' and '1' differ from 0x30 only in the low bit of each byte
+				auto const digits = load_u64 ( p + 8 * k ) ^ 0x3030303030303030ull;
+				if ( digits & 0xFEFEFEFEFEFEFEFEull ) { return false; }
+				// gathers the low bit of every byte into the top byte, first character lowest
+				bits |= ( digits * 0x0102040810204080ull >> 56 ) << ( 8 * k );
+			}
+		}
+		else
+		{
+			for ( unsigned i {}; i < 64; ++i )
+			{
+				if ( text[i] != '0' && text[i] != '1' ) { return false; }
+				bits |= std::uint64_t ( text[i] == '1' ) << i;
+			}
+		}
+		return true;
+	}
+
+	inline void format64_portable( char* text, std::uint64_t bits )
+	{
+		for ( unsigned k {}; k < 8; ++k )
+		{
+			std::memcpy ( text + 8 * k, &text_table[bits >> ( 8 * k ) & 0xFF], 8 );
+		}
+	}
+
+	template <bitop Op, class Word>
+	Word apply( Word a, Word b )
+	{
+		if constexpr ( Op == bitop::and_op ) { return Word ( a & b ); }
+		else if constexpr ( Op == bitop::or_op ) { return Word ( a | b ); }
+		else if constexpr ( Op == bitop::xor_op ) { return Word ( a ^ b ); }
+		else { return Word ( a & ~b ); }
+	}
+
+	inline void store_u64( unsigned char* p, std::uint64_t word ) { std::memcpy ( p, &word, sizeof word ); }
+
+	// dst = dst op src
+	template <bitop Op>
+	void combine_portable( unsigned char* dst, unsigned char const* src, size_t nbytes )
+	{
+		size_t i {};
+		for ( ; i + 8 <= nbytes; i += 8 ) { store_u64 ( dst + i, apply<Op> ( load_u64 ( dst + i ), load_u64 ( src + i ) ) ); }
+		for ( ; i < nbytes; ++i ) { dst[i] = apply<Op> ( dst[i], src[i] ); }
+	}
+
+	// popcount ( a op b ) without storing the combined words
+	template <bitop Op>
+	size_t popcount_combined_portable( unsigned char const* a, unsigned char const* b, size_t nbytes )
+	{
+		size_t count {};
+		size_t i {};
+		for ( ; i + 8 <= nbytes; i += 8 ) { count += std::popcount ( apply<Op> ( load_u64 ( a + i ), load_u64 ( b + i ) ) ); }
+		for ( ; i < nbytes; ++i ) { count += std::popcount ( apply<Op> ( a[i], b[i] ) ); }
+		return count;
+	}
+
+	// ( a op b ) != 0 without storing the combined words
+	template <bitop Op>
+	bool any_combined_portable( unsigned char const* a, unsigned char const* b, size_t nbytes )
+	{
+		size_t i {};
+		for ( ; i + 8 <= nbytes; i += 8 ) { if ( apply<Op> ( load_u64 ( a + i ), load_u64 ( b + i ) ) ) { return true; } }
+		for ( ; i < nbytes; ++i ) { if ( apply<Op> ( a[i], b[i] ) ) { return true; } }
+		return false;
+	}
+
+#ifdef BITARRAY_X86_SIMD
+	// AVX2 kernels
+
+	// per 64-bit lane popcount of a vector through a nibble lookup table
+	BITARRAY_TARGET ( "avx2" ) inline __m256i popcount256( __m256i v )
+	{
+		auto const lookup = _mm256_setr_epi8 ( 0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+			0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4 );
+		auto const nibble = _mm256_set1_epi8 ( 0x0F );
+		auto const lo = _mm256_shuffle_epi8 ( lookup, _mm256_and_si256 ( v, nibble ) );
+		auto const hi = _mm256_shuffle_epi8 ( lookup, _mm256_and_si256 ( _mm256_srli_epi32 ( v, 4 ), nibble ) );
+		return _mm256_sad_epu8 ( _mm256_add_epi8 ( lo, hi ), _mm256_setzero_si256 () );
+	}
+
+	// carry-save adder: adds three bit vectors into a sum (`low`) and carry (`high`) vector
+	BITARRAY_TARGET ( "avx2" ) inline void csa256( __m256i& high, __m256i& low, __m256i a, __m256i b, __m256i c )
+	{
+		auto const u = _mm256_xor_si256 ( a, b );
+		high = _mm256_or_si256 ( _mm256_and_si256 ( a, b ), _mm256_and_si256 ( u, c ) );
+		low = _mm256_xor_si256 ( u, c );
+	}
+
+	// Harley-Seal: a tree of carry-save adders over 16 vectors, so only one in 16 vectors
+	// pays for a full popcount
+	BITARRAY_TARGET ( "avx2" ) inline size_t popcount_avx2( unsigned char const* p, size_t nbytes )
+	{
+		auto const* v = reinterpret_cast<__m256i const*> ( p );
+		auto const nvectors = nbytes / sizeof ( __m256i );
+		auto total = _mm256_setzero_si256 ();
+		auto ones = _mm256_setzero_si256 ();
+		auto twos = _mm256_setzero_si256 ();
+		auto fours = _mm256_setzero_si256 ();
+		auto eights = _mm256_setzero_si256 ();
+		__m256i twos_a, twos_b, fours_a, fours_b, eights_a, eights_b, sixteens;
+
+		size_t i {};
+		for ( ; i + 16 <= nvectors; i += 16 )
+		{
+			csa256 ( twos_a, ones, ones, _mm256_loadu_si256 ( v + i + 0 ), _mm256_loadu_si256 ( v + i + 1 ) );
+			csa256 ( twos_b, ones, ones, _mm256_loadu_si256 ( v + i + 2 ), _mm256_loadu_si256 ( v + i + 3 ) );
+			csa256 ( fours_a, twos, twos, twos_a, twos_b );
+			csa256 ( twos_a, ones, ones, _mm256_loadu_si256 ( v + i + 4 ), _mm256_loadu_si256 ( v + i + 5 ) );
+			csa256 ( twos_b, ones, ones, _mm256_loadu_si256 ( v + i + 6 ), _mm256_loadu_si256 ( v + i + 7 ) );
+			csa256 ( fours_b, twos, twos, twos_a, twos_b );
+			csa256 ( eights_a, fours, fours, fours_a, fours_b );
+			csa256 ( twos_a, ones, ones, _mm256_loadu_si256 ( v + i + 8 ), _mm256_loadu_si256 ( v + i + 9 ) );
+			csa256 ( twos_b, ones, ones, _mm256_loadu_si256 ( v + i + 10 ), _mm256_loadu_si256 ( v + i + 11 ) );
+			csa256 ( fours_a, twos, twos, twos_a, twos_b );
+			csa256 ( twos_a, ones, ones, _mm256_loadu_si256 ( v + i + 12 ), _mm256_loadu_si256 ( v + i + 13 ) );
+			csa256 ( twos_b, ones, ones, _mm256_loadu_si256 ( v + i + 14 ), _mm256_loadu_si256 ( v + i + 15 ) );
+			csa256 ( fours_b, twos, twos, twos_a, twos_b );
+			csa256 ( eights_b, fours, fours, fours_a, fours_b );
+			csa256 ( sixteens, eights, eights, eights_a, eights_b );
+			total = _mm256_add_epi64 ( total, popcount256 ( sixteens ) );
+		}
+
+		total = _mm256_slli_epi64 ( total, 4 );
+		total = _mm256_add_epi64 ( total, _mm256_slli_epi64 ( popcount256 ( eights ), 3 ) );
+		total = _mm256_add_epi64 ( total, _mm256_slli_epi64 ( popcount256 ( fours ), 2 ) );
+		total = _mm256_add_epi64 ( total, _mm256_slli_epi64 ( popcount256 ( twos ), 1 ) );
+		total = _mm256_add_epi64 ( total, popcount256 ( ones ) );
+		for ( auto const* q = v + i; q < v + nvectors; ++q ) { total = _mm256_add_epi64 ( total, popcount256 ( _mm256_loadu_si256 ( q ) ) ); }
+
+		auto const count = size_t ( _mm256_extract_epi64 ( total, 0 ) ) + size_t ( _mm256_extract_epi64 ( total, 1 ) )
+			+ size_t ( _mm256_extract_epi64 ( total, 2 ) ) + size_t ( _mm256_extract_epi64 ( total, 3 ) );
+		auto const done = nvectors * sizeof ( __m256i );
+		return count + popcount_portable ( p + done, nbytes - done );
+	}
+
+	BITARRAY_TARGET ( "avx2" ) inline bool any_avx2( unsigned char const* p, size_t nbytes )
+	{
+		auto const nvectors = nbytes / sizeof ( __m256i );
+		auto const* v = reinterpret_cast<__m256i const*> ( p );
+		size_t i {};
+		for ( ; i + 4 <= nvectors; i += 4 )
+		{
+			auto const folded = _mm256_or_si256 ( _mm256_or_si256 ( _mm256_loadu_si256 ( v + i ), _mm256_loadu_si256 ( v + i + 1 ) ),
+				_mm256_or_si256 ( _mm256_loadu_si256 ( v + i + 2 ), _mm256_loadu_si256 ( v + i + 3 ) ) );
+			if ( !_mm256_testz_si256 ( folded, folded ) ) { return true; }
+		}
+		for ( ; i < nvectors; ++i )
+		{
+			auto const word = _mm256_loadu_si256 ( v + i );
+			if ( !_mm256_testz_si256 ( word, word ) ) { return true; }
+		}
+		auto const done = nvectors * sizeof ( __m256i );
+		return any_portable ( p + done, nbytes - done );
+	}
+
+	BITARRAY_TARGET ( "avx2" ) inline bool all_ones_avx2( unsigned char const* p, size_t nbytes )
+	{
+		auto const nvectors = nbytes / sizeof ( __m256i );
+		auto const* v = reinterpret_cast<__m256i const*> ( p );
+		auto const ones = _mm256_set1_epi8 ( -1 );
+		size_t i {};
+		for ( ; i + 4 <= nvectors; i += 4 )
+		{
+			auto const folded = _mm256_and_si256 ( _mm256_and_si256 ( _mm256_loadu_si256 ( v + i ), _mm256_loadu_si256 ( v + i + 1 ) ),
+				_mm256_and_si256 ( _mm256_loadu_si256 ( v + i + 2 ), _mm256_loadu_si256 ( v + i + 3 ) ) );
+			if ( !_mm256_testc_si256 ( folded, ones ) ) { return false; }
+		}
+		for ( ; i < nvectors; ++i )
+		{
+			if ( !_mm256_testc_si256 ( _mm256_loadu_si256 ( v + i ), ones ) ) { return false; }
+		}
+		auto const done = nvectors * sizeof ( __m256i );
+		return all_ones_portable ( p + done, nbytes - done );
+	}
+
+	template <bitop Op>
+	BITARRAY_TARGET ( "avx2" ) __m256i apply256( __m256i a, __m256i b )
+	{
+		if constexpr ( Op == bitop::and_op ) { return _mm256_and_si256 ( a, b ); }
+		else if constexpr ( Op == bitop::or_op ) { return _mm256_or_si256 ( a, b ); }
+		else if constexpr ( Op == bitop::xor_op ) { return _mm256_xor_si256 ( a, b ); }
+		else { return _mm256_andnot_si256 ( b, a ); }
+	}
+
+	template <bitop Op>
+	BITARRAY_TARGET ( "avx2" ) void combine_avx2( unsigned char* dst, unsigned char const* src, size_t nbytes )
+	{
+		auto const nvectors = nbytes / sizeof ( __m256i );
+		auto* d = reinterpret_cast<__m256i*> ( dst );
+		auto const* s = reinterpret_cast<__m256i const*> ( src );
+		for ( size_t i {}; i < nvectors; ++i )
+		{
+			_mm256_storeu_si256 ( d + i, apply256<Op> ( _mm256_loadu_si256 ( d + i ), _mm256_loadu_si256 ( s + i ) ) );
+		}
+		auto const done = nvectors * sizeof ( __m256i );
+		combine_portable<Op> ( dst + done, src + done, nbytes - done );
+	}
+
+	template <bitop Op>
+	BITARRAY_TARGET ( "avx2" ) size_t popcount_combined_avx2( unsigned char const* a, unsigned char const* b, size_t nbytes )
+	{
+		auto const nvectors = nbytes / sizeof ( __m256i );
+		auto const* va = reinterpret_cast<__m256i const*> ( a );
+		auto const* vb = reinterpret_cast<__m256i const*> ( b );
+		auto total = _mm256_setzero_si256 ();
+		for ( size_t i {}; i < nvectors; ++i )
+		{
+			total = _mm256_add_epi64 ( total, popcount256 ( apply256<Op> ( _mm256_loadu_si256 ( va + i ), _mm256_loadu_si256 ( vb + i ) ) ) );
+		}
+		auto const count = size_t ( _mm256_extract_epi64 ( total, 0 ) ) + size_t ( _mm256_extract_epi64 ( total, 1 ) )
+			+ size_t ( _mm256_extract_epi64 ( total, 2 ) ) + size_t ( _mm256_extract_epi64 ( total, 3 ) );
+		auto const done = nvectors * sizeof ( __m256i );
+		return count + popcount_combined_portable<Op> ( a + done, b + done, nbytes - done );
+	}
+
+	template <bitop Op>
+	BITARRAY_TARGET ( "avx2" ) bool any_combined_avx2( unsigned char const* a, unsigned char const* b, size_t nbytes )
+	{
+		auto const nvectors = nbytes / sizeof ( __m256i );
+		auto const* va = reinterpret_cast<__m256i const*> ( a );
+		auto const* vb = reinterpret_cast<__m256i const*> ( b );
+		for ( size_t i {}; i < nvectors; ++i )
+		{
+			auto const word = apply256<Op> ( _mm256_loadu_si256 ( va + i ), _mm256_loadu_si256 ( vb + i ) );
+			if ( !_mm256_testz_si256 ( word, word ) ) { return true; }
+		}
+		auto const done = nvectors * sizeof ( __m256i );
+		return any_combined_portable<Op> ( a + done, b + done, nbytes - done );
+	}
+
+	BITARRAY_TARGET ( "avx2" ) inline bool parse64_avx2( char const* text, std::uint64_t& bits )
+	{
+		auto const lo = _mm256_loadu_si256 ( reinterpret_cast<__m256i const*> ( text ) );
+		auto const hi = _mm256_loadu_si256 ( reinterpret_cast<__m256i const*> ( text + 32 ) );
+		auto const one = _mm256_set1_epi8 ( '1' );
+		auto const zero = _mm256_set1_epi8 ( '0' );
+		auto const ones_lo = std::uint32_t ( _mm256_movemask_epi8 ( _mm256_cmpeq_epi8 ( lo, one ) ) );
+		auto const ones_hi = std::uint32_t ( _mm256_movemask_epi8 ( _mm256_cmpeq_epi8 ( hi, one ) ) );
+		auto const zeros_lo = std::uint32_t ( _mm256_movemask_epi8 ( _mm256_cmpeq_epi8 ( lo, zero ) ) );
+		auto const zeros_hi = std::uint32_t ( _mm256_movemask_epi8 ( _mm256_cmpeq_epi8 ( hi, zero ) ) );
+		bits = ones_lo | std::uint64_t ( ones_hi ) << 32;
+		return ( ( ones_lo | zeros_lo ) & ( ones_hi | zeros_hi ) ) == 0xFFFFFFFFu;
+	}
+
+	// expands 32 bits to 32 characters: byte `j` picks source byte `j / 8` and tests bit `j % 8`
+	BITARRAY_TARGET ( "avx2" ) inline __m256i format32_avx2( std::uint32_t bits )
+	{
+		auto const spread = _mm256_shuffle_epi8 ( _mm256_set1_epi32 ( int ( bits ) ),
+			_mm256_setr_epi8 ( 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1,
+				2, 2, 2, 2, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3 ) );
+		auto const select = _mm256_set1_epi64x ( 0x8040201008040201ll );
+		auto const set = _mm256_cmpeq_epi8 ( _mm256_and_si256 ( spread, select ), select );
+		return _mm256_sub_epi8 ( _mm256_set1_epi8 ( '0' ), set ); // a set byte is -1, so '0' - -1 == '1'
+	}
+
+	BITARRAY_TARGET ( "avx2" ) inline void format64_avx2( char* text, std::uint64_t bits )
+	{
+		_mm256_storeu_si256 ( reinterpret_cast<__m256i*> ( text ), format32_avx2 ( std::uint32_t ( bits ) ) );
+		_mm256_storeu_si256 ( reinterpret_cast<__m256i*> ( text + 32 ), format32_avx2 ( std::uint32_t ( bits >> 32 ) ) );
+	}
+
+	template <class Sink>
+	BITARRAY_TARGET ( "avx2" ) size_t parse_text_avx2( char const* text, size_t first, size_t last, Sink& sink )
+	{
+		for ( auto k { first }; k < last; ++k )
+		{
+			std::uint64_t bits;
+			if ( !parse64_avx2 ( text + 64 * k, bits ) ) { return k; }
+			sink ( k, bits );
+		}
+		return last;
+	}
+
+	template <class Source>
+	BITARRAY_TARGET ( "avx2" ) void format_text_avx2( char* text, size_t first, size_t last, Source& source )
+	{
+		for ( auto k { first }; k < last; ++k ) { format64_avx2 ( text + 64 * k, source ( k ) ); }
+	}
+
+	// AVX-512 kernels
+
+	template <bitop Op>
+	BITARRAY_TARGET ( "avx512f" ) __m512i apply512( __m512i a, __m512i b )
+	{
+		if constexpr ( Op == bitop::and_op ) { return _mm512_and_si512 ( a, b ); }
+		else if constexpr ( Op == bitop::or_op ) { return _mm512_or_si512 ( a, b ); }
+		else if constexpr ( Op == bitop::xor_op ) { return _mm512_xor_si512 ( a, b ); }
+		else { return _mm512_ternarylogic_epi64 ( a, b, b, 0x30 ); } // a & ~b
+	}
+
+	template <bitop Op>
+	BITARRAY_TARGET ( "avx512f" ) void combine_avx512( unsigned char* dst, unsigned char const* src, size_t nbytes )
+	{
+		auto const nvectors = nbytes / sizeof ( __m512i );
+		auto* d = reinterpret_cast<__m512i*> ( dst );
+		auto const* s = reinterpret_cast<__m512i const*> ( src );
+		for ( size_t i {}; i < nvectors; ++i )
+		{
+			_mm512_storeu_si512 ( d + i, apply512<Op> ( _mm512_loadu_si512 ( d + i ), _mm512_loadu_si512 ( s + i ) ) );
+		}
+		auto const done = nvectors * sizeof ( __m512i );
+		combine_portable<Op> ( dst + done, src + done, nbytes - done );
+	}
+
+	template <bitop Op>
+	BITARRAY_TARGET ( "avx512f,avx512vpopcntdq" ) size_t popcount_combined_avx512( unsigned char const* a, unsigned char const* b, size_t nbytes )
+	{
+		auto const nvectors = nbytes / sizeof ( __m512i );
+		auto const* va = reinterpret_cast<__m512i const*> ( a );
+		auto const* vb = reinterpret_cast<__m512i const*> ( b );
+		auto total = _mm512_setzero_si512 ();
+		for ( size_t i {}; i < nvectors; ++i )
+		{
+			total = _mm512_add_epi64 ( total, _mm512_popcnt_epi64 ( apply512<Op> ( _mm512_loadu_si512 ( va + i ), _mm512_loadu_si512 ( vb + i ) ) ) );
+		}
+		std::uint64_t lanes[8];
+		_mm512_storeu_si512 ( lanes, total );
+		size_t count {};
+		for ( auto const lane : lanes ) { count += size_t ( lane ); }
+		auto const done = nvectors * sizeof ( __m512i );
+		return count + popcount_combined_portable<Op> ( a + done, b + done, nbytes - done );
+	}
+
+	BITARRAY_TARGET ( "avx512f,avx512vpopcntdq" ) inline size_t popcount_avx512( unsigned char const* p, size_t nbytes )
+	{
+		auto const nvectors = nbytes / sizeof ( __m512i );
+		auto const* v = reinterpret_cast<__m512i const*> ( p );
+		auto total_a = _mm512_setzero_si512 ();
+		auto total_b = _mm512_setzero_si512 ();
+		size_t i {};
+		// two accumulators hide the latency of the vector add
+		for ( ; i + 2 <= nvectors; i += 2 )
+		{
+			total_a = _mm512_add_epi64 ( total_a, _mm512_popcnt_epi64 ( _mm512_loadu_si512 ( v + i ) ) );
+			total_b = _mm512_add_epi64 ( total_b, _mm512_popcnt_epi64 ( _mm512_loadu_si512 ( v + i + 1 ) ) );
+		}
+		if ( i < nvectors ) { total_a = _mm512_add_epi64 ( total_a, _mm512_popcnt_epi64 ( _mm512_loadu_si512 ( v + i ) ) ); }
+
+		std::uint64_t lanes[8];
+		_mm512_storeu_si512 ( lanes, _mm512_add_epi64 ( total_a, total_b ) );
+		size_t count {};
+		for ( auto const lane : lanes ) { count += size_t ( lane ); }
+		auto const done = nvectors * sizeof ( __m512i );
+		return count + popcount_portable ( p + done, nbytes - done );
+	}
+
+	inline isa detect_isa()
+	{
+#if defined( _MSC_VER ) && !defined( __clang__ )
+		int regs[4] {};
+		__cpuid ( regs, 0 );
+		if ( regs[0] < 7 ) { return isa::portable; }
+		__cpuidex ( regs, 7, 0 );
+		auto const avx2 = ( regs[1] & ( 1 << 5 ) ) != 0;
+		auto const avx512f = ( regs[1] & ( 1 << 16 ) ) != 0;
+		auto const vpopcntdq = ( regs[2] & ( 1 << 14 ) ) != 0;
+		// the OS must also save the wider registers on a context switch
+		auto const xcr0 = _xgetbv ( 0 );
+		auto const ymm_saved = ( xcr0 & 0x6 ) == 0x6;
+		auto const zmm_saved = ( xcr0 & 0xE6 ) == 0xE6;
+		if ( avx512f && vpopcntdq && zmm_saved ) { return isa::avx512; }
+		if ( avx2 && ymm_saved ) { return isa::avx2; }
+		return isa::portable;
+#else
+		__builtin_cpu_init ();
+		if ( __builtin_cpu_supports ( "avx512f" ) && __builtin_cpu_supports ( "avx512vpopcntdq" ) ) { return isa::avx512; }
+		if ( __builtin_cpu_supports ( "avx2" ) ) { return isa::avx2; }
+		return isa::portable;
+#endif
+	}
+#else
+	inline isa detect_isa() { return isa::portable; }
+#endif
+
+	// the instruction set picked for this process, detected once on first use
+	inline isa active_isa()
+	{
+		static isa const level = detect_isa ();
+		return level;
+	}
+
+	// Dispatching entry points. Buffers shorter than one vector go straight to the portable kernel.
+
+	inline size_t popcount( void const* data, size_t nbytes )
+	{
+		auto const* p = static_cast<unsigned char const*> ( data );
+#ifdef BITARRAY_X86_SIMD
+		if ( nbytes >= 64 )
+		{
+			switch ( active_isa () )
+			{
+			case isa::avx512: return popcount_avx512 ( p, nbytes );
+			case isa::avx2: return popcount_avx2 ( p, nbytes );
+			default: break;
+			}
+		}
+#endif
+		return popcount_portable ( p, nbytes );
+	}
+
+	inline bool any( void const* data, size_t nbytes )
+	{
+		auto const* p = static_cast<unsigned char const*> ( data );
+#ifdef BITARRAY_X86_SIMD
+		if ( nbytes >= 64 && active_isa () != isa::portable ) { return any_avx2 ( p, nbytes ); }
+#endif
+		return any_portable ( p, nbytes );
+	}
+
+	inline bool all_ones( void const* data, size_t nbytes )
+	{
+		auto const* p = static_cast<unsigned char const*> ( data );
+#ifdef BITARRAY_X86_SIMD
+		if ( nbytes >= 64 && active_isa () != isa::portable ) { return all_ones_avx2 ( p, nbytes ); }
+#endif
+		return all_ones_portable ( p, nbytes );
+	}
+
+	// dst = dst op src, over `nbytes` bytes of both buffers
+	template <bitop Op>
+	void combine( void* dst, void const* src, size_t nbytes )
+	{
+		auto* d = static_cast<unsigned char*> ( dst );
+		auto const* s = static_cast<unsigned char const*> ( src );
+#ifdef BITARRAY_X86_SIMD
+		if ( nbytes >= 64 )
+		{
+			switch ( active_isa () )
+			{
+			case isa::avx512: combine_avx512<Op> ( d, s, nbytes ); return;
+			case isa::avx2: combine_avx2<Op> ( d, s, nbytes ); return;
+			default: break;
+			}
+		}
+#endif
+		combine_portable<Op> ( d, s, nbytes );
+	}
+
+	template <bitop Op>
+	size_t popcount_combined( void const* a, void const* b, size_t nbytes )
+	{
+		auto const* pa = static_cast<unsigned char const*> ( a );
+		auto const* pb = static_cast<unsigned char const*> ( b );
+#ifdef BITARRAY_X86_SIMD
+		if ( nbytes >= 64 )
+		{
+			switch ( active_isa () )
+			{
+			case isa::avx512: return popcount_combined_avx512<Op> ( pa, pb, nbytes );
+			case isa::avx2: return popcount_combined_avx2<Op> ( pa, pb, nbytes );
+			default: break;
+			}
+		}
+#endif
+		return popcount_combined_portable<Op> ( pa, pb, nbytes );
+	}
+
+	// Thread pool and execution policies
+	// The whole-array ops of BitArray take an optional execution policy, as the standard
+	// algorithms do: `seq` runs on the calling thread and `par` splits the words into pieces
+	// that start on 64-byte cache lines, so no two threads ever write the same line, and
+	// hands them to a pool of threads that is started once and reused.
+
+	// A fixed set of worker threads; the thread calling `run` works on the job as well, so a
+	// pool of `n` runs `n` pieces at once. One job runs at a time, and a job started from
+	// inside another job runs on the calling thread.
+	class thread_pool
+	{
+		struct job
+		{
+			void ( *task )( void*, size_t );
+			void* body;
+			size_t npieces;
+			std::atomic<size_t> next {};
+			std::atomic<size_t> remaining {};
+			size_t workers {}; // workers that have joined, guarded by `lock_`
+			std::exception_ptr error {}; // the first exception a piece threw, guarded by `lock_`
+		};
+
+		std::vector<std::thread> workers_;
+		std::mutex submit_; // serializes callers
+		std::mutex lock_;
+		std::condition_variable wake_;
+		std::condition_variable done_;
+		job* job_ {};
+		size_t generation_ {};
+		bool stop_ {};
+
+		static bool& inside_job()
+		{
+			static thread_local bool inside {};
+			return inside;
+		}
+
+		void drain( job& j )
+		{
+			for ( size_t k; ( k = j.next.fetch_add ( 1, std::memory_order_relaxed ) ) < j.npieces; )
+			{
+				try { j.task ( j.body, k ); }
+				catch ( ... )
+				{
+					// kept for `run` to rethrow; the piece still counts as finished
+					std::lock_guard<std::mutex> const guard ( lock_ );
+					if ( !j.error ) { j.error = std::current_exception (); }
+				}
+				j.remaining.fetch_sub ( 1, std::memory_order_acq_rel );
+			}
+		}
+
+		void work()
+		{
+			inside_job () = true;
+			size_t seen {};
+			for ( ;; )
+			{
+				job* j;
+				{
+					std::unique_lock<std::mutex> guard ( lock_ );
+					wake_.wait ( guard, [&] { return stop_ || ( job_ && generation_ != seen ); } );
+					if ( stop_ ) { return; }
+					seen = generation_;
+					j = job_;
+					++j->workers; // the job cannot end until this worker has left it
+				}
+				drain ( *j );
+				{
+					std::lock_guard<std::mutex> const guard ( lock_ );
+					--j->workers;
+				}
+				done_.notify_all ();
+			}
+		}
+
+	public:
+		explicit thread_pool( size_t const nthreads = std::thread::hardware_concurrency () )
+		{
+			for ( size_t i { 1 }; i < nthreads; ++i ) { workers_.emplace_back ( &thread_pool::work, this ); }
+		}
+
+		thread_pool( thread_pool const& ) = delete;
+		auto operator=( thread_pool const& ) -> thread_pool& = delete;
+
+		~thread_pool()
+		{
+			{
+				std::lock_guard<std::mutex> const guard ( lock_ );
+				stop_ = true;
+			}
+			wake_.notify_all ();
+			for ( auto& worker : workers_ ) { worker.join (); }
+		}
+
+		size_t size() const { return workers_.size () + 1; } // threads working on each job
+
+		// calls `body ( k )` once for every k in [0, npieces) and returns when all have finished.
+		// If pieces throw, the rest still run and the first exception is rethrown here.
+		template <class Body>
+		void run( size_t const npieces, Body& body )
+		{
+			if ( workers_.empty () || npieces < 2 || inside_job () )
+			{
+				for ( size_t k {}; k < npieces; ++k ) { body ( k ); }
+				return;
+			}
+
+			std::lock_guard<std::mutex> const one_job ( submit_ );
+			job j { []( void* b, size_t k ) { ( *static_cast<Body*> ( b ) ) ( k ); }, &body, npieces };
+			j.remaining.store ( npieces, std::memory_order_relaxed );
+			{
+				std::lock_guard<std::mutex> const guard ( lock_ );
+				job_ = &j;
+				++generation_;
+			}
+			wake_.notify_all ();
+
+			inside_job () = true;
+			drain ( j );
+			inside_job () = false;
+
+			std::unique_lock<std::mutex> guard ( lock_ );
+			done_.wait ( guard, [&] { return j.remaining.load ( std::memory_order_acquire ) == 0 && j.workers == 0; } );
+			job_ = nullptr;
+			if ( j.error ) { std::rethrow_exception ( j.error ); }
+		}
+	};
+
+	// the pool behind `par`, with one thread per core, started on first use
+	inline thread_pool& default_pool()
+	{
+		static thread_pool pool;
+		return pool;
+	}
+
+	struct sequenced_policy {};
+
+	struct parallel_policy
+	{
+		thread_pool* pool {};                       // `nullptr` means `default_pool ()`
+		size_t min_bytes { size_t ( 1 ) << 22 };   // smaller arrays run on the calling thread
+
+		thread_pool& workers() const { return pool ? *pool : default_pool (); }
+	};
+
+	inline constexpr sequenced_policy seq {};
+	inline constexpr parallel_policy par {};
+
+	template <class Policy>
+	concept execution_policy = std::same_as<std::remove_cvref_t<Policy>, sequenced_policy>
+		|| std::same_as<std::remove_cvref_t<Policy>, parallel_policy>;
+
+	inline bool runs_parallel( sequenced_policy const&, size_t ) { return false; }
+
+	inline bool runs_parallel( parallel_policy const& policy, size_t const nbytes )
+	{
+		return nbytes >= policy.min_bytes && policy.workers ().size () > 1;
+	}
+
+	// Calls `body ( first, last )` for byte ranges that cover [0, nbytes); every boundary
+	// between two ranges is a multiple of 64, so it falls on a cache line and on a word
+	template <class Policy, class Body>
+	void for_each_chunk( Policy const& policy, size_t const nbytes, Body body )
+	{
+		if ( !runs_parallel ( policy, nbytes ) )
+		{
+			body ( size_t {}, nbytes );
+			return;
+		}
+		if constexpr ( std::same_as<Policy, parallel_policy> )
+		{
+			// a few pieces per thread, so a thread that starts late does not hold up the rest
+			auto& pool = policy.workers ();
+			auto const step = std::max<size_t> ( 64, ( nbytes / ( 4 * pool.size () ) + 63 ) / 64 * 64 );
+			auto const npieces = ( nbytes + step - 1 ) / step;
+			auto piece = [&]( size_t const k ) { body ( k * step, std::min ( nbytes, k * step + step ) ); };
+			pool.run ( npieces, piece );
+		}
+	}
+
+	// Splits [0, count) into one contiguous range per thread of `workers` (`nullptr` means
+	// `default_pool ()`) and calls `body ( first, last )` for each, once `count` is at least
+	// `min_parallel`; smaller counts run on the calling thread without starting any pool
+	template <class Body>
+	void parallel_for( size_t count, size_t min_parallel, Body body, thread_pool* const workers = nullptr )
+	{
+		if ( count < min_parallel )
+		{
+			body ( size_t {}, count );
+			return;
+		}
+		auto& pool = workers ? *workers : default_pool ();
+		if ( pool.size () <= 1 )
+		{
+			body ( size_t {}, count );
+			return;
+		}
+
+		auto const step = ( count + pool.size () - 1 ) / pool.size ();
+		auto piece = [&]( size_t const k ) { body ( k * step, std::min ( count, k * step + step ) ); };
+		pool.run ( ( count + step - 1 ) / step, piece );
+	}
+
+	// Parses the 64 character blocks [first, last) of `text`, handing each chunk to
+	// `sink ( block, bits )`; returns the first block holding a character other than
+	// '0' or '1', or `last` if there is none
+	template <class Sink>
+	size_t parse_text( char const* text, size_t first, size_t last, Sink sink )
+	{
+#ifdef BITARRAY_X86_SIMD
+		if ( active_isa () != isa::portable ) { return parse_text_avx2 ( text, first, last, sink ); }
+#endif
+		for ( auto k { first }; k < last; ++k )
+		{
+			std::uint64_t bits;
+			if ( !parse64_portable ( text + 64 * k, bits ) ) { return k; }
+			sink ( k, bits );
+		}
+		return last;
+	}
+
+	// Writes the 64 character blocks [first, last) of `text` from the chunks `source ( block )`
+	template <class Source>
+	void format_text( char* text, size_t first, size_t last, Source source )
+	{
+#ifdef BITARRAY_X86_SIMD
+		if ( active_isa () != isa::portable )
+		{
+			format_text_avx2 ( text, first, last, source );
+			return;
+		}
+#endif
+		for ( auto k { first }; k < last; ++k ) { format64_portable ( text + 64 * k, source ( k ) ); }
+	}
+
+	template <bitop Op>
+	bool any_combined( void const* a, void const* b, size_t nbytes )
+	{
+		auto const* pa = static_cast<unsigned char const*> ( a );
+		auto const* pb = static_cast<unsigned char const*> ( b );
+#ifdef BITARRAY_X86_SIMD
+		if ( nbytes >= 64 && active_isa () != isa::portable ) { return any_combined_avx2<Op> ( pa, pb, nbytes ); }
+#endif
+		return any_combined_portable<Op> ( pa, pb, nbytes );
+	}
+}
+#endif // BIT_KERNELS_H
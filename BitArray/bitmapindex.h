@@ -0,0 +1,340 @@
+// bitmapindex.h: bitmap indexes and their queries
+#ifndef BITMAP_INDEX_H
+#define BITMAP_INDEX_H
+#include <algorithm>
+#include <bit>
+#include <climits>
+#include <cstddef>
+#include <functional>
+#include <initializer_list>
+#include <map>
+#include <ranges>
+#include <utility>
+#include <vector>
+#include "bitarray.h"
+#include "bitkernels.h"
+
+// Bitmap indexes and the queries over them. A `BitmapIndex` keeps one BitArray per distinct
+// value of a column, with bit `row` set in the bitmap of that row's value; it suits columns of
+// up to a few thousand distinct values. Its terms combine into a `BitmapQuery` with `&`, `|`
+// and `~`, like the arrays themselves:
+//    BitmapIndex<int> region { regions }, status { statuses };
+//    auto const q = region.equals ( 3 ) & status.in ( { 1, 2 } ) & ~flagged.equals ( true );
+//    for ( auto row : q.row_ids () ) { ... }
+// A query is planned as it is built: chains of `&` and `|` are flattened into one node, and
+// their terms are ordered by their 1-bit counts, the rarest first for `&` and the commonest
+// first for `|`. It is evaluated in one pass over the bitmaps, a block of words at a time:
+// each term is combined into a block small enough to stay in the L1 cache, and the rest of an
+// `&` chain is skipped for a block that is already empty (or of an `|` chain for one that is
+// already full), so no whole-size intermediate array is ever made.
+// A query reads its bitmaps when it is evaluated, but takes the number of rows from the
+// indexes when it is built; build it again after appending rows.
+template <class IType = size_t>
+class BitmapQuery
+{
+	enum { BITS_PER_WORD = CHAR_BIT * sizeof ( IType ) };
+	static constexpr size_t BLOCK_WORDS = 2048 / sizeof ( IType ); // 2 KiB per tree level
+
+	enum class kind { leaf, all_of, any_of, negate };
+
+	struct node
+	{
+		kind op { kind::leaf };
+		BitArray<IType> const* bitmap {}; // a leaf's bitmap; `nullptr` matches no rows
+		size_t estimate {};               // the 1-bits expected; exact for a leaf
+		std::vector<node> children;
+	};
+
+	node root_ {};
+	size_t nrows_ {};
+
+	template <class, class> friend class BitmapIndex;
+
+	BitmapQuery( BitArray<IType> const* bitmap, size_t const ones, size_t const nrows ) : root_ { kind::leaf, bitmap, ones, {} }, nrows_ { nrows } {}
+
+	bool matches_nothing() const { return root_.op == kind::leaf && !root_.bitmap; }
+
+	static size_t words_for( size_t const nbits ) { return ( nbits + BITS_PER_WORD - 1 ) / BITS_PER_WORD; }
+
+	// flattens `a` and `b` into one `op` node and orders its terms
+	static BitmapQuery join( kind const op, BitmapQuery a, BitmapQuery b )
+	{
+		BitmapQuery q;
+		q.nrows_ = std::max ( a.nrows_, b.nrows_ );
+		if ( op == kind::any_of )
+		{
+			// a term that matches nothing drops out of an `|`
+			if ( a.matches_nothing () ) { b.nrows_ = q.nrows_; return b; }
+			if ( b.matches_nothing () ) { a.nrows_ = q.nrows_; return a; }
+		}
+		q.root_.op = op;
+		for ( auto* part : { &a.root_, &b.root_ } )
+		{
+			if ( part->op == op ) { std::move ( part->children.begin (), part->children.end (), std::back_inserter ( q.root_.children ) ); }
+			else { q.root_.children.push_back ( std::move ( *part ) ); }
+		}
+
+		auto& terms = q.root_.children;
+		if ( op == kind::all_of )
+		{
+			std::stable_sort ( terms.begin (), terms.end (), []( node const& x, node const& y ) { return x.estimate < y.estimate; } );
+			q.root_.estimate = terms.front ().estimate;
+		}
+		else
+		{
+			std::stable_sort ( terms.begin (), terms.end (), []( node const& x, node const& y ) { return x.estimate > y.estimate; } );
+			size_t sum {};
+			for ( auto const& t : terms ) { sum += t.estimate; }
+			q.root_.estimate = std::min ( sum, q.nrows_ );
+		}
+		return q;
+	}
+
+	// the words of a leaf's bitmap from word `first` on; `avail` is how many of the `n` wanted
+	// it has, the rest being zeros
+	static IType const* leaf_words( node const& leaf, size_t const first, size_t const n, size_t& avail )
+	{
+		auto const stored = leaf.bitmap ? words_for ( leaf.bitmap->size () ) : 0;
+		avail = first < stored ? std::min ( n, stored - first ) : 0;
+		return avail ? BitSpan<IType> ( *leaf.bitmap ).aligned_words () + first : nullptr;
+	}
+
+	// writes words [first, first + n) of `x` to `out`; past the last row they hold garbage
+	void eval( node const& x, size_t const first, size_t const n, IType* out ) const
+	{
+		if ( x.op == kind::leaf )
+		{
+			size_t avail;
+			auto const* words = leaf_words ( x, first, n, avail );
+			std::copy_n ( words, avail, out );
+			std::fill ( out + avail, out + n, IType ( 0 ) );
+			return;
+		}
+		eval ( x.children.front (), first, n, out );
+		if ( x.op == kind::negate )
+		{
+			for ( size_t i {}; i < n; ++i ) { out[i] = IType ( ~out[i] ); }
+			return;
+		}
+
+		IType scratch[BLOCK_WORDS];
+		auto const nbytes = n * sizeof ( IType );
+		for ( auto t { x.children.begin () + 1 }; t != x.children.end (); ++t )
+		{
+			if ( x.op == kind::all_of )
+			{
+				if ( !bitkernels::any ( out, nbytes ) ) { return; }
+				// a leaf, or the negation of one, is combined straight from its bitmap
+				bool const negated_leaf = t->op == kind::negate && t->children.front ().op == kind::leaf;
+				if ( t->op == kind::leaf || negated_leaf )
+				{
+					size_t avail;
+					auto const* words = leaf_words ( negated_leaf ? t->children.front () : *t, first, n, avail );
+					if ( negated_leaf ) { bitkernels::combine<bitkernels::bitop::and_not_op> ( out, words, avail * sizeof ( IType ) ); }
+					else
+					{
+						bitkernels::combine<bitkernels::bitop::and_op> ( out, words, avail * sizeof ( IType ) );
+						std::fill ( out + avail, out + n, IType ( 0 ) );
+					}
+					continue;
+				}
+				eval ( *t, first, n, scratch );
+				bitkernels::combine<bitkernels::bitop::and_op> ( out, scratch, nbytes );
+			}
+			else
+			{
+				if ( bitkernels::all_ones ( out, nbytes ) ) { return; }
+				if ( t->op == kind::leaf )
+				{
+					size_t avail;
+					auto const* words = leaf_words ( *t, first, n, avail );
+					bitkernels::combine<bitkernels::bitop::or_op> ( out, words, avail * sizeof ( IType ) );
+					continue;
+				}
+				eval ( *t, first, n, scratch );
+				bitkernels::combine<bitkernels::bitop::or_op> ( out, scratch, nbytes );
+			}
+		}
+	}
+
+	// evaluates the query block by block into `storage` (a block buffer, or the result's words
+	// when `in_place`), clearing the bits past the last row, and hands each block to `sink`
+	template <class Sink>
+	void run( IType* storage, bool const in_place, Sink&& sink ) const
+	{
+		auto const nwords = words_for ( nrows_ );
+		for ( size_t first {}; first < nwords; first += BLOCK_WORDS )
+		{
+			auto const n = std::min ( BLOCK_WORDS, nwords - first );
+			auto* const block = in_place ? storage + first : storage;
+			eval ( root_, first, n, block );
+			if ( first + n == nwords && nrows_ % BITS_PER_WORD )
+			{
+				block[n - 1] &= IType ( IType ( ~IType ( 0 ) ) >> ( BITS_PER_WORD - nrows_ % BITS_PER_WORD ) );
+			}
+			sink ( first, block, n );
+		}
+	}
+
+public:
+	BitmapQuery() = default; // matches no rows
+
+	// a query over any bitmap of `nrows` rows; `bitmap` is counted once, for planning
+	BitmapQuery( BitArray<IType> const& bitmap, size_t const nrows ) : BitmapQuery ( &bitmap, bitmap.count (), nrows ) {}
+
+	friend BitmapQuery operator&( BitmapQuery a, BitmapQuery b ) { return join ( kind::all_of, std::move ( a ), std::move ( b ) ); }
+	friend BitmapQuery operator|( BitmapQuery a, BitmapQuery b ) { return join ( kind::any_of, std::move ( a ), std::move ( b ) ); }
+
+	friend BitmapQuery operator~( BitmapQuery a )
+	{
+		if ( a.root_.op == kind::negate )
+		{
+			auto inner = std::move ( a.root_.children.front () );
+			a.root_ = std::move ( inner );
+			return a;
+		}
+		BitmapQuery q;
+		q.nrows_ = a.nrows_;
+		q.root_.op = kind::negate;
+		q.root_.estimate = a.nrows_ - std::min ( a.root_.estimate, a.nrows_ );
+		q.root_.children.push_back ( std::move ( a.root_ ) );
+		return q;
+	}
+
+	size_t rows() const { return nrows_; } // the rows the query ranges over
+
+	size_t estimate() const { return root_.estimate; } // the planner's guess at `count ()`
+
+	BitArray<IType> evaluate() const // the matching rows as a bitmap
+	{
+		BitArray<IType> result ( nrows_ );
+		run ( result.bits_.data (), true, []( size_t, IType const*, size_t ) {} );
+		return result;
+	}
+
+	size_t count() const // the number of matching rows, without making the bitmap
+	{
+		size_t ones {};
+		IType block[BLOCK_WORDS];
+		run ( block, false, [&ones]( size_t, IType const* words, size_t const n ) { ones += bitkernels::popcount ( words, n * sizeof ( IType ) ); } );
+		return ones;
+	}
+
+	template <class F>
+	void for_each_row( F&& f ) const // calls `f ( row )` for each matching row, in order
+	{
+		IType block[BLOCK_WORDS];
+		run ( block, false, [&f]( size_t const first, IType const* words, size_t const n )
+		{
+			for ( size_t i {}; i < n; ++i )
+			{
+				for ( auto word { words[i] }; word; word &= IType ( word - 1 ) )
+				{
+					f ( ( first + i ) * BITS_PER_WORD + size_t ( bitword::countr_zero ( word ) ) );
+				}
+			}
+		} );
+	}
+
+	std::vector<size_t> row_ids() const // the matching row ids, in order
+	{
+		std::vector<size_t> ids;
+		ids.reserve ( root_.estimate );
+		for_each_row ( [&ids]( size_t const row ) { ids.push_back ( row ); } );
+		return ids;
+	}
+};
+
+// One column's bitmap index. `Value` must be ordered by `std::less`, which `between` uses.
+template <class Value, class IType = size_t>
+class BitmapIndex
+{
+	struct entry
+	{
+		BitArray<IType> bits;
+		size_t ones {}; // kept for the query planner
+	};
+
+	std::map<Value, entry, std::less<>> bitmaps_;
+	size_t nrows_ {};
+
+	BitmapQuery<IType> term( entry const& e ) const { return { &e.bits, e.ones, nrows_ }; }
+
+public:
+	BitmapIndex() = default;
+
+	// Indexes a column in one pass; a sized column gets every bitmap at its full size up front
+	template <std::ranges::input_range Column>
+	explicit BitmapIndex( Column&& column )
+	{
+		if constexpr ( std::ranges::sized_range<Column> )
+		{
+			nrows_ = size_t ( std::ranges::size ( column ) );
+			size_t row {};
+			for ( auto&& value : column )
+			{
+				auto const [it, fresh] = bitmaps_.try_emplace ( value );
+				auto& e = it->second;
+				if ( fresh ) { e.bits = BitArray<IType> ( nrows_ ); }
+				e.bits[row++] = true;
+				++e.ones;
+			}
+		}
+		else
+		{
+			for ( auto&& value : column ) { push_back ( value ); }
+		}
+	}
+
+	void push_back( Value const& value ) // Appends a row
+	{
+		// the other bitmaps are left short; the rows past their ends read as zeros
+		auto& e = bitmaps_.try_emplace ( value ).first->second;
+		e.bits.resize ( nrows_ );
+		e.bits += true;
+		++e.ones;
+		++nrows_;
+	}
+
+	size_t rows() const { return nrows_; }
+
+	size_t cardinality() const { return bitmaps_.size (); } // the number of distinct values
+
+	size_t count( Value const& value ) const // the rows holding `value`
+	{
+		auto const it = bitmaps_.find ( value );
+		return it == bitmaps_.end () ? 0 : it->second.ones;
+	}
+
+	size_t memory_usage() const // bytes held by the bitmaps
+	{
+		size_t bytes {};
+		for ( auto const& [value, e] : bitmaps_ ) { bytes += e.bits.capacity () / CHAR_BIT; }
+		return bytes;
+	}
+
+	// Query terms
+	BitmapQuery<IType> equals( Value const& value ) const // the rows holding `value`
+	{
+		auto const it = bitmaps_.find ( value );
+		return it == bitmaps_.end () ? BitmapQuery<IType> ( nullptr, 0, nrows_ ) : term ( it->second );
+	}
+
+	BitmapQuery<IType> in( std::initializer_list<Value> const values ) const // the rows holding any of `values`
+	{
+		auto q = BitmapQuery<IType> ( nullptr, 0, nrows_ );
+		for ( auto const& value : values ) { q = std::move ( q ) | equals ( value ); }
+		return q;
+	}
+
+	BitmapQuery<IType> between( Value const& low, Value const& high ) const // the rows holding a value in [low, high]
+	{
+		auto q = BitmapQuery<IType> ( nullptr, 0, nrows_ );
+		for ( auto it { bitmaps_.lower_bound ( low ) }; it != bitmaps_.end () && !( high < it->first ); ++it )
+		{
+			q = std::move ( q ) | term ( it->second );
+		}
+		return q;
+	}
+};
+#endif // BITMAP_INDEX_H
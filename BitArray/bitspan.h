@@ -0,0 +1,156 @@
+// bitspan.h: a read-only window of bits at any offset
+#ifndef BIT_SPAN_H
+#define BIT_SPAN_H
+#include <algorithm>
+#include <bit>
+#include <climits>
+#include <compare>
+#include <cstring>
+#include <stdexcept>
+#include "bitkernels.h"
+#include "bitword.h"
+
+// A read-only window of `nbits` bits starting at any bit `offset` of a run of words laid out
+// as in BitArray. It does not own the words; `BitArray::span` hands one out without copying,
+// and it stays valid until that array is resized or destroyed.
+// `word ( i )` realigns the window so it reads as if it started at bit 0: word `i` holds span
+// bits [i * BITS_PER_WORD, i * BITS_PER_WORD + BITS_PER_WORD), with the bits past the end zeroed.
+// Every op is built on that, so an unaligned window costs one shift per word and nothing more.
+template <class IType = size_t>
+class BitSpan
+{
+	enum { BITS_PER_WORD = CHAR_BIT * sizeof ( IType ) };
+
+	IType const* words_ {};
+	size_t offset_ {};
+	size_t nbits_ {};
+
+	static IType low_mask( size_t const nbits )
+	{
+		return nbits ? IType ( IType ( ~IType ( 0 ) ) >> ( BITS_PER_WORD - nbits ) ) : IType ( 0 );
+	}
+
+	size_t check_index( size_t const& bitpos ) const
+	{
+		if ( bitpos >= nbits_ ) { throw std::out_of_range ( "bit position out of range" ); }
+		return bitpos;
+	}
+
+public:
+	static constexpr size_t npos = static_cast<size_t> ( -1 );
+
+	BitSpan() = default;
+
+	BitSpan( IType const* words, size_t const offset, size_t const nbits ) : words_ { words }, offset_ { offset }, nbits_ { nbits } {}
+
+	BitSpan subspan( size_t const bitpos, size_t const count ) const // throws `out_of_range` past the end
+	{
+		if ( bitpos > nbits_ || count > nbits_ - bitpos ) { throw std::out_of_range ( "subspan: range out of bounds" ); }
+		return { words_, offset_ + bitpos, count };
+	}
+
+	size_t size() const { return nbits_; }
+
+	size_t nwords() const { return ( nbits_ + BITS_PER_WORD - 1 ) / BITS_PER_WORD; } // words `word ( i )` can return
+
+	// the underlying words when the window starts on a word boundary, otherwise `nullptr`
+	IType const* aligned_words() const { return offset_ % BITS_PER_WORD ? nullptr : words_ + offset_ / BITS_PER_WORD; }
+
+	IType word( size_t const i ) const
+	{
+		auto const first = offset_ + i * BITS_PER_WORD;
+		auto const w = first / BITS_PER_WORD;
+		auto const shift = first % BITS_PER_WORD;
+		auto const left = nbits_ - i * BITS_PER_WORD; // span bits from this word on
+
+		IType word = words_[w];
+		if ( shift )
+		{
+			// the next word is only read when the window actually reaches into it
+			word = IType ( word >> shift );
+			if ( left > BITS_PER_WORD - shift ) { word |= IType ( words_[w + 1] << ( BITS_PER_WORD - shift ) ); }
+		}
+		return left < BITS_PER_WORD ? IType ( word & low_mask ( left ) ) : word;
+	}
+
+	// writes `nwords ()` realigned words to `out`; a word aligned window is a single memcpy
+	void copy_to( IType* out ) const
+	{
+		auto const n = nwords ();
+		if ( !n ) { return; }
+		if ( auto const* aligned = aligned_words () )
+		{
+			std::memcpy ( out, aligned, n * sizeof ( IType ) );
+			out[n - 1] = word ( n - 1 );
+		}
+		else
+		{
+			// every word but the last takes bits from two whole source words
+			auto const* in = words_ + offset_ / BITS_PER_WORD;
+			auto const shift = offset_ % BITS_PER_WORD;
+			for ( size_t i {}; i + 1 < n; ++i ) { out[i] = IType ( in[i] >> shift | in[i + 1] << ( BITS_PER_WORD - shift ) ); }
+			out[n - 1] = word ( n - 1 );
+		}
+	}
+
+	// Bit access
+	bool operator[]( size_t const& bitpos ) const { return at ( bitpos ); }
+
+	bool at( size_t const& bitpos ) const
+	{
+		auto const pos = offset_ + check_index ( bitpos );
+		return ( words_[pos / BITS_PER_WORD] >> ( pos % BITS_PER_WORD ) & 1u ) != IType ( 0 );
+	}
+
+	// Counting ops
+	// the whole words inside the window go to the popcount kernel; only the two ends are masked
+	size_t count() const
+	{
+		if ( !nbits_ ) { return 0; }
+		auto const first = offset_ / BITS_PER_WORD;
+		auto const last = ( offset_ + nbits_ - 1 ) / BITS_PER_WORD;
+		auto const head = offset_ % BITS_PER_WORD;
+		auto const tail = ( offset_ + nbits_ ) % BITS_PER_WORD;
+		if ( first == last )
+		{
+			return size_t ( bitword::popcount ( IType ( words_[first] >> head & low_mask ( nbits_ ) ) ) );
+		}
+		auto ones = size_t ( bitword::popcount ( IType ( words_[first] >> head ) ) );
+		ones += bitkernels::popcount ( words_ + first + 1, ( last - first - 1 ) * sizeof ( IType ) );
+		return ones + size_t ( bitword::popcount ( tail ? IType ( words_[last] & low_mask ( tail ) ) : words_[last] ) );
+	}
+
+	bool any() const
+	{
+		for ( size_t i {}, n = nwords (); i < n; ++i ) { if ( word ( i ) ) { return true; } }
+		return false;
+	}
+
+	bool none() const { return !any (); }
+
+	// Comparison ops, with the same lexicographic order as BitArray
+	friend bool operator==( BitSpan const& a, BitSpan const& b )
+	{
+		if ( a.nbits_ != b.nbits_ ) { return false; }
+		for ( size_t i {}, n = a.nwords (); i < n; ++i ) { if ( a.word ( i ) != b.word ( i ) ) { return false; } }
+		return true;
+	}
+
+	friend std::strong_ordering operator<=>( BitSpan const& a, BitSpan const& b )
+	{
+		auto const common = std::min ( a.nbits_, b.nbits_ );
+		for ( size_t i {}, n = ( common + BITS_PER_WORD - 1 ) / BITS_PER_WORD; i < n; ++i )
+		{
+			auto const left = common - i * BITS_PER_WORD;
+			IType diff = IType ( a.word ( i ) ^ b.word ( i ) );
+			if ( left < BITS_PER_WORD ) { diff &= low_mask ( left ); }
+			if ( diff )
+			{
+				// the lowest differing bit is the first differing character
+				return ( a.word ( i ) >> bitword::countr_zero ( diff ) & 1u ) ? std::strong_ordering::greater : std::strong_ordering::less;
+			}
+		}
+		return a.nbits_ <=> b.nbits_;
+	}
+};
+#endif // BIT_SPAN_H
@@ -0,0 +1,191 @@
+// bitstats.h: instrumentation policies for BitArray
+#ifndef BIT_STATS_H
+#define BIT_STATS_H
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <ostream>
+#if defined( __x86_64__ ) || defined( __i386__ )
+#include <x86intrin.h>
+#elif defined( _M_X64 ) || defined( _M_IX86 )
+#include <intrin.h>
+#endif
+
+// Instrumentation policies, the third template parameter of BitArray. BitArray reports
+// reallocations, copies, moves and its bulk operations to the policy's hooks:
+//    off        the default; every hook is empty, so nothing is compiled in
+//    counting   tallies everything in process-wide relaxed atomic counters
+//    tracing    as `counting`, and also prints "move constructor" / "move assignment"
+//               to `std::cout` on every move, the trace the moves used to print
+// The tallies are read with `BitArray<...>::stats ()` (or `counting::stats ()`), e.g.
+//    using Traced = BitArray<size_t, std::allocator<size_t>, bitstats::counting>;
+//    ...
+//    std::cout << Traced::stats ();
+// Operation timings are in cycles from the time stamp counter where there is one,
+// and in nanoseconds elsewhere.
+namespace bitstats
+{
+	// the operations that are counted and timed
+	enum class op
+	{
+		append, insert, erase, shift, combine, toggle, range, count, find, compare, rank, select,
+		parse, format, slice, evaluate, OP_COUNT
+	};
+
+	inline constexpr std::array<char const*, size_t ( op::OP_COUNT )> OP_NAMES {
+		"append", "insert", "erase", "shift", "combine", "toggle", "range", "count", "find", "compare", "rank", "select",
+		"parse", "format", "slice", "evaluate"
+	};
+
+	inline std::uint64_t cycles()
+	{
+#if defined( __x86_64__ ) || defined( __i386__ ) || defined( _M_X64 ) || defined( _M_IX86 )
+		return __rdtsc ();
+#else
+		return std::uint64_t ( std::chrono::duration_cast<std::chrono::nanoseconds> (
+			std::chrono::steady_clock::now ().time_since_epoch () ).count () );
+#endif
+	}
+
+	// a copy of the counters at one moment
+	struct snapshot
+	{
+		std::uint64_t reallocations {};   // times the word storage moved to a new heap buffer
+		std::uint64_t bytes_allocated {}; // the sizes of those buffers, summed
+		std::uint64_t copies {};          // copy constructions and assignments
+		std::uint64_t moves {};           // move constructions and assignments
+		std::array<std::uint64_t, size_t ( op::OP_COUNT )> calls {};
+		std::array<std::uint64_t, size_t ( op::OP_COUNT )> cycles {};
+
+		std::uint64_t calls_to( op const o ) const { return calls[size_t ( o )]; }
+		std::uint64_t cycles_in( op const o ) const { return cycles[size_t ( o )]; }
+
+		// a table of the nonzero counters
+		friend std::ostream& operator<<( std::ostream& os, snapshot const& s )
+		{
+			os << "reallocations: " << s.reallocations << ", bytes allocated: " << s.bytes_allocated
+				<< ", copies: " << s.copies << ", moves: " << s.moves << '\n';
+			for ( size_t i {}; i < OP_NAMES.size (); ++i )
+			{
+				if ( !s.calls[i] ) { continue; }
+				os << "  " << std::left << std::setw ( 10 ) << OP_NAMES[i] << std::right << std::setw ( 12 ) << s.calls[i]
+					<< " calls " << std::setw ( 14 ) << s.cycles[i] / s.calls[i] << " cycles/call\n";
+			}
+			return os;
+		}
+	};
+
+	struct off
+	{
+		static constexpr bool enabled = false;
+		static void reallocated( size_t ) {}
+		static void copied() {}
+		static void moved( bool ) {}
+		static void called( op, std::uint64_t ) {}
+		static snapshot stats() { return {}; }
+		static void reset() {}
+	};
+
+	struct counting
+	{
+	private:
+		struct counters
+		{
+			std::atomic<std::uint64_t> reallocations {};
+			std::atomic<std::uint64_t> bytes_allocated {};
+			std::atomic<std::uint64_t> copies {};
+			std::atomic<std::uint64_t> moves {};
+			std::array<std::atomic<std::uint64_t>, size_t ( op::OP_COUNT )> calls {};
+			std::array<std::atomic<std::uint64_t>, size_t ( op::OP_COUNT )> cycles {};
+		};
+
+		static counters& data()
+		{
+			static counters c;
+			return c;
+		}
+
+		static void bump( std::atomic<std::uint64_t>& counter, std::uint64_t const by = 1 ) { counter.fetch_add ( by, std::memory_order_relaxed ); }
+
+	public:
+		static constexpr bool enabled = true;
+
+		static void reallocated( size_t const bytes )
+		{
+			bump ( data ().reallocations );
+			bump ( data ().bytes_allocated, bytes );
+		}
+
+		static void copied() { bump ( data ().copies ); }
+		static void moved( bool ) { bump ( data ().moves ); }
+
+		static void called( op const o, std::uint64_t const elapsed )
+		{
+			bump ( data ().calls[size_t ( o )] );
+			bump ( data ().cycles[size_t ( o )], elapsed );
+		}
+
+		static snapshot stats()
+		{
+			auto& c = data ();
+			snapshot s;
+			s.reallocations = c.reallocations.load ( std::memory_order_relaxed );
+			s.bytes_allocated = c.bytes_allocated.load ( std::memory_order_relaxed );
+			s.copies = c.copies.load ( std::memory_order_relaxed );
+			s.moves = c.moves.load ( std::memory_order_relaxed );
+			for ( size_t i {}; i < s.calls.size (); ++i )
+			{
+				s.calls[i] = c.calls[i].load ( std::memory_order_relaxed );
+				s.cycles[i] = c.cycles[i].load ( std::memory_order_relaxed );
+			}
+			return s;
+		}
+
+		static void reset()
+		{
+			auto& c = data ();
+			for ( auto* counter : { &c.reallocations, &c.bytes_allocated, &c.copies, &c.moves } ) { counter->store ( 0, std::memory_order_relaxed ); }
+			for ( size_t i {}; i < c.calls.size (); ++i )
+			{
+				c.calls[i].store ( 0, std::memory_order_relaxed );
+				c.cycles[i].store ( 0, std::memory_order_relaxed );
+			}
+		}
+	};
+
+	struct tracing : counting
+	{
+		static void moved( bool const assignment )
+		{
+			counting::moved ( assignment );
+			std::cout << ( assignment ? "move assignment" : "move constructor" ) << std::endl;
+		}
+	};
+
+	// Times one call of `o` from construction to destruction and reports it to `Policy`;
+	// with a policy that is not enabled it holds nothing and does nothing
+	template <class Policy, bool = Policy::enabled>
+	class probe
+	{
+		op op_;
+		std::uint64_t start_;
+	public:
+		explicit probe( op const o ) : op_ { o }, start_ { cycles () } {}
+		probe( probe const& ) = delete;
+		~probe() { Policy::called ( op_, cycles () - start_ ); }
+	};
+
+	template <class Policy>
+	class probe<Policy, false>
+	{
+	public:
+		explicit probe( op ) {}
+		probe( probe const& ) = delete;
+		~probe() {} // user provided, so an unused probe draws no warning
+	};
+}
+#endif // BIT_STATS_H
@@ -0,0 +1,223 @@
+// bitstorage.h: the word storage behind BitArray
+#ifndef BIT_STORAGE_H
+#define BIT_STORAGE_H
+#include <algorithm>
+#include <climits>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <utility>
+
+// The word storage behind BitArray: the subset of `std::vector` that BitArray uses, with the
+// first 256 bits held inside the object. An array that never outgrows them never calls the
+// allocator; past that the words come from `Allocator`, which follows the usual allocator
+// propagation rules, so a `std::pmr::polymorphic_allocator` keeps an array on its arena.
+// Words exposed by `resize` are zeroed, as `std::vector` does.
+template <class IType, class Allocator = std::allocator<IType>>
+class BitStorage
+{
+	using traits = std::allocator_traits<Allocator>;
+
+public:
+	static constexpr size_t INLINE_BITS = 256;
+	static constexpr size_t INLINE_WORDS = std::max<size_t> ( 1, INLINE_BITS / ( CHAR_BIT * sizeof ( IType ) ) );
+
+private:
+	[[no_unique_address]] Allocator alloc_ {};
+	size_t size_ {};
+	size_t capacity_ { INLINE_WORDS }; // more than INLINE_WORDS means the words are on the heap
+	union
+	{
+		IType inline_[INLINE_WORDS] {};
+		IType* heap_;
+	};
+
+	bool on_heap() const { return capacity_ > INLINE_WORDS; }
+
+	// returns to the empty inline buffer
+	void release()
+	{
+		if ( on_heap () ) { traits::deallocate ( alloc_, heap_, capacity_ ); }
+		capacity_ = INLINE_WORDS;
+		size_ = 0;
+	}
+
+	// moves to exactly `capacity` words, inline when they fit
+	void reallocate( size_t const capacity )
+	{
+		if ( capacity <= INLINE_WORDS )
+		{
+			// only a heap buffer is ever shrunk back inline
+			IType saved[INLINE_WORDS] {};
+			std::copy_n ( heap_, size_, saved );
+			traits::deallocate ( alloc_, heap_, capacity_ );
+			std::copy_n ( saved, INLINE_WORDS, inline_ );
+			capacity_ = INLINE_WORDS;
+			return;
+		}
+		auto* const words = traits::allocate ( alloc_, capacity );
+		std::copy_n ( data (), size_, words );
+		if ( on_heap () ) { traits::deallocate ( alloc_, heap_, capacity_ ); }
+		heap_ = words;
+		capacity_ = capacity;
+	}
+
+	// takes `other`'s words, which must be releasable by this allocator
+	void steal( BitStorage& other ) noexcept
+	{
+		if ( other.on_heap () ) { heap_ = other.heap_; }
+		else { std::copy_n ( other.inline_, INLINE_WORDS, inline_ ); }
+		size_ = other.size_;
+		capacity_ = other.capacity_;
+		other.size_ = 0;
+		other.capacity_ = INLINE_WORDS;
+	}
+
+	void copy_words( BitStorage const& other )
+	{
+		size_ = 0;
+		reserve ( other.size_ );
+		std::copy_n ( other.data (), other.size_, data () );
+		size_ = other.size_;
+	}
+
+public:
+	using allocator_type = Allocator;
+
+	BitStorage() = default;
+
+	explicit BitStorage( Allocator const& alloc ) : alloc_ { alloc } {}
+
+	BitStorage( BitStorage const& other ) : alloc_ { traits::select_on_container_copy_construction ( other.alloc_ ) } { copy_words ( other ); }
+
+	BitStorage( BitStorage const& other, Allocator const& alloc ) : alloc_ { alloc } { copy_words ( other ); }
+
+	BitStorage( BitStorage&& other ) noexcept : alloc_ { std::move ( other.alloc_ ) } { steal ( other ); }
+
+	BitStorage( BitStorage&& other, Allocator const& alloc ) : alloc_ { alloc }
+	{
+		if ( alloc_ == other.alloc_ ) { steal ( other ); }
+		else { copy_words ( other ); }
+	}
+
+	auto operator=( BitStorage const& other ) -> BitStorage&
+	{
+		if ( this == &other ) { return *this; }
+		if constexpr ( traits::propagate_on_container_copy_assignment::value )
+		{
+			if ( alloc_ != other.alloc_ ) { release (); }
+			alloc_ = other.alloc_;
+		}
+		copy_words ( other );
+		return *this;
+	}
+
+	auto operator=( BitStorage&& other ) noexcept ( traits::propagate_on_container_move_assignment::value || traits::is_always_equal::value ) -> BitStorage&
+	{
+		if ( this == &other ) { return *this; }
+		if constexpr ( traits::propagate_on_container_move_assignment::value )
+		{
+			release ();
+			alloc_ = std::move ( other.alloc_ );
+			steal ( other );
+		}
+		else if ( alloc_ == other.alloc_ )
+		{
+			release ();
+			steal ( other );
+		}
+		else
+		{
+			copy_words ( other ); // the words cannot change hands between unequal allocators
+		}
+		return *this;
+	}
+
+	~BitStorage() { release (); }
+
+	// exchanges the words without allocating; as with `std::vector`, the allocators must be
+	// equal unless they propagate on swap
+	void swap( BitStorage& other ) noexcept
+	{
+		if constexpr ( traits::propagate_on_container_swap::value ) { std::swap ( alloc_, other.alloc_ ); }
+		if ( on_heap () && other.on_heap () ) { std::swap ( heap_, other.heap_ ); }
+		else if ( !on_heap () && !other.on_heap () ) { std::swap_ranges ( inline_, inline_ + INLINE_WORDS, other.inline_ ); }
+		else
+		{
+			// one buffer is inline: it is copied across and the heap pointer goes the other way
+			auto& heap = on_heap () ? *this : other;
+			auto& local = on_heap () ? other : *this;
+			auto* const words = heap.heap_;
+			std::copy_n ( local.inline_, INLINE_WORDS, heap.inline_ );
+			local.heap_ = words;
+		}
+		std::swap ( size_, other.size_ );
+		std::swap ( capacity_, other.capacity_ );
+	}
+
+	Allocator get_allocator() const { return alloc_; }
+
+	IType* data() { return on_heap () ? heap_ : inline_; }
+	IType const* data() const { return on_heap () ? heap_ : inline_; }
+
+	size_t size() const { return size_; }
+	size_t capacity() const { return capacity_; }
+
+	IType& operator[]( size_t const i ) { return data ()[i]; }
+	IType const& operator[]( size_t const i ) const { return data ()[i]; }
+
+	IType const& at( size_t const i ) const
+	{
+		if ( i >= size_ ) { throw std::out_of_range ( "word index out of range" ); }
+		return data ()[i];
+	}
+
+	IType* begin() { return data (); }
+	IType* end() { return data () + size_; }
+	IType const* begin() const { return data (); }
+	IType const* end() const { return data () + size_; }
+
+	void reserve( size_t const capacity )
+	{
+		if ( capacity > capacity_ ) { reallocate ( capacity ); }
+	}
+
+	void resize( size_t const size )
+	{
+		reserve ( size );
+		if ( size > size_ ) { std::fill ( data () + size_, data () + size, IType ( 0 ) ); }
+		size_ = size;
+	}
+
+	void assign( size_t const size, IType const word )
+	{
+		reserve ( size ); // first, so a failed allocation leaves the words as they were
+		std::fill_n ( data (), size, word );
+		size_ = size;
+	}
+
+	void shrink_to_fit()
+	{
+		if ( on_heap () && size_ < capacity_ ) { reallocate ( size_ ); }
+	}
+};
+
+// An allocator whose blocks start on a cache line (64 bytes), for storage that is read a
+// line at a time, such as the blocks of a BloomFilter
+template <class T>
+struct cache_line_allocator
+{
+	using value_type = T;
+	static constexpr std::size_t ALIGNMENT = 64;
+
+	cache_line_allocator() = default;
+	template <class U>
+	cache_line_allocator( cache_line_allocator<U> const& ) noexcept {}
+
+	T* allocate( std::size_t const n ) { return static_cast<T*> ( ::operator new ( n * sizeof ( T ), std::align_val_t { ALIGNMENT } ) ); }
+	void deallocate( T* const p, std::size_t ) noexcept { ::operator delete ( p, std::align_val_t { ALIGNMENT } ); }
+
+	friend bool operator==( cache_line_allocator const&, cache_line_allocator const& ) { return true; }
+};
+#endif // BIT_STORAGE_H
@@ -0,0 +1,288 @@
+// bitstream.h: variable-length codes packed into a BitArray
+#ifndef BIT_STREAM_H
+#define BIT_STREAM_H
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include "bitarray.h"
+
+// Variable-length codes packed into a BitArray. Values go in and come out low bit first, so
+// a value written at position p has its bit j at index p + j. Both ends move whole 64-bit
+// chunks (see `BitArray::read_chunk`) through a register, so a field costs a few shifts
+// whatever the word type.
+//    BitArray<> packed;
+//    BitWriter out { packed };
+//    for ( auto v : values ) { out.write_gamma ( v ); }
+//    out.flush ();
+//    BitReader in { packed };
+//    while ( !in.at_end () ) { use ( in.read_gamma () ); }
+//
+// The codes, for an LSB-first stream:
+//   unary n      n zeros, then a one
+//   gamma x      (x > 0) unary L for L = floor(log2 x), then the L bits of x below its top bit;
+//                the same 2L + 1 bits as an Elias gamma code
+//   rice x, k    unary ( x >> k ), then the low k bits of x: a Golomb code with divisor 2^k
+namespace bitstream {
+	// the low `n` bits, for `n` from 0 to 64
+	constexpr std::uint64_t low_bits( std::uint64_t const value, unsigned const n )
+	{
+		return n ? value & ~std::uint64_t ( 0 ) >> ( 64 - n ) : 0;
+	}
+}
+
+// Appends to the end of an array. Whole chunks are stored as they fill; the partial chunk
+// stays in the register until `flush`. The destructor flushes too, but like a file stream it
+// cannot report a failure, so call `flush` to learn that the last bits could not be stored.
+// The array must not be changed by other means while the writer is in use.
+template <class Array>
+class BitWriter final
+{
+	Array* bits_;
+	size_t chunk_;          // the chunk the register is filling
+	unsigned fill_;         // bits in the register
+	std::uint64_t buffer_;  // the bits of chunk `chunk_`, low bit first, zero above `fill_`
+
+	// stores the full register and moves on to the next chunk
+	void store( std::uint64_t const carry, unsigned const fill )
+	{
+		auto& b = *bits_;
+		auto const end = ( chunk_ + 1 ) * 64;
+		if ( b.bits_.size () < b.words_needed ( end ) )
+		{
+			// the spare words are zero, so room can be made well ahead of `nbits_`
+			b.grow ( std::max ( end, 2 * b.bits_.size () * Array::BITS_PER_WORD ) );
+		}
+		b.set_chunk ( chunk_, buffer_ );
+		b.nbits_ = end;
+		b.drop_rank ();
+		++chunk_;
+		buffer_ = carry;
+		fill_ = fill;
+	}
+
+public:
+	explicit BitWriter( Array& bits ) :
+		bits_ { &bits }, chunk_ { bits.nbits_ / 64 }, fill_ { unsigned ( bits.nbits_ % 64 ) },
+		buffer_ { fill_ ? bits.read_chunk ( chunk_ ) : 0 }
+	{
+	}
+
+	BitWriter( BitWriter const& ) = delete;
+	BitWriter& operator=( BitWriter const& ) = delete;
+
+	~BitWriter()
+	{
+		try { flush (); }
+		catch ( ... ) {} // the array keeps the chunks stored so far
+	}
+
+	// the size the array will have after `flush`
+	size_t size() const { return chunk_ * 64 + fill_; }
+
+	// appends the low `n` bits of `value`, for `n` up to 64
+	void write( std::uint64_t const value, unsigned const n )
+	{
+		if ( n > 64 ) { throw std::out_of_range ( "write: more than 64 bits" ); }
+		auto const v = bitstream::low_bits ( value, n );
+		buffer_ |= v << fill_;
+		auto const fill = fill_ + n;
+		if ( fill < 64 ) { fill_ = fill; }
+		else
+		{
+			// the bits that did not fit start the next chunk
+			store ( fill_ ? v >> ( 64 - fill_ ) : 0, fill - 64 );
+		}
+	}
+
+	void write_bit( bool const bit ) { write ( bit, 1 ); }
+
+	void write_zeros( size_t n )
+	{
+		for ( ; n > 64; n -= 64 ) { write ( 0, 64 ); }
+		write ( 0, unsigned ( n ) );
+	}
+
+	void write_unary( size_t const n )
+	{
+		if ( n < 64 ) { write ( std::uint64_t ( 1 ) << n, unsigned ( n + 1 ) ); }
+		else
+		{
+			write_zeros ( n );
+			write ( 1, 1 );
+		}
+	}
+
+	void write_gamma( std::uint64_t const x )
+	{
+		if ( x == 0 ) { throw std::out_of_range ( "write_gamma: zero has no gamma code" ); }
+		auto const length = unsigned ( std::bit_width ( x ) - 1 );
+		if ( length < 32 )
+		{
+			// the zeros, the one and the low bits make one field of 2L + 1 bits
+			write ( ( ( x << 1 ) | 1 ) << length, 2 * length + 1 );
+		}
+		else
+		{
+			write_unary ( length );
+			write ( x, length );
+		}
+	}
+
+	void write_rice( std::uint64_t const x, unsigned const k )
+	{
+		write_unary ( k < 64 ? x >> k : 0 );
+		write ( x, k );
+	}
+
+	// makes every bit written so far part of the array
+	void flush()
+	{
+		if ( fill_ == 0 ) { return; }
+		auto& b = *bits_;
+		b.grow ( ( chunk_ + 1 ) * 64 ); // `set_chunk` writes every word of the chunk
+		b.set_chunk ( chunk_, buffer_ );
+		b.nbits_ = size ();
+		b.drop_rank ();
+	}
+};
+
+// Reads from a position in an array. The register holds the next bits and the chunk after
+// them, so a field of up to 64 bits is at most two shifts and one load. Reading past the end
+// throws `out_of_range`. The array must not change while the reader is in use.
+template <class Array>
+class BitReader final
+{
+	Array const* bits_;
+	size_t position_;       // the next bit to read
+	size_t next_chunk_;     // the chunk to load into `ahead_` when `buffer_` runs out
+	unsigned available_;    // bits left in `buffer_`
+	std::uint64_t buffer_;  // the bits from `position_` on, low bit first, zero above `available_`
+	std::uint64_t ahead_;   // chunk `next_chunk_ - 1`, whole
+
+	// chunk `k`, or zero past the end of the bits
+	std::uint64_t load( size_t const k ) const { return k * 64 < bits_->nbits_ ? bits_->read_chunk ( k ) : 0; }
+
+	// moves the chunk ahead into the register
+	void advance()
+	{
+		buffer_ = ahead_;
+		available_ = 64;
+		ahead_ = load ( next_chunk_++ );
+	}
+
+	// drops `n` bits, at least one and at most `available_`, from the register
+	void consume( unsigned const n )
+	{
+		buffer_ = n < 64 ? buffer_ >> n : 0;
+		available_ -= n;
+		position_ += n;
+	}
+
+	void require( size_t const n ) const
+	{
+		if ( n > bits_->nbits_ - position_ ) { throw std::out_of_range ( "read: past the end of the bits" ); }
+	}
+
+public:
+	explicit BitReader( Array const& bits, size_t const position = 0 ) : bits_ { &bits }
+	{
+		seek ( position );
+	}
+
+	size_t position() const { return position_; }
+	size_t remaining() const { return bits_->nbits_ - position_; }
+	bool at_end() const { return position_ == bits_->nbits_; }
+
+	void seek( size_t const position )
+	{
+		if ( position > bits_->nbits_ ) { throw std::out_of_range ( "seek: position out of bounds" ); }
+		position_ = position;
+		auto const k = position / 64;
+		auto const offset = unsigned ( position % 64 );
+		buffer_ = load ( k ) >> offset;
+		available_ = 64 - offset;
+		ahead_ = load ( k + 1 );
+		next_chunk_ = k + 2;
+	}
+
+	// the next `n` bits, for `n` up to 64, low bit first
+	std::uint64_t read( unsigned const n )
+	{
+		if ( n > 64 ) { throw std::out_of_range ( "read: more than 64 bits" ); }
+		require ( n );
+		position_ += n;
+		if ( n < available_ )
+		{
+			auto const v = bitstream::low_bits ( buffer_, n );
+			buffer_ >>= n;
+			available_ -= n;
+			return v;
+		}
+		// the field ends in the chunk ahead: take its low bits and keep the rest
+		auto const taken = n - available_;
+		auto const v = bitstream::low_bits ( buffer_ | ( available_ < 64 ? ahead_ << available_ : 0 ), n );
+		advance ();
+		buffer_ = taken < 64 ? buffer_ >> taken : 0;
+		available_ -= taken;
+		return v;
+	}
+
+	bool read_bit() { return read ( 1 ) != 0; }
+
+	// the zeros before the next one, which is consumed too
+	size_t read_unary()
+	{
+		// the bits above `available_` are zero, so the run goes on until the register holds a one
+		auto const start = position_;
+		size_t zeros {};
+		while ( !buffer_ )
+		{
+			zeros += available_;
+			if ( zeros >= remaining () )
+			{
+				seek ( start );
+				throw std::out_of_range ( "read_unary: past the end of the bits" );
+			}
+			advance ();
+		}
+		auto const run = unsigned ( std::countr_zero ( buffer_ ) );
+		zeros += run;
+		if ( zeros >= remaining () )
+		{
+			seek ( start );
+			throw std::out_of_range ( "read_unary: past the end of the bits" );
+		}
+		consume ( run + 1 );
+		position_ += zeros - run;
+		return zeros;
+	}
+
+	std::uint64_t read_gamma()
+	{
+		// a short code is usually all in the register: L zeros, a one and L bits
+		if ( buffer_ )
+		{
+			auto const length = unsigned ( std::countr_zero ( buffer_ ) );
+			auto const bits = 2 * length + 1;
+			if ( bits <= available_ && bits <= remaining () )
+			{
+				auto const value = std::uint64_t ( 1 ) << length | bitstream::low_bits ( buffer_ >> ( length + 1 ), length );
+				consume ( bits );
+				return value;
+			}
+		}
+		auto const length = read_unary ();
+		if ( length > 63 ) { throw std::runtime_error ( "read_gamma: code longer than 64 bits" ); }
+		return std::uint64_t ( 1 ) << length | read ( unsigned ( length ) );
+	}
+
+	std::uint64_t read_rice( unsigned const k )
+	{
+		auto const high = read_unary ();
+		auto const low = read ( k );
+		return k < 64 ? std::uint64_t ( high ) << k | low : low;
+	}
+};
+#endif // BIT_STREAM_H
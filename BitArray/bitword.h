@@ -0,0 +1,265 @@
+// bitword.h: the word types a BitArray can be built on
+#ifndef BIT_WORD_H
+#define BIT_WORD_H
+#include <bit>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+
+// The word types a BitArray can be built on: any unsigned integer, or a `BitBlock` of 128 or
+// 256 bits, the width of an SSE or AVX register. A block behaves like a wide unsigned integer
+// (the bitwise ops, shifts, `+` and `-`, comparison with zero), so the array code is the same
+// for every width; the byte kernels see its lanes as plain memory. Lane 0 holds bits 0-63, so
+// on a little endian host every width lays bit `i` out at bit `i % 8` of byte `i / 8`, and
+// arrays of different widths convert with a copy of the bytes.
+//    BitArray<BitBlock<256>> wide { 1 << 20 };
+//    BitArray<uint8_t> narrow { wide };   // the same bits, in byte words
+template <size_t Bits>
+class BitBlock
+{
+	static_assert ( Bits % 64 == 0 && Bits >= 128, "a BitBlock is a whole number of 64-bit lanes, at least two" );
+
+public:
+	static constexpr size_t LANES = Bits / 64;
+
+private:
+	std::uint64_t lanes_[LANES]; // left uninitialized, so `BitBlock {}` is zero and the type is trivial
+
+	// the block shifted away from bit 0 by `n` bits; lane i takes lanes i - q and i - q - 1
+	constexpr BitBlock shifted_up( size_t const n ) const
+	{
+		BitBlock r {};
+		if ( n >= Bits ) { return r; }
+		auto const q = n / 64;
+		auto const s = unsigned ( n % 64 );
+		if ( s == 0 )
+		{
+			for ( auto i { q }; i < LANES; ++i ) { r.lanes_[i] = lanes_[i - q]; }
+			return r;
+		}
+		r.lanes_[q] = lanes_[0] << s;
+		for ( auto i { q + 1 }; i < LANES; ++i ) { r.lanes_[i] = lanes_[i - q] << s | lanes_[i - q - 1] >> ( 64 - s ); }
+		return r;
+	}
+
+	// the block shifted toward bit 0 by `n` bits; lane i takes lanes i + q and i + q + 1
+	constexpr BitBlock shifted_down( size_t const n ) const
+	{
+		BitBlock r {};
+		if ( n >= Bits ) { return r; }
+		auto const q = n / 64;
+		auto const s = unsigned ( n % 64 );
+		if ( s == 0 )
+		{
+			for ( size_t i {}; i + q < LANES; ++i ) { r.lanes_[i] = lanes_[i + q]; }
+			return r;
+		}
+		for ( size_t i {}; i + q + 1 < LANES; ++i ) { r.lanes_[i] = lanes_[i + q] >> s | lanes_[i + q + 1] << ( 64 - s ); }
+		r.lanes_[LANES - 1 - q] = lanes_[LANES - 1] >> s;
+		return r;
+	}
+
+public:
+	BitBlock() = default;
+
+	// converts as an integer would: the value goes in the low lane, sign extended
+	template <std::integral T>
+	constexpr BitBlock( T const value ) : lanes_ {}
+	{
+		lanes_[0] = std::uint64_t ( value );
+		if constexpr ( std::signed_integral<T> )
+		{
+			for ( size_t i { 1 }; i < LANES; ++i ) { lanes_[i] = value < 0 ? ~std::uint64_t ( 0 ) : 0; }
+		}
+	}
+
+	// bits [64 * i, 64 * i + 64)
+	constexpr std::uint64_t lane( size_t const i ) const { return lanes_[i]; }
+
+	// truncates to the low bits, as an integer conversion would
+	template <std::integral T>
+	explicit constexpr operator T() const { return T ( lanes_[0] ); }
+
+	explicit constexpr operator bool() const
+	{
+		std::uint64_t any {};
+		for ( auto const lane : lanes_ ) { any |= lane; }
+		return any != 0;
+	}
+
+	constexpr bool operator!() const { return !bool ( *this ); }
+
+	constexpr BitBlock operator~() const
+	{
+		BitBlock r;
+		for ( size_t i {}; i < LANES; ++i ) { r.lanes_[i] = ~lanes_[i]; }
+		return r;
+	}
+
+	constexpr BitBlock& operator&=( BitBlock const& b )
+	{
+		for ( size_t i {}; i < LANES; ++i ) { lanes_[i] &= b.lanes_[i]; }
+		return *this;
+	}
+	constexpr BitBlock& operator|=( BitBlock const& b )
+	{
+		for ( size_t i {}; i < LANES; ++i ) { lanes_[i] |= b.lanes_[i]; }
+		return *this;
+	}
+	constexpr BitBlock& operator^=( BitBlock const& b )
+	{
+		for ( size_t i {}; i < LANES; ++i ) { lanes_[i] ^= b.lanes_[i]; }
+		return *this;
+	}
+	friend constexpr BitBlock operator&( BitBlock a, BitBlock const& b ) { return a &= b; }
+	friend constexpr BitBlock operator|( BitBlock a, BitBlock const& b ) { return a |= b; }
+	friend constexpr BitBlock operator^( BitBlock a, BitBlock const& b ) { return a ^= b; }
+
+	// shifts by `Bits` or more give zero rather than being undefined
+	template <std::integral T>
+	friend constexpr BitBlock operator<<( BitBlock const& a, T const n ) { return a.shifted_up ( size_t ( n ) ); }
+	template <std::integral T>
+	friend constexpr BitBlock operator>>( BitBlock const& a, T const n ) { return a.shifted_down ( size_t ( n ) ); }
+	template <std::integral T>
+	constexpr BitBlock& operator<<=( T const n ) { return *this = shifted_up ( size_t ( n ) ); }
+	template <std::integral T>
+	constexpr BitBlock& operator>>=( T const n ) { return *this = shifted_down ( size_t ( n ) ); }
+
+	// arithmetic modulo 2^Bits, for masks such as `( BitBlock ( 1 ) << n ) - 1`
+	friend constexpr BitBlock operator+( BitBlock const& a, BitBlock const& b )
+	{
+		BitBlock r;
+		std::uint64_t carry {};
+		for ( size_t i {}; i < LANES; ++i )
+		{
+			auto const sum = a.lanes_[i] + b.lanes_[i];
+			r.lanes_[i] = sum + carry;
+			carry = ( sum < a.lanes_[i] ) | ( r.lanes_[i] < sum );
+		}
+		return r;
+	}
+	friend constexpr BitBlock operator-( BitBlock const& a, BitBlock const& b )
+	{
+		BitBlock r;
+		std::uint64_t borrow {};
+		for ( size_t i {}; i < LANES; ++i )
+		{
+			auto const difference = a.lanes_[i] - b.lanes_[i];
+			r.lanes_[i] = difference - borrow;
+			borrow = ( a.lanes_[i] < b.lanes_[i] ) | ( difference < borrow );
+		}
+		return r;
+	}
+
+	friend constexpr bool operator==( BitBlock const& a, BitBlock const& b )
+	{
+		std::uint64_t diff {};
+		for ( size_t i {}; i < LANES; ++i ) { diff |= a.lanes_[i] ^ b.lanes_[i]; }
+		return diff == 0;
+	}
+
+	constexpr int popcount() const
+	{
+		int ones {};
+		for ( auto const lane : lanes_ ) { ones += std::popcount ( lane ); }
+		return ones;
+	}
+
+	constexpr int countr_zero() const
+	{
+		for ( size_t i {}; i < LANES; ++i )
+		{
+			if ( lanes_[i] ) { return int ( 64 * i ) + std::countr_zero ( lanes_[i] ); }
+		}
+		return int ( Bits );
+	}
+
+	constexpr int countl_zero() const
+	{
+		for ( auto i { LANES }; i-- > 0; )
+		{
+			if ( lanes_[i] ) { return int ( 64 * ( LANES - 1 - i ) ) + std::countl_zero ( lanes_[i] ); }
+		}
+		return int ( Bits );
+	}
+};
+
+// The bit counts of `<bit>` for every word type, so the array code need not tell an integer
+// from a block
+namespace bitword
+{
+	template <class W>
+	constexpr int popcount( W const w )
+	{
+		if constexpr ( std::unsigned_integral<W> ) { return std::popcount ( w ); }
+		else { return w.popcount (); }
+	}
+
+	template <class W>
+	constexpr int countr_zero( W const w )
+	{
+		if constexpr ( std::unsigned_integral<W> ) { return std::countr_zero ( w ); }
+		else { return w.countr_zero (); }
+	}
+
+	template <class W>
+	constexpr int countl_zero( W const w )
+	{
+		if constexpr ( std::unsigned_integral<W> ) { return std::countl_zero ( w ); }
+		else { return w.countl_zero (); }
+	}
+
+	// The word loops of the shifts. `shift` is 1 to the word width less one; `out` may be
+	// `in` or lie before it (down) or after it (up), as when an array is shifted in place.
+	// The run of blocks is shifted as a run of lanes, which costs what the 64-bit words do.
+
+	// out[i] = in[i] >> shift | in[i + 1] << ( width - shift ), for n > 0 words with in[n] = next
+	template <class W>
+	void shift_run_down( W* const out, W const* const in, W const next, size_t const n, unsigned const shift )
+	{
+		constexpr unsigned width = sizeof ( W ) * 8;
+		for ( size_t i {}; i + 1 < n; ++i ) { out[i] = W ( in[i] >> shift | in[i + 1] << ( width - shift ) ); }
+		out[n - 1] = W ( in[n - 1] >> shift | next << ( width - shift ) );
+	}
+
+	template <size_t Bits>
+	void shift_run_down( BitBlock<Bits>* const out, BitBlock<Bits> const* const in, BitBlock<Bits> const next, size_t const n, unsigned const shift )
+	{
+		constexpr auto lanes = BitBlock<Bits>::LANES;
+		auto* const lo = reinterpret_cast<std::uint64_t*> ( out );
+		auto const* const li = reinterpret_cast<std::uint64_t const*> ( in );
+		auto const q = shift / 64, s = shift % 64;
+		auto const total = n * lanes;
+		// lane j of the run, the lanes of `next` following those of `in`
+		auto const lane = [&]( size_t const j ) { return j < total ? li[j] : next.lane ( j - total ); };
+		size_t i {};
+		if ( s == 0 ) { for ( ; i + q < total; ++i ) { lo[i] = li[i + q]; } }
+		else { for ( ; i + q + 1 < total; ++i ) { lo[i] = li[i + q] >> s | li[i + q + 1] << ( 64 - s ); } }
+		for ( ; i < total; ++i ) { lo[i] = s ? lane ( i + q ) >> s | lane ( i + q + 1 ) << ( 64 - s ) : lane ( i + q ); }
+	}
+
+	// out[i] = in[i] << shift | in[i - 1] >> ( width - shift ), for n > 0 words with in[-1] = previous
+	template <class W>
+	void shift_run_up( W* const out, W const* const in, W const previous, size_t const n, unsigned const shift )
+	{
+		constexpr unsigned width = sizeof ( W ) * 8;
+		for ( auto i { n - 1 }; i > 0; --i ) { out[i] = W ( in[i] << shift | in[i - 1] >> ( width - shift ) ); }
+		out[0] = W ( in[0] << shift | previous >> ( width - shift ) );
+	}
+
+	template <size_t Bits>
+	void shift_run_up( BitBlock<Bits>* const out, BitBlock<Bits> const* const in, BitBlock<Bits> const previous, size_t const n, unsigned const shift )
+	{
+		constexpr auto lanes = BitBlock<Bits>::LANES;
+		auto* const lo = reinterpret_cast<std::uint64_t*> ( out );
+		auto const* const li = reinterpret_cast<std::uint64_t const*> ( in );
+		auto const q = shift / 64, s = shift % 64;
+		// lane j of the run, counted from the lanes of `previous` before those of `in`
+		auto const lane = [&]( size_t const j ) { return j >= lanes ? li[j - lanes] : previous.lane ( j ); };
+		auto i { n * lanes };
+		if ( s == 0 ) { for ( ; i-- > q; ) { lo[i] = li[i - q]; } }
+		else { for ( ; i-- > q + 1; ) { lo[i] = li[i - q] << s | li[i - q - 1] >> ( 64 - s ); } }
+		for ( ++i; i-- > 0; ) { lo[i] = s ? lane ( i + lanes - q ) << s | lane ( i + lanes - q - 1 ) >> ( 64 - s ) : lane ( i + lanes - q ); }
+	}
+}
+#endif // BIT_WORD_H
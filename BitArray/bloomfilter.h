@@ -0,0 +1,387 @@
+// bloomfilter.h: Bloom filters stored in a BitArray
+#ifndef BLOOM_FILTER_H
+#define BLOOM_FILTER_H
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <istream>
+#include <ostream>
+#include <ranges>
+#include <stdexcept>
+#include <utility>
+#include "bitarray.h"
+#include "bitkernels.h"
+#include "bitstorage.h"
+
+// Membership filters stored in a BitArray. Both are blocked: the table is split into 64-byte
+// blocks that start on cache lines, and every probe for a key lands in the one block its hash
+// picks, so a lookup reads a single cache line (at the price of a slightly higher false
+// positive rate than an unblocked filter of the same size).
+//    BloomFilter          1 bit per probe position; keys can be added but not removed.
+//                         `merge` (or `|=`) takes the union of two filters with word ORs.
+//    CountingBloomFilter  a 4-bit counter per probe position, so keys can be removed too;
+//                         a counter that reaches 15 stays there.
+// `insert_many` and `contains_many` hash a batch of keys and prefetch their blocks before
+// touching any of them, so the cache misses of a large filter overlap.
+// Keys are hashed with `Hash` and then remixed, so `std::hash` is fine even where it is the
+// identity. The binary images hold the BitArray image of the table after a short header; they
+// can only be read back by a program that hashes keys the same way.
+namespace bloom
+{
+	// the splitmix64 finalizer: every input bit affects every output bit
+	inline std::uint64_t mix( std::uint64_t x )
+	{
+		x = ( x ^ ( x >> 30 ) ) * 0xBF58476D1CE4E5B9ull;
+		x = ( x ^ ( x >> 27 ) ) * 0x94D049BB133111EBull;
+		return x ^ ( x >> 31 );
+	}
+
+	// The part shared by the two filters: a table of 64-byte blocks, the hashing of keys to a
+	// block and to positions inside it, the batching, and the image header.
+	//   0  "BITBLOOM" or "BITCOUNT"
+	//   8  number of hashes (uint32)
+	//  12  reserved, zero (uint32)
+	//  16  seed (uint64)
+	// followed by the image of the table written by `BitArray::write_binary`.
+	template <class Key, class Hash>
+	class blocked_filter
+	{
+	public:
+		using table_type = BitArray<std::uint64_t, cache_line_allocator<std::uint64_t>>;
+		static constexpr size_t BLOCK_WORDS = 8;
+		static constexpr size_t BLOCK_BITS = BLOCK_WORDS * 64;
+		static constexpr unsigned MAX_HASHES = 16;
+
+	protected:
+		static constexpr size_t BATCH = 16; // how far the prefetches run ahead of the probes
+		static constexpr size_t HEADER_SIZE = 24;
+
+		table_type table_ {};
+		size_t nblocks_ {};
+		unsigned nhashes_ {};
+		std::uint64_t seed_ {};
+		[[no_unique_address]] Hash hash_ {};
+
+		blocked_filter() = default;
+
+		blocked_filter( size_t const nbits, unsigned const nhashes, std::uint64_t const seed )
+			: nblocks_ { std::max<size_t> ( 1, ( nbits + BLOCK_BITS - 1 ) / BLOCK_BITS ) }, nhashes_ { nhashes }, seed_ { seed }
+		{
+			if ( nhashes_ == 0 || nhashes_ > MAX_HASHES ) { throw std::invalid_argument ( "bloom filter: the number of hashes must be 1 to 16" ); }
+			if ( nblocks_ > size_t ( 1 ) << 32 ) { throw std::length_error ( "bloom filter: more than 2^32 blocks" ); }
+			table_ = table_type ( nblocks_ * BLOCK_BITS );
+		}
+
+		std::uint64_t hash_of( Key const& key ) const { return mix ( std::uint64_t ( hash_ ( key ) ) ^ seed_ ); }
+
+		// the high half of the hash picks the block, without a division
+		std::uint64_t* block_of( std::uint64_t const h ) { return table_.bits_.data () + ( ( h >> 32 ) * nblocks_ >> 32 ) * BLOCK_WORDS; }
+		std::uint64_t const* block_of( std::uint64_t const h ) const { return table_.bits_.data () + ( ( h >> 32 ) * nblocks_ >> 32 ) * BLOCK_WORDS; }
+
+		// the low half gives the probe positions by double hashing; each is the top bits of a
+		// 32-bit value: 3 bits for the word of the block, then `slot_bits` for the slot in it.
+		// `K` is the number of hashes when it is known at compile time, so the loop unrolls.
+		template <unsigned slot_bits, unsigned K = 0, class Visit>
+		void for_each_probe( std::uint64_t const h, Visit&& visit ) const
+		{
+			auto x = std::uint32_t ( h );
+			auto const step = std::uint32_t ( ( h * 0x9E3779B97F4A7C15ull ) >> 32 ) | 1u;
+			auto const nprobes = K ? K : nhashes_;
+			for ( unsigned i {}; i < nprobes; ++i, x += step )
+			{
+				visit ( size_t ( x >> 29 ), unsigned ( x >> ( 29 - slot_bits ) ) & ( ( 1u << slot_bits ) - 1 ) );
+			}
+		}
+
+		// calls `f ( std::integral_constant<unsigned, K> {} )` with `K` the number of hashes
+		template <class F>
+		void with_hash_count( F&& f ) const
+		{
+			[&]<unsigned... I>( std::integer_sequence<unsigned, I...> )
+			{
+				static_cast<void> ( ( ( nhashes_ == I + 1 && ( f ( std::integral_constant<unsigned, I + 1> {} ), true ) ) || ... ) );
+			} ( std::make_integer_sequence<unsigned, MAX_HASHES> {} );
+		}
+
+		// hashes each key and prefetches its block `BATCH` keys ahead of calling `visit ( h )` for
+		// it, so that many cache misses are in flight at once; the keys are visited in order
+		template <class Keys, class Visit>
+		void for_each_batch( Keys const& keys, bool const for_write, Visit&& visit ) const
+		{
+			std::uint64_t pending[BATCH];
+			size_t n {};
+			for ( auto const& key : keys )
+			{
+				auto const h = hash_of ( key );
+				bitkernels::prefetch ( block_of ( h ), for_write );
+				if ( n >= BATCH ) { visit ( pending[n % BATCH] ); }
+				pending[n++ % BATCH] = h;
+			}
+			for ( auto i { n > BATCH ? n - BATCH : 0 }; i < n; ++i ) { visit ( pending[i % BATCH] ); }
+		}
+
+		bool same_shape( blocked_filter const& other ) const
+		{
+			return nblocks_ == other.nblocks_ && nhashes_ == other.nhashes_ && seed_ == other.seed_;
+		}
+
+		void write_image( std::ostream& os, char const* magic ) const
+		{
+			unsigned char header[HEADER_SIZE] {};
+			std::memcpy ( header, magic, 8 );
+			for ( size_t i {}; i < 4; ++i ) { header[8 + i] = static_cast<unsigned char> ( nhashes_ >> ( 8 * i ) ); }
+			for ( size_t i {}; i < 8; ++i ) { header[16 + i] = static_cast<unsigned char> ( seed_ >> ( 8 * i ) ); }
+			os.write ( reinterpret_cast<char const*> ( header ), sizeof header );
+			table_.write_binary ( os );
+		}
+
+		// throws `runtime_error` unless `is` holds an image of this kind of filter
+		void read_image( std::istream& is, char const* magic )
+		{
+			unsigned char header[HEADER_SIZE];
+			if ( !is.read ( reinterpret_cast<char*> ( header ), sizeof header ) ) { throw std::runtime_error ( "truncated bloom filter header" ); }
+			if ( std::memcmp ( header, magic, 8 ) != 0 ) { throw std::runtime_error ( "not a bloom filter image of this kind" ); }
+			nhashes_ = 0;
+			seed_ = 0;
+			for ( size_t i {}; i < 4; ++i ) { nhashes_ |= unsigned ( header[8 + i] ) << ( 8 * i ); }
+			for ( size_t i {}; i < 8; ++i ) { seed_ |= std::uint64_t ( header[16 + i] ) << ( 8 * i ); }
+			table_ = table_type::read_binary ( is );
+			nblocks_ = table_.size () / BLOCK_BITS;
+			if ( nhashes_ == 0 || nhashes_ > MAX_HASHES || nblocks_ == 0 || table_.size () % BLOCK_BITS )
+			{
+				throw std::runtime_error ( "corrupt bloom filter header" );
+			}
+		}
+
+	public:
+		size_t bit_count() const { return table_.size (); } // the size of the table in bits
+		unsigned hash_count() const { return nhashes_; }
+		std::uint64_t seed() const { return seed_; }
+		table_type const& table() const { return table_; } // the blocks, e.g. for `count ()`
+
+		void clear() { table_.fill ( false ); }
+	};
+
+	// the table size and number of hashes an unblocked filter needs for `items` keys at `rate`
+	inline std::pair<size_t, unsigned> optimal_shape( size_t const items, double const rate )
+	{
+		if ( !( rate > 0 && rate < 1 ) ) { throw std::invalid_argument ( "bloom filter: the false positive rate must be between 0 and 1" ); }
+		auto const ln2 = std::log ( 2.0 );
+		auto const n = double ( std::max<size_t> ( 1, items ) );
+		auto const nbits = std::ceil ( -n * std::log ( rate ) / ( ln2 * ln2 ) );
+		auto const nhashes = std::clamp ( unsigned ( std::lround ( nbits / n * ln2 ) ), 1u, 16u );
+		return { size_t ( nbits ), nhashes };
+	}
+}
+
+template <class Key, class Hash = std::hash<Key>>
+class BloomFilter : public bloom::blocked_filter<Key, Hash>
+{
+	using base = bloom::blocked_filter<Key, Hash>;
+	using base::nhashes_;
+	using base::table_;
+
+	// each probe sets or tests one bit of its block; there are no branches on the bits, so a
+	// lookup that fails early costs the same as one that succeeds
+	template <unsigned K>
+	void insert_hash( std::uint64_t const h )
+	{
+		auto* const block = this->block_of ( h );
+		this->template for_each_probe<6, K> ( h, [block]( size_t word, unsigned bit ) { block[word] |= std::uint64_t ( 1 ) << bit; } );
+	}
+
+	template <unsigned K>
+	bool contains_hash( std::uint64_t const h ) const
+	{
+		auto const* const block = this->block_of ( h );
+		std::uint64_t all { 1 };
+		this->template for_each_probe<6, K> ( h, [block, &all]( size_t word, unsigned bit ) { all &= block[word] >> bit; } );
+		return all & 1;
+	}
+
+public:
+	BloomFilter() = default; // an empty table, for `read_binary` to fill
+
+	// a table of at least `nbits` bits (rounded up to whole blocks) probed `nhashes` times per key
+	BloomFilter( size_t const nbits, unsigned const nhashes, std::uint64_t const seed = 0 ) : base ( nbits, nhashes, seed ) {}
+
+	// sized for `items` keys at about `false_positive_rate`
+	static BloomFilter for_items( size_t const items, double const false_positive_rate, std::uint64_t const seed = 0 )
+	{
+		auto const [nbits, nhashes] = bloom::optimal_shape ( items, false_positive_rate );
+		return { nbits, nhashes, seed };
+	}
+
+	void insert( Key const& key )
+	{
+		auto const h = this->hash_of ( key );
+		this->with_hash_count ( [&]( auto k ) { insert_hash<k> ( h ); } );
+	}
+
+	bool contains( Key const& key ) const
+	{
+		auto const h = this->hash_of ( key );
+		bool hit {};
+		this->with_hash_count ( [&]( auto k ) { hit = contains_hash<k> ( h ); } );
+		return hit;
+	}
+
+	template <std::ranges::input_range Keys>
+	void insert_many( Keys const& keys )
+	{
+		this->with_hash_count ( [&]( auto k )
+		{
+			this->for_each_batch ( keys, true, [this]( std::uint64_t h ) { insert_hash<decltype ( k )::value> ( h ); } );
+		} );
+	}
+
+	// the number of `keys` that may be present; with `found`, also writes each answer to it
+	template <std::ranges::input_range Keys>
+	size_t contains_many( Keys const& keys, bool* found = nullptr ) const
+	{
+		size_t hits {};
+		this->with_hash_count ( [&]( auto k )
+		{
+			this->for_each_batch ( keys, false, [&]( std::uint64_t h )
+			{
+				bool const hit = contains_hash<decltype ( k )::value> ( h );
+				hits += hit;
+				if ( found ) { *found++ = hit; }
+			} );
+		} );
+		return hits;
+	}
+
+	// Takes the union with `other`, which must have the same size, hash count and seed
+	// (`invalid_argument` otherwise)
+	BloomFilter& merge( BloomFilter const& other )
+	{
+		if ( !this->same_shape ( other ) ) { throw std::invalid_argument ( "bloom filter: merging filters of different shapes" ); }
+		table_ |= other.table_;
+		return *this;
+	}
+
+	BloomFilter& operator|=( BloomFilter const& other ) { return merge ( other ); }
+
+	double estimated_items() const // the number of distinct keys inserted, estimated from the bits set
+	{
+		auto const m = double ( table_.size () );
+		auto const ones = double ( table_.count () );
+		return ones >= m ? INFINITY : -m / nhashes_ * std::log1p ( -ones / m );
+	}
+
+	void write_binary( std::ostream& os ) const { this->write_image ( os, "BITBLOOM" ); }
+
+	// throws `runtime_error` if the image is truncated, corrupt or of another kind
+	static BloomFilter read_binary( std::istream& is )
+	{
+		BloomFilter filter;
+		filter.read_image ( is, "BITBLOOM" );
+		return filter;
+	}
+};
+
+template <class Key, class Hash = std::hash<Key>>
+class CountingBloomFilter : public bloom::blocked_filter<Key, Hash>
+{
+	using base = bloom::blocked_filter<Key, Hash>;
+	static constexpr unsigned COUNTER_MAX = 15;
+
+	// calls `visit ( word, shift )` for each of the 4-bit counters of `h`
+	template <class Visit>
+	void for_each_counter( std::uint64_t const h, Visit&& visit ) const
+	{
+		this->template for_each_probe<4> ( h, [&visit]( size_t word, unsigned slot ) { visit ( word, slot * 4 ); } );
+	}
+
+	void insert_hash( std::uint64_t const h )
+	{
+		auto* const block = this->block_of ( h );
+		for_each_counter ( h, [block]( size_t word, unsigned shift )
+		{
+			if ( ( block[word] >> shift & COUNTER_MAX ) != COUNTER_MAX ) { block[word] += std::uint64_t ( 1 ) << shift; }
+		} );
+	}
+
+	bool contains_hash( std::uint64_t const h ) const
+	{
+		auto const* const block = this->block_of ( h );
+		bool all { true };
+		for_each_counter ( h, [&]( size_t word, unsigned shift ) { all &= ( block[word] >> shift & COUNTER_MAX ) != 0; } );
+		return all;
+	}
+
+public:
+	CountingBloomFilter() = default;
+
+	// `nbits` of counters (rounded up to whole blocks), so `nbits / 4` of them
+	CountingBloomFilter( size_t const nbits, unsigned const nhashes, std::uint64_t const seed = 0 ) : base ( nbits, nhashes, seed ) {}
+
+	// sized for `items` keys at about `false_positive_rate`
+	static CountingBloomFilter for_items( size_t const items, double const false_positive_rate, std::uint64_t const seed = 0 )
+	{
+		auto const [positions, nhashes] = bloom::optimal_shape ( items, false_positive_rate );
+		return { 4 * positions, nhashes, seed };
+	}
+
+	void insert( Key const& key ) { insert_hash ( this->hash_of ( key ) ); }
+
+	template <std::ranges::input_range Keys>
+	void insert_many( Keys const& keys )
+	{
+		this->for_each_batch ( keys, true, [this]( std::uint64_t h ) { insert_hash ( h ); } );
+	}
+
+	// removes one insertion of `key`; false, with nothing changed, if `key` is not present
+	bool erase( Key const& key )
+	{
+		auto const h = this->hash_of ( key );
+		if ( !contains_hash ( h ) ) { return false; }
+		auto* const block = this->block_of ( h );
+		for_each_counter ( h, [block]( size_t word, unsigned shift )
+		{
+			// a saturated counter no longer knows its count, so it is left alone
+			auto const counter = block[word] >> shift & COUNTER_MAX;
+			if ( counter != COUNTER_MAX && counter != 0 ) { block[word] -= std::uint64_t ( 1 ) << shift; }
+		} );
+		return true;
+	}
+
+	bool contains( Key const& key ) const { return contains_hash ( this->hash_of ( key ) ); }
+
+	// at least the number of times `key` was inserted (less erased); exact unless the key shares
+	// every counter with others or a counter saturated
+	unsigned count( Key const& key ) const
+	{
+		auto const h = this->hash_of ( key );
+		auto const* const block = this->block_of ( h );
+		unsigned least { COUNTER_MAX };
+		for_each_counter ( h, [&]( size_t word, unsigned shift ) { least = std::min ( least, unsigned ( block[word] >> shift & COUNTER_MAX ) ); } );
+		return least;
+	}
+
+	template <std::ranges::input_range Keys>
+	size_t contains_many( Keys const& keys, bool* found = nullptr ) const
+	{
+		size_t hits {};
+		this->for_each_batch ( keys, false, [&]( std::uint64_t h )
+		{
+			bool const hit = contains_hash ( h );
+			hits += hit;
+			if ( found ) { *found++ = hit; }
+		} );
+		return hits;
+	}
+
+	void write_binary( std::ostream& os ) const { this->write_image ( os, "BITCOUNT" ); }
+
+	static CountingBloomFilter read_binary( std::istream& is )
+	{
+		CountingBloomFilter filter;
+		filter.read_image ( is, "BITCOUNT" );
+		return filter;
+	}
+};
+#endif // BLOOM_FILTER_H
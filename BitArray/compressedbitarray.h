@@ -0,0 +1,611 @@
+// compressedbitarray.h: a chunked, compressed BitArray for sparse data
+#ifndef COMPRESSED_BIT_ARRAY_H
+#define COMPRESSED_BIT_ARRAY_H
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <iterator>
+#include <stdexcept>
+#include <variant>
+#include <vector>
+#include "bitarray.h"
+
+// A BitArray for sparse data, stored Roaring style: the positions are split into chunks of
+// 65536 bits and only the chunks holding a 1-bit are stored, each in whichever container is
+// smallest for its contents:
+//   array  - the sorted low 16 bits of each 1-bit, for up to 4096 bits
+//   bitmap - 1024 64-bit words, for denser chunks
+//   run    - sorted [start, last] ranges, chosen by `optimize` when it beats both and kept
+//            by single-bit edits
+// Every operation keeps array and bitmap containers on the right side of the 4096 bit line.
+class CompressedBitArray
+{
+	static constexpr size_t CHUNK_BITS = 65536;
+	static constexpr size_t CHUNK_WORDS = CHUNK_BITS / 64;
+	static constexpr size_t ARRAY_MAX = 4096; // above this many bits a bitmap is smaller than an array
+
+	using Chunk = std::array<std::uint64_t, CHUNK_WORDS>; // a decoded container
+
+	struct ArrayContainer
+	{
+		std::vector<std::uint16_t> values;
+
+		size_t cardinality() const { return values.size (); }
+		bool contains( std::uint32_t low ) const { return std::binary_search ( values.begin (), values.end (), std::uint16_t ( low ) ); }
+		void decode( Chunk& words ) const { for ( auto const v : values ) { words[v >> 6] |= std::uint64_t ( 1 ) << ( v & 63 ); } }
+		size_t bytes() const { return values.capacity () * sizeof ( std::uint16_t ); }
+
+		std::uint32_t next( std::uint32_t low ) const // the first value >= low, or CHUNK_BITS
+		{
+			auto const it = std::lower_bound ( values.begin (), values.end (), low,
+				[]( std::uint16_t v, std::uint32_t x ) { return v < x; } );
+			return it == values.end () ? CHUNK_BITS : *it;
+		}
+	};
+
+	struct BitmapContainer
+	{
+		std::vector<std::uint64_t> words = std::vector<std::uint64_t> ( CHUNK_WORDS );
+		size_t ones {};
+
+		size_t cardinality() const { return ones; }
+		bool contains( std::uint32_t low ) const { return words[low >> 6] >> ( low & 63 ) & 1u; }
+		void decode( Chunk& out ) const { std::copy ( words.begin (), words.end (), out.begin () ); }
+		size_t bytes() const { return words.capacity () * sizeof ( std::uint64_t ); }
+
+		void set( std::uint32_t low, bool val ) // writes one bit in place, keeping `ones` current
+		{
+			auto& word = words[low >> 6];
+			auto const bit = std::uint64_t ( 1 ) << ( low & 63 );
+			if ( bool ( word & bit ) == val ) { return; }
+			word ^= bit;
+			ones = val ? ones + 1 : ones - 1;
+		}
+
+		std::uint32_t next( std::uint32_t low ) const
+		{
+			auto i = low >> 6;
+			auto word = words[i] & ~std::uint64_t ( 0 ) << ( low & 63 );
+			while ( !word )
+			{
+				if ( ++i == CHUNK_WORDS ) { return CHUNK_BITS; }
+				word = words[i];
+			}
+			return std::uint32_t ( i * 64 + std::countr_zero ( word ) );
+		}
+	};
+
+	struct Run
+	{
+		std::uint16_t start;
+		std::uint16_t last;
+	};
+
+	struct RunContainer
+	{
+		std::vector<Run> runs;
+
+		// orders runs against positions, so `lower_bound` finds the first run ending at or after one
+		static bool ends_before( Run const& run, std::uint32_t low ) { return run.last < low; }
+
+		size_t cardinality() const
+		{
+			size_t total {};
+			for ( auto const& run : runs ) { total += size_t ( run.last ) - run.start + 1; }
+			return total;
+		}
+
+		bool contains( std::uint32_t low ) const { return next ( low ) == low; }
+
+		void decode( Chunk& words ) const
+		{
+			for ( auto const& run : runs )
+			{
+				for ( std::uint32_t v { run.start }; v <= run.last; ++v ) { words[v >> 6] |= std::uint64_t ( 1 ) << ( v & 63 ); }
+			}
+		}
+
+		size_t bytes() const { return runs.capacity () * sizeof ( Run ); }
+
+		// writes one bit by extending, joining, shrinking or splitting the runs around it
+		void set( std::uint32_t low, bool val )
+		{
+			auto const it = std::lower_bound ( runs.begin (), runs.end (), low, ends_before );
+			auto const found = it != runs.end () && it->start <= low;
+			if ( val == found ) { return; }
+			if ( val )
+			{
+				auto const prev = it == runs.begin () ? runs.end () : it - 1;
+				auto const joins_prev = prev != runs.end () && prev->last + 1u == low;
+				auto const joins_next = it != runs.end () && it->start == low + 1;
+				if ( joins_prev && joins_next )
+				{
+					prev->last = it->last;
+					runs.erase ( it );
+				}
+				else if ( joins_prev ) { prev->last = std::uint16_t ( low ); }
+				else if ( joins_next ) { it->start = std::uint16_t ( low ); }
+				else { runs.insert ( it, { std::uint16_t ( low ), std::uint16_t ( low ) } ); }
+			}
+			else if ( it->start == it->last ) { runs.erase ( it ); }
+			else if ( it->start == low ) { ++it->start; }
+			else if ( it->last == low ) { --it->last; }
+			else
+			{
+				auto const last = it->last;
+				it->last = std::uint16_t ( low - 1 );
+				runs.insert ( it + 1, { std::uint16_t ( low + 1 ), last } );
+			}
+		}
+
+		std::uint32_t next( std::uint32_t low ) const
+		{
+			auto const it = std::lower_bound ( runs.begin (), runs.end (), low, ends_before );
+			if ( it == runs.end () ) { return CHUNK_BITS; }
+			return std::max<std::uint32_t> ( it->start, low );
+		}
+	};
+
+	using Container = std::variant<ArrayContainer, BitmapContainer, RunContainer>;
+
+	std::vector<size_t> keys_ {};         // chunk numbers in use, ascending
+	std::vector<Container> containers_ {}; // parallel to `keys_`, never empty
+	size_t nbits_ {};
+
+	// picks the array or bitmap form for a decoded chunk; false if the chunk is empty
+	static bool encode( Chunk const& words, Container& out )
+	{
+		auto const ones = bitkernels::popcount ( words.data (), sizeof words );
+		if ( ones == 0 ) { return false; }
+		if ( ones <= ARRAY_MAX )
+		{
+			ArrayContainer array;
+			array.values.reserve ( ones );
+			for ( size_t i {}; i < CHUNK_WORDS; ++i )
+			{
+				for ( auto word = words[i]; word; word &= word - 1 )
+				{
+					array.values.push_back ( std::uint16_t ( i * 64 + std::countr_zero ( word ) ) );
+				}
+			}
+			out = std::move ( array );
+		}
+		else
+		{
+			BitmapContainer bitmap;
+			std::copy ( words.begin (), words.end (), bitmap.words.begin () );
+			bitmap.ones = ones;
+			out = std::move ( bitmap );
+		}
+		return true;
+	}
+
+	static void decode( Container const& c, Chunk& words )
+	{
+		words.fill ( 0 );
+		std::visit ( [&words]( auto const& container ) { container.decode ( words ); }, c );
+	}
+
+	static size_t cardinality( Container const& c )
+	{
+		return std::visit ( []( auto const& container ) { return container.cardinality (); }, c );
+	}
+
+	static std::uint32_t next_in( Container const& c, std::uint32_t low )
+	{
+		return std::visit ( [low]( auto const& container ) { return container.next ( low ); }, c );
+	}
+
+	size_t check_index( size_t const& bitpos ) const
+	{
+		if ( bitpos >= nbits_ ) { throw std::out_of_range ( "bit position out of range" ); }
+		return bitpos;
+	}
+
+	// the index of the first chunk whose key is >= `key`
+	size_t chunk_index( size_t key ) const
+	{
+		return size_t ( std::lower_bound ( keys_.begin (), keys_.end (), key ) - keys_.begin () );
+	}
+
+	// the first 1-bit at or after `bitpos`, or npos
+	size_t find_from( size_t bitpos ) const
+	{
+		if ( bitpos >= nbits_ ) { return npos; }
+		auto const key = bitpos / CHUNK_BITS;
+		for ( auto i = chunk_index ( key ); i < keys_.size (); ++i )
+		{
+			auto const low = keys_[i] == key ? std::uint32_t ( bitpos % CHUNK_BITS ) : 0u;
+			auto const found = next_in ( containers_[i], low );
+			if ( found != CHUNK_BITS ) { return keys_[i] * CHUNK_BITS + found; }
+		}
+		return npos;
+	}
+
+	// appends a 1-bit past every bit already stored; used to build results in order
+	void push_back_one( size_t bitpos )
+	{
+		auto const key = bitpos / CHUNK_BITS;
+		auto const low = std::uint16_t ( bitpos % CHUNK_BITS );
+		if ( keys_.empty () || keys_.back () != key )
+		{
+			keys_.push_back ( key );
+			containers_.emplace_back ( ArrayContainer {} );
+		}
+
+		auto& last = containers_.back ();
+		if ( auto* array = std::get_if<ArrayContainer> ( &last ) )
+		{
+			if ( array->values.size () < ARRAY_MAX )
+			{
+				array->values.push_back ( low );
+				return;
+			}
+			// a full array becomes a bitmap before it grows past the array limit
+			BitmapContainer bitmap;
+			for ( auto const v : array->values ) { bitmap.words[v >> 6] |= std::uint64_t ( 1 ) << ( v & 63 ); }
+			bitmap.ones = array->values.size ();
+			last = std::move ( bitmap );
+		}
+		auto& bitmap = std::get<BitmapContainer> ( last );
+		bitmap.words[low >> 6] |= std::uint64_t ( 1 ) << ( low & 63 );
+		++bitmap.ones;
+	}
+
+	template <bitkernels::bitop Op>
+	CompressedBitArray& combine( CompressedBitArray const& b )
+	{
+		using bitkernels::bitop;
+		std::vector<size_t> keys;
+		std::vector<Container> containers;
+		keys.reserve ( keys_.size () + b.keys_.size () );
+		containers.reserve ( keys_.size () + b.keys_.size () );
+
+		Chunk left, right;
+		size_t i {}, j {};
+		while ( i < keys_.size () || j < b.keys_.size () )
+		{
+			auto const in_a = i < keys_.size () && ( j == b.keys_.size () || keys_[i] <= b.keys_[j] );
+			auto const in_b = j < b.keys_.size () && ( i == keys_.size () || b.keys_[j] <= keys_[i] );
+			auto const key = in_a ? keys_[i] : b.keys_[j];
+
+			if ( in_a && in_b )
+			{
+				Container result;
+				if ( combine_arrays<Op> ( containers_[i], b.containers_[j], result ) || combine_words<Op> ( containers_[i], b.containers_[j], left, right, result ) )
+				{
+					keys.push_back ( key );
+					containers.push_back ( std::move ( result ) );
+				}
+			}
+			else if ( in_a && Op != bitop::and_op )
+			{
+				keys.push_back ( key );
+				containers.push_back ( std::move ( containers_[i] ) );
+			}
+			else if ( in_b && ( Op == bitop::or_op || Op == bitop::xor_op ) )
+			{
+				keys.push_back ( key );
+				containers.push_back ( b.containers_[j] );
+			}
+			i += in_a;
+			j += in_b;
+		}
+
+		keys_ = std::move ( keys );
+		containers_ = std::move ( containers );
+		nbits_ = std::max ( nbits_, b.nbits_ );
+		return *this;
+	}
+
+	// merges two array containers directly; false if either is not an array or the result is empty
+	template <bitkernels::bitop Op>
+	static bool combine_arrays( Container const& a, Container const& b, Container& out )
+	{
+		using bitkernels::bitop;
+		auto const* x = std::get_if<ArrayContainer> ( &a );
+		auto const* y = std::get_if<ArrayContainer> ( &b );
+		if ( !x || !y ) { return false; }
+		if constexpr ( Op == bitop::or_op || Op == bitop::xor_op )
+		{
+			// a union may cross the array limit; let the word path pick the container then
+			if ( x->cardinality () + y->cardinality () > ARRAY_MAX ) { return false; }
+		}
+
+		ArrayContainer merged;
+		auto const sink = std::back_inserter ( merged.values );
+		auto const& xv = x->values;
+		auto const& yv = y->values;
+		if constexpr ( Op == bitop::and_op ) { std::set_intersection ( xv.begin (), xv.end (), yv.begin (), yv.end (), sink ); }
+		else if constexpr ( Op == bitop::or_op ) { std::set_union ( xv.begin (), xv.end (), yv.begin (), yv.end (), sink ); }
+		else if constexpr ( Op == bitop::xor_op ) { std::set_symmetric_difference ( xv.begin (), xv.end (), yv.begin (), yv.end (), sink ); }
+		else { std::set_difference ( xv.begin (), xv.end (), yv.begin (), yv.end (), sink ); }
+		if ( merged.values.empty () ) { return false; }
+		out = std::move ( merged );
+		return true;
+	}
+
+	// any other pair is decoded and combined with the dense kernels; false if the result is empty
+	template <bitkernels::bitop Op>
+	static bool combine_words( Container const& a, Container const& b, Chunk& left, Chunk& right, Container& out )
+	{
+		decode ( a, left );
+		decode ( b, right );
+		bitkernels::combine<Op> ( left.data (), right.data (), sizeof left );
+		return encode ( left, out );
+	}
+
+public:
+	static constexpr size_t npos = static_cast<size_t> ( -1 );
+
+	// Forward iterator over the positions of the 1-bits, in increasing order
+	class set_bit_iterator final
+	{
+		CompressedBitArray const* b_ {};
+		size_t pos_ { npos };
+
+	public:
+		using iterator_category = std::forward_iterator_tag;
+		using value_type = size_t;
+		using difference_type = std::ptrdiff_t;
+		using pointer = size_t const*;
+		using reference = size_t;
+
+		set_bit_iterator() = default;
+		set_bit_iterator( CompressedBitArray const* b, size_t pos ) : b_ { b }, pos_ { pos } {}
+
+		size_t operator*() const { return pos_; }
+
+		set_bit_iterator& operator++()
+		{
+			pos_ = b_->find_next ( pos_ );
+			return *this;
+		}
+
+		set_bit_iterator operator++( int )
+		{
+			auto old = *this;
+			++*this;
+			return old;
+		}
+
+		friend bool operator==( set_bit_iterator const& a, set_bit_iterator const& b ) { return a.pos_ == b.pos_; }
+	};
+
+	struct set_bit_range
+	{
+		set_bit_iterator first, last;
+		set_bit_iterator begin() const { return first; }
+		set_bit_iterator end() const { return last; }
+	};
+
+	// Object Management
+
+	explicit CompressedBitArray( size_t const nbits = 0 ) : nbits_ { nbits } {} // nbits zero bits; stores nothing
+
+	template <class IType, class Allocator, class Instrumentation>
+	explicit CompressedBitArray( BitArray<IType, Allocator, Instrumentation> const& b ) : nbits_ { b.size () } // Compresses a dense array
+	{
+		auto const full_chunks = b.size () / 64; // whole 64-bit pieces of `b`
+		Chunk words;
+		for ( size_t key {}; key * CHUNK_BITS < nbits_; ++key )
+		{
+			words.fill ( 0 );
+			auto const first = key * CHUNK_WORDS;
+			for ( size_t j {}; j < CHUNK_WORDS && first + j < full_chunks; ++j ) { words[j] = b.read_chunk ( first + j ); }
+			for ( auto pos = std::max ( full_chunks * 64, key * CHUNK_BITS ); pos < std::min ( nbits_, ( key + 1 ) * CHUNK_BITS ); ++pos )
+			{
+				if ( b.read_bit ( pos ) ) { words[( pos % CHUNK_BITS ) >> 6] |= std::uint64_t ( 1 ) << ( pos & 63 ); }
+			}
+
+			Container c;
+			if ( encode ( words, c ) )
+			{
+				keys_.push_back ( key );
+				containers_.push_back ( std::move ( c ) );
+			}
+		}
+	}
+
+	template <class IType = size_t>
+	BitArray<IType> to_bitarray() const // Expands into a dense array
+	{
+		BitArray<IType> b { nbits_ };
+		auto const full_chunks = nbits_ / 64;
+		Chunk words;
+		for ( size_t i {}; i < keys_.size (); ++i )
+		{
+			decode ( containers_[i], words );
+			auto const first = keys_[i] * CHUNK_WORDS;
+			for ( size_t j {}; j < CHUNK_WORDS; ++j )
+			{
+				if ( !words[j] ) { continue; }
+				if ( first + j < full_chunks ) { b.set_chunk ( first + j, words[j] ); }
+				else
+				{
+					for ( auto word = words[j]; word; word &= word - 1 ) { b.assign_bit ( ( first + j ) * 64 + std::countr_zero ( word ), true ); }
+				}
+			}
+		}
+		return b;
+	}
+
+	// Mutators
+	void set( size_t const& bitpos, bool const val = true ) // Sets or resets one bit
+	{
+		check_index ( bitpos );
+		auto const key = bitpos / CHUNK_BITS;
+		auto const low = std::uint32_t ( bitpos % CHUNK_BITS );
+		auto const i = chunk_index ( key );
+		auto const present = i < keys_.size () && keys_[i] == key;
+		if ( !present )
+		{
+			if ( !val ) { return; }
+			keys_.insert ( keys_.begin () + std::ptrdiff_t ( i ), key );
+			containers_.insert ( containers_.begin () + std::ptrdiff_t ( i ), ArrayContainer { { std::uint16_t ( low ) } } );
+			return;
+		}
+
+		auto& c = containers_[i];
+		auto kept = true; // false once the chunk has no 1-bits left
+		if ( auto* array = std::get_if<ArrayContainer> ( &c ) )
+		{
+			auto const it = std::lower_bound ( array->values.begin (), array->values.end (), std::uint16_t ( low ) );
+			auto const found = it != array->values.end () && *it == low;
+			if ( val && !found && array->values.size () == ARRAY_MAX )
+			{
+				// a full array becomes a bitmap before it grows past the array limit
+				Chunk words;
+				decode ( c, words );
+				words[low >> 6] |= std::uint64_t ( 1 ) << ( low & 63 );
+				encode ( words, c );
+				return;
+			}
+			if ( val && !found ) { array->values.insert ( it, std::uint16_t ( low ) ); }
+			if ( !val && found ) { array->values.erase ( it ); }
+			kept = !array->values.empty ();
+		}
+		else if ( auto* bitmap = std::get_if<BitmapContainer> ( &c ) )
+		{
+			bitmap->set ( low, val );
+			if ( bitmap->ones == ARRAY_MAX )
+			{
+				// back to an array once it is no larger than one
+				ArrayContainer array;
+				array.values.reserve ( ARRAY_MAX );
+				for ( size_t k {}; k < CHUNK_WORDS; ++k )
+				{
+					for ( auto word = bitmap->words[k]; word; word &= word - 1 ) { array.values.push_back ( std::uint16_t ( k * 64 + std::countr_zero ( word ) ) ); }
+				}
+				c = std::move ( array );
+			}
+		}
+		else
+		{
+			// runs stay runs, as `optimize` chose them
+			auto& runs = std::get<RunContainer> ( c );
+			runs.set ( low, val );
+			kept = !runs.runs.empty ();
+		}
+
+		if ( !kept )
+		{
+			keys_.erase ( keys_.begin () + std::ptrdiff_t ( i ) );
+			containers_.erase ( containers_.begin () + std::ptrdiff_t ( i ) );
+		}
+	}
+
+	void reset( size_t const& bitpos ) { set ( bitpos, false ); }
+
+	// Converts chunks to run containers wherever runs are smaller; worthwhile for clustered data
+	void optimize()
+	{
+		Chunk words;
+		for ( auto& c : containers_ )
+		{
+			decode ( c, words );
+			RunContainer runs;
+			for ( std::uint32_t pos {}; pos < CHUNK_BITS; )
+			{
+				std::uint32_t start;
+				// find the next 1-bit, then the 0-bit that ends its run
+				auto i = pos >> 6;
+				auto word = words[i] & ~std::uint64_t ( 0 ) << ( pos & 63 );
+				while ( !word && ++i < CHUNK_WORDS ) { word = words[i]; }
+				if ( !word ) { break; }
+				start = std::uint32_t ( i * 64 + std::countr_zero ( word ) );
+				word = ~words[i] & ~std::uint64_t ( 0 ) << ( start & 63 );
+				while ( !word && ++i < CHUNK_WORDS ) { word = ~words[i]; }
+				auto const end = word ? std::uint32_t ( i * 64 + std::countr_zero ( word ) ) : std::uint32_t ( CHUNK_BITS );
+				runs.runs.push_back ( { std::uint16_t ( start ), std::uint16_t ( end - 1 ) } );
+				pos = end;
+			}
+
+			auto const current = std::visit ( []( auto const& container ) { return container.bytes (); }, c );
+			if ( runs.runs.size () * sizeof ( Run ) < current )
+			{
+				runs.runs.shrink_to_fit ();
+				c = std::move ( runs );
+			}
+		}
+	}
+
+	// Bit access
+	bool operator[]( size_t const& bitpos ) const { return at ( bitpos ); }
+
+	bool at( size_t const& bitpos ) const
+	{
+		check_index ( bitpos );
+		auto const key = bitpos / CHUNK_BITS;
+		auto const i = chunk_index ( key );
+		if ( i == keys_.size () || keys_[i] != key ) { return false; }
+		auto const low = std::uint32_t ( bitpos % CHUNK_BITS );
+		return std::visit ( [low]( auto const& container ) { return container.contains ( low ); }, containers_[i] );
+	}
+
+	// Bitwise algebra; operands of different sizes combine as they do between BitArrays
+	CompressedBitArray& operator&=( CompressedBitArray const& b ) { return combine<bitkernels::bitop::and_op> ( b ); }
+	CompressedBitArray& operator|=( CompressedBitArray const& b ) { return combine<bitkernels::bitop::or_op> ( b ); }
+	CompressedBitArray& operator^=( CompressedBitArray const& b ) { return combine<bitkernels::bitop::xor_op> ( b ); }
+	CompressedBitArray& and_not( CompressedBitArray const& b ) { return combine<bitkernels::bitop::and_not_op> ( b ); }
+
+	friend CompressedBitArray operator&( CompressedBitArray a, CompressedBitArray const& b ) { return std::move ( a &= b ); }
+	friend CompressedBitArray operator|( CompressedBitArray a, CompressedBitArray const& b ) { return std::move ( a |= b ); }
+	friend CompressedBitArray operator^( CompressedBitArray a, CompressedBitArray const& b ) { return std::move ( a ^= b ); }
+	friend CompressedBitArray and_not( CompressedBitArray a, CompressedBitArray const& b ) { return std::move ( a.and_not ( b ) ); }
+
+	friend bool operator==( CompressedBitArray const& a, CompressedBitArray const& b )
+	{
+		if ( a.nbits_ != b.nbits_ || a.keys_ != b.keys_ ) { return false; }
+		Chunk left, right;
+		for ( size_t i {}; i < a.keys_.size (); ++i )
+		{
+			decode ( a.containers_[i], left );
+			decode ( b.containers_[i], right );
+			if ( left != right ) { return false; }
+		}
+		return true;
+	}
+
+	// Extraction ops
+	CompressedBitArray slice( size_t const& bitpos, size_t const& count ) const // Extracts a new sub-array
+	{
+		if ( bitpos > nbits_ || count > nbits_ - bitpos ) { throw std::out_of_range ( "slice: range out of bounds" ); }
+		CompressedBitArray result { count };
+		for ( auto pos = find_from ( bitpos ); pos != npos && pos < bitpos + count; pos = find_next ( pos ) )
+		{
+			result.push_back_one ( pos - bitpos );
+		}
+		return result;
+	}
+
+	// Search ops
+	set_bit_range set_bits() const { return { set_bit_iterator ( this, find_first () ), set_bit_iterator ( this, npos ) }; }
+
+	size_t find_first() const { return find_from ( 0 ); }
+
+	size_t find_next( size_t const& bitpos ) const { return bitpos + 1 < nbits_ ? find_from ( bitpos + 1 ) : npos; }
+
+	// Counting ops
+	size_t size() const { return nbits_; }
+
+	size_t count() const
+	{
+		size_t total {};
+		for ( auto const& c : containers_ ) { total += cardinality ( c ); }
+		return total;
+	}
+
+	bool any() const { return !containers_.empty (); }
+
+	bool none() const { return containers_.empty (); }
+
+	size_t memory_usage() const // Bytes held by this object and its containers
+	{
+		auto total = sizeof ( *this ) + keys_.capacity () * sizeof ( size_t ) + containers_.capacity () * sizeof ( Container );
+		for ( auto const& c : containers_ ) { total += std::visit ( []( auto const& container ) { return container.bytes (); }, c ); }
+		return total;
+	}
+};
+#endif // COMPRESSED_BIT_ARRAY_H
@@ -0,0 +1,263 @@
+// pbitarray.cpp: The BitArray performance suite
+// Every operation is timed for each word type (uint8/16/32/64 and 128/256-bit blocks) at
+// sizes from 64 bits to 1 Gbit, growing eightfold. Run it with --benchmark_out=<file> to keep a JSON record for
+// comparing releases, and --benchmark_filter=<regex> to run a subset, e.g.
+//    pbitarray --benchmark_filter="count<uint64_t>" --benchmark_out=count.json
+// The case names read `op<word type>/bits`; GB/s counts the packed bits (bits / 8 bytes).
+#include <cstdint>
+#include <string>
+#include "bench.h"
+#include "bitarray.h"
+using namespace std;
+
+namespace {
+	constexpr size_t MIN_BITS = 64;
+	constexpr size_t MAX_BITS = size_t ( 1 ) << 30;
+	constexpr size_t UNDO_BATCH = 64; // inserts or erases between two untimed undos
+
+	// the text of the pattern used for every operand: bits 0, 3, 6, ... set
+	string const& pattern_text( size_t nbits )
+	{
+		static string text;
+		if ( text.size () != nbits )
+		{
+			text.assign ( nbits, '0' );
+			for ( size_t i {}; i < nbits; i += 3 ) { text[i] = '1'; }
+		}
+		return text;
+	}
+
+	template <class IType>
+	BitArray<IType> patterned( size_t nbits ) { return BitArray<IType> { pattern_text ( nbits ) }; }
+
+	template <class IType>
+	void register_size( string const& type, size_t nbits )
+	{
+		auto const add = [&]( char const* op, function<void( bench::state& )> body )
+		{
+			bench::add ( string ( op ) + "<" + type + ">/" + to_string ( nbits ), std::move ( body ) );
+		};
+
+		// construction and text conversion
+		add ( "construct", [nbits]( bench::state& s )
+		{
+			for ( auto _ : s ) { bench::do_not_optimize ( BitArray<IType> { nbits }.size () ); }
+			s.set_bits ( nbits );
+		} );
+		add ( "parse", [nbits]( bench::state& s )
+		{
+			auto const& text = pattern_text ( nbits );
+			for ( auto _ : s ) { bench::do_not_optimize ( BitArray<IType> { text }.size () ); }
+			s.set_bits ( nbits );
+		} );
+		add ( "to_string", [nbits]( bench::state& s )
+		{
+			auto const b = patterned<IType> ( nbits );
+			for ( auto _ : s ) { bench::do_not_optimize ( b.to_string ().size () ); }
+			s.set_bits ( nbits );
+		} );
+
+		// counting
+		add ( "count", [nbits]( bench::state& s )
+		{
+			auto const b = patterned<IType> ( nbits );
+			for ( auto _ : s ) { bench::do_not_optimize ( b.count () ); }
+			s.set_bits ( nbits );
+		} );
+
+		// shifts, by an amount that is not a whole number of words
+		add ( "shift_left", [nbits]( bench::state& s )
+		{
+			auto b = patterned<IType> ( nbits );
+			for ( auto _ : s )
+			{
+				b <<= 5;
+				bench::do_not_optimize ( b );
+			}
+			s.set_bits ( nbits );
+		} );
+		add ( "shift_right", [nbits]( bench::state& s )
+		{
+			auto b = patterned<IType> ( nbits );
+			for ( auto _ : s )
+			{
+				b >>= 5;
+				bench::do_not_optimize ( b );
+			}
+			s.set_bits ( nbits );
+		} );
+
+		// insert and erase in the middle; the other op undoes a batch of them outside the timing
+		add ( "insert", [nbits]( bench::state& s )
+		{
+			auto b = patterned<IType> ( nbits );
+			size_t pending {};
+			for ( auto _ : s )
+			{
+				b.insert ( nbits / 2, true );
+				if ( ++pending == UNDO_BATCH )
+				{
+					s.pause_timing ();
+					b.erase ( nbits / 2, pending );
+					pending = 0;
+					s.resume_timing ();
+				}
+			}
+			s.set_bits ( nbits );
+		} );
+		add ( "erase", [nbits]( bench::state& s )
+		{
+			auto b = patterned<IType> ( nbits + UNDO_BATCH );
+			size_t pending {};
+			for ( auto _ : s )
+			{
+				b.erase ( nbits / 2 );
+				if ( ++pending == UNDO_BATCH )
+				{
+					s.pause_timing ();
+					b.insert ( nbits / 2, BitArray<IType> { pending } );
+					pending = 0;
+					s.resume_timing ();
+				}
+			}
+			s.set_bits ( nbits );
+		} );
+
+		// the middle half, starting off a word boundary
+		add ( "slice", [nbits]( bench::state& s )
+		{
+			auto const b = patterned<IType> ( nbits );
+			for ( auto _ : s ) { bench::do_not_optimize ( b.slice ( nbits / 4 + 3, nbits / 2 ).size () ); }
+			s.set_bits ( nbits / 2 );
+		} );
+
+		// range edits over the middle half, with both ends off a word boundary
+		add ( "set_range", [nbits]( bench::state& s )
+		{
+			auto b = patterned<IType> ( nbits );
+			for ( auto _ : s )
+			{
+				b.set_range ( nbits / 4 + 3, nbits / 2 );
+				bench::do_not_optimize ( b );
+			}
+			s.set_bits ( nbits / 2 );
+		} );
+		add ( "count_range", [nbits]( bench::state& s )
+		{
+			auto const b = patterned<IType> ( nbits );
+			for ( auto _ : s ) { bench::do_not_optimize ( b.count_range ( nbits / 4 + 3, nbits / 2 ) ); }
+			s.set_bits ( nbits / 2 );
+		} );
+
+		// comparisons of equal operands, which read every word
+		add ( "equal", [nbits]( bench::state& s )
+		{
+			auto const a = patterned<IType> ( nbits ), b = a;
+			for ( auto _ : s ) { bench::do_not_optimize ( a == b ); }
+			s.set_bits ( nbits );
+		} );
+		add ( "less", [nbits]( bench::state& s )
+		{
+			auto const a = patterned<IType> ( nbits ), b = a;
+			for ( auto _ : s ) { bench::do_not_optimize ( a < b ); }
+			s.set_bits ( nbits );
+		} );
+
+		// bitwise ops, in place
+		add ( "and", [nbits]( bench::state& s )
+		{
+			auto a = patterned<IType> ( nbits );
+			BitArray<IType> const b = ~a; // a copy, not a lazy view of `a`
+			for ( auto _ : s ) { bench::do_not_optimize ( a &= b ); }
+			s.set_bits ( nbits );
+		} );
+		add ( "or", [nbits]( bench::state& s )
+		{
+			auto a = patterned<IType> ( nbits );
+			BitArray<IType> const b = ~a; // a copy, not a lazy view of `a`
+			for ( auto _ : s ) { bench::do_not_optimize ( a |= b ); }
+			s.set_bits ( nbits );
+		} );
+		add ( "xor", [nbits]( bench::state& s )
+		{
+			auto a = patterned<IType> ( nbits );
+			BitArray<IType> const b = ~a; // a copy, not a lazy view of `a`
+			for ( auto _ : s ) { bench::do_not_optimize ( a ^= b ); }
+			s.set_bits ( nbits );
+		} );
+		add ( "toggle", [nbits]( bench::state& s )
+		{
+			auto a = patterned<IType> ( nbits );
+			for ( auto _ : s )
+			{
+				a.toggle ();
+				bench::do_not_optimize ( a );
+			}
+			s.set_bits ( nbits );
+		} );
+
+		// r = ( ( a << 6 ) & ( ~b >> 6 ) ) ^ c, as one lazy expression and as the in-place ops
+		// (with a temporary for each shifted operand) it replaces
+		add ( "chain", [nbits]( bench::state& s )
+		{
+			BitArray<IType> const a = patterned<IType> ( nbits ), b = a << 1, c = a >> 1;
+			BitArray<IType> r { nbits };
+			for ( auto _ : s )
+			{
+				r = ( ( a << 6 ) & ( ~b >> 6 ) ) ^ c;
+				bench::do_not_optimize ( r );
+			}
+			s.set_bits ( nbits );
+		} );
+		add ( "chain_eager", [nbits]( bench::state& s )
+		{
+			BitArray<IType> const a = patterned<IType> ( nbits ), b = a << 1, c = a >> 1;
+			BitArray<IType> r { nbits }, t { nbits };
+			for ( auto _ : s )
+			{
+				r = a;
+				r <<= 6;
+				t = b;
+				t.toggle ();
+				t >>= 6;
+				r &= t;
+				r ^= c;
+				bench::do_not_optimize ( r );
+			}
+			s.set_bits ( nbits );
+		} );
+		add ( "chain_count", [nbits]( bench::state& s )
+		{
+			BitArray<IType> const a = patterned<IType> ( nbits ), b = a << 1, c = a >> 1;
+			for ( auto _ : s ) { bench::do_not_optimize ( ( ( ( a << 6 ) & ( ~b >> 6 ) ) ^ c ).count () ); }
+			s.set_bits ( nbits );
+		} );
+	}
+
+	template <class IType>
+	void register_type( string const& type )
+	{
+		for ( auto nbits { MIN_BITS }; nbits <= MAX_BITS; nbits *= 8 ) { register_size<IType> ( type, nbits ); }
+	}
+
+	char const* isa_name()
+	{
+		switch ( bitkernels::active_isa () )
+		{
+		case bitkernels::isa::avx512: return "avx512";
+		case bitkernels::isa::avx2: return "avx2";
+		default: return "portable";
+		}
+	}
+}
+
+int main( int argc, char** argv )
+{
+	register_type<uint8_t> ( "uint8_t" );
+	register_type<uint16_t> ( "uint16_t" );
+	register_type<uint32_t> ( "uint32_t" );
+	register_type<uint64_t> ( "uint64_t" );
+	register_type<BitBlock<128>> ( "block128" );
+	register_type<BitBlock<256>> ( "block256" );
+	return bench::run ( argc, argv, string ( "    \"bitarray_simd\": \"" ) + isa_name () + "\",\n" );
+}
@@ -0,0 +1,152 @@
+// pbitmapindex.cpp: Bitmap index queries over a synthetic 100M-row table
+// The table has four columns of uniformly spread values: region (16 values), status (4),
+// flagged (true for 1 row in 10) and age band (10). Each query is timed three ways:
+//    scan/...      the row-by-row loop over `operator[]` that a query replaces
+//    bitarray/...  whole-array BitArray ops, one temporary per operator
+//    query/...     the planned, fused BitmapQuery
+// It takes the same flags as pbitarray, e.g.
+//    pbitmapindex --benchmark_filter=selective --benchmark_out=index.json
+// The index is built once, on the first case that needs it (about 400 MB).
+#include <cstdint>
+#include <ranges>
+#include <string>
+#include "bench.h"
+#include "bitmapindex.h"
+using namespace std;
+
+namespace {
+	constexpr size_t ROWS = 100'000'000;
+
+	// a well mixed value for each row and column
+	uint64_t mix( uint64_t x )
+	{
+		x += 0x9E3779B97F4A7C15ull;
+		x = ( x ^ ( x >> 30 ) ) * 0xBF58476D1CE4E5B9ull;
+		x = ( x ^ ( x >> 27 ) ) * 0x94D049BB133111EBull;
+		return x ^ ( x >> 31 );
+	}
+
+	template <class F>
+	auto column( F f ) { return views::iota ( size_t {}, ROWS ) | views::transform ( f ); }
+
+	struct table
+	{
+		BitmapIndex<int> region { column ( []( size_t r ) { return int ( mix ( r ) % 16 ); } ) };
+		BitmapIndex<int> status { column ( []( size_t r ) { return int ( mix ( r + ROWS ) % 4 ); } ) };
+		BitmapIndex<bool> flagged { column ( []( size_t r ) { return mix ( r + 2 * ROWS ) % 10 == 0; } ) };
+		BitmapIndex<int> age { column ( []( size_t r ) { return int ( mix ( r + 3 * ROWS ) % 10 ); } ) };
+	};
+
+	table const& data()
+	{
+		static table const t;
+		return t;
+	}
+
+	// the bitmap of one value, for the hand-written forms
+	BitArray<> bitmap( BitmapIndex<int> const& index, int value ) { return index.equals ( value ).evaluate (); }
+	BitArray<> bitmap( BitmapIndex<bool> const& index, bool value ) { return index.equals ( value ).evaluate (); }
+
+	// region = 3 and status in (1, 2) and not flagged: about 1 row in 75
+	void register_selective()
+	{
+		bench::add ( "scan/selective", []( bench::state& s )
+		{
+			auto const r3 = bitmap ( data ().region, 3 ), s1 = bitmap ( data ().status, 1 ), s2 = bitmap ( data ().status, 2 );
+			auto const f = bitmap ( data ().flagged, true );
+			for ( auto _ : s )
+			{
+				size_t hits {};
+				for ( size_t row {}; row < ROWS; ++row ) { hits += r3[row] && ( s1[row] || s2[row] ) && !f[row]; }
+				bench::do_not_optimize ( hits );
+			}
+			s.set_bits ( ROWS );
+		} );
+		bench::add ( "bitarray/selective", []( bench::state& s )
+		{
+			auto const r3 = bitmap ( data ().region, 3 ), s1 = bitmap ( data ().status, 1 ), s2 = bitmap ( data ().status, 2 );
+			auto const f = bitmap ( data ().flagged, true );
+			for ( auto _ : s ) { bench::do_not_optimize ( and_not ( r3 & ( s1 | s2 ), f ).count () ); }
+			s.set_bits ( ROWS );
+		} );
+		bench::add ( "query/selective", []( bench::state& s )
+		{
+			auto const& t = data ();
+			auto const q = t.region.equals ( 3 ) & t.status.in ( { 1, 2 } ) & ~t.flagged.equals ( true );
+			for ( auto _ : s ) { bench::do_not_optimize ( q.count () ); }
+			s.set_bits ( ROWS );
+		} );
+		bench::add ( "query/selective_ids", []( bench::state& s )
+		{
+			auto const& t = data ();
+			auto const q = t.region.equals ( 3 ) & t.status.in ( { 1, 2 } ) & ~t.flagged.equals ( true );
+			for ( auto _ : s ) { bench::do_not_optimize ( q.row_ids ().size () ); }
+			s.set_bits ( ROWS );
+		} );
+		bench::add ( "query/selective_bitmap", []( bench::state& s )
+		{
+			auto const& t = data ();
+			auto const q = t.region.equals ( 3 ) & t.status.in ( { 1, 2 } ) & ~t.flagged.equals ( true );
+			for ( auto _ : s ) { bench::do_not_optimize ( q.evaluate ().size () ); }
+			s.set_bits ( ROWS );
+		} );
+	}
+
+	// age band 2 to 6 or region below 4, and status not 0: about 2 rows in 3
+	void register_wide()
+	{
+		bench::add ( "bitarray/wide", []( bench::state& s )
+		{
+			auto const& t = data ();
+			vector<BitArray<>> ages, regions;
+			for ( int a { 2 }; a <= 6; ++a ) { ages.push_back ( bitmap ( t.age, a ) ); }
+			for ( int r {}; r < 4; ++r ) { regions.push_back ( bitmap ( t.region, r ) ); }
+			auto const s0 = bitmap ( t.status, 0 );
+			for ( auto _ : s )
+			{
+				auto any = ages[0];
+				for ( size_t i { 1 }; i < ages.size (); ++i ) { any = any | ages[i]; }
+				for ( auto const& r : regions ) { any = any | r; }
+				bench::do_not_optimize ( and_not ( any, s0 ).count () );
+			}
+			s.set_bits ( ROWS );
+		} );
+		bench::add ( "query/wide", []( bench::state& s )
+		{
+			auto const& t = data ();
+			auto const q = ( t.age.between ( 2, 6 ) | t.region.between ( 0, 3 ) ) & ~t.status.equals ( 0 );
+			for ( auto _ : s ) { bench::do_not_optimize ( q.count () ); }
+			s.set_bits ( ROWS );
+		} );
+	}
+
+	// a term that matches nothing empties the whole conjunction after one pass over it
+	void register_empty()
+	{
+		bench::add ( "query/empty_term", []( bench::state& s )
+		{
+			auto const& t = data ();
+			auto const q = t.age.between ( 0, 8 ) & t.status.in ( { 0, 1, 2 } ) & t.region.equals ( 99 );
+			for ( auto _ : s ) { bench::do_not_optimize ( q.count () ); }
+			s.set_bits ( ROWS );
+		} );
+	}
+
+	void register_build()
+	{
+		bench::add ( "build/region", []( bench::state& s )
+		{
+			for ( auto _ : s ) { bench::do_not_optimize ( BitmapIndex<int> { column ( []( size_t r ) { return int ( mix ( r ) % 16 ); } ) }.rows () ); }
+			s.set_bits ( ROWS );
+		} );
+	}
+}
+
+int main( int argc, char** argv )
+{
+	register_selective ();
+	register_wide ();
+	register_empty ();
+	register_build ();
+	return bench::run ( argc, argv, "    \"rows\": " + to_string ( ROWS ) + ",\n" );
+}
@@ -0,0 +1,131 @@
+// pbitstream.cpp: BitWriter and BitReader rates
+// A million values are packed into a BitArray and read back: fixed fields of 1, 13 and 64
+// bits, and gamma codes of geometrically distributed values (the gaps of a sparse posting
+// list). `append` is the bit-at-a-time `operator+=` loop the writer replaces. GB/s counts the
+// bits packed or unpacked. Takes the same flags as pbitarray, e.g.
+//    pbitstream --benchmark_filter=gamma --benchmark_out=stream.json
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "bench.h"
+#include "bitstream.h"
+using namespace std;
+
+namespace {
+	constexpr size_t VALUES = 1 << 20;
+
+	// gaps whose bit lengths fall off by half per bit, as in an index of a frequent term
+	vector<uint64_t> const& gaps()
+	{
+		static vector<uint64_t> values;
+		if ( values.empty () )
+		{
+			uint64_t x { 0x9E3779B97F4A7C15 };
+			for ( size_t i {}; i < VALUES; ++i )
+			{
+				x = x * 6364136223846793005 + 1442695040888963407;
+				auto const length = unsigned ( std::countr_zero ( x | uint64_t ( 1 ) << 40 ) );
+				values.push_back ( ( uint64_t ( 1 ) << length ) | ( x >> 44 & ( ( uint64_t ( 1 ) << length ) - 1 ) ) );
+			}
+		}
+		return values;
+	}
+
+	BitArray<> const& packed_gaps()
+	{
+		static BitArray<> bits;
+		if ( bits.size () == 0 )
+		{
+			BitWriter out { bits };
+			for ( auto const v : gaps () ) { out.write_gamma ( v ); }
+		}
+		return bits;
+	}
+
+	void register_width( unsigned width )
+	{
+		auto const suffix = "/" + to_string ( width );
+		bench::add ( "write" + suffix, [width]( bench::state& s )
+		{
+			BitArray<> bits;
+			bits.reserve ( VALUES * width );
+			for ( auto _ : s )
+			{
+				s.pause_timing ();
+				if ( bits.size () ) { bits.erase ( 0, bits.size () ); }
+				s.resume_timing ();
+				BitWriter out { bits };
+				for ( size_t i {}; i < VALUES; ++i ) { out.write ( i, width ); }
+				out.flush ();
+				bench::do_not_optimize ( bits );
+			}
+			s.set_bits ( VALUES * width );
+		} );
+		bench::add ( "read" + suffix, [width]( bench::state& s )
+		{
+			BitArray<> bits;
+			{
+				BitWriter out { bits };
+				for ( size_t i {}; i < VALUES; ++i ) { out.write ( i, width ); }
+			}
+			for ( auto _ : s )
+			{
+				BitReader in { bits };
+				uint64_t sum {};
+				for ( size_t i {}; i < VALUES; ++i ) { sum += in.read ( width ); }
+				bench::do_not_optimize ( sum );
+			}
+			s.set_bits ( VALUES * width );
+		} );
+	}
+}
+
+int main( int argc, char** argv )
+{
+	for ( auto const width : { 1u, 13u, 64u } ) { register_width ( width ); }
+
+	bench::add ( "append/1", []( bench::state& s )
+	{
+		BitArray<> bits;
+		bits.reserve ( VALUES );
+		for ( auto _ : s )
+		{
+			s.pause_timing ();
+			if ( bits.size () ) { bits.erase ( 0, bits.size () ); }
+			s.resume_timing ();
+			for ( size_t i {}; i < VALUES; ++i ) { bits += ( i & 1 ) != 0; }
+			bench::do_not_optimize ( bits );
+		}
+		s.set_bits ( VALUES );
+	} );
+	bench::add ( "write_gamma", []( bench::state& s )
+	{
+		auto const& values = gaps ();
+		BitArray<> bits;
+		bits.reserve ( packed_gaps ().size () );
+		for ( auto _ : s )
+		{
+			s.pause_timing ();
+			if ( bits.size () ) { bits.erase ( 0, bits.size () ); }
+			s.resume_timing ();
+			BitWriter out { bits };
+			for ( auto const v : values ) { out.write_gamma ( v ); }
+			out.flush ();
+			bench::do_not_optimize ( bits );
+		}
+		s.set_bits ( packed_gaps ().size () );
+	} );
+	bench::add ( "read_gamma", []( bench::state& s )
+	{
+		auto const& bits = packed_gaps ();
+		for ( auto _ : s )
+		{
+			BitReader in { bits };
+			uint64_t sum {};
+			for ( size_t i {}; i < VALUES; ++i ) { sum += in.read_gamma (); }
+			bench::do_not_optimize ( sum );
+		}
+		s.set_bits ( bits.size () );
+	} );
+	return bench::run ( argc, argv );
+}
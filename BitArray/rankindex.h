@@ -0,0 +1,158 @@
+// rankindex.h: the rank/select directory
+#ifndef RANK_INDEX_H
+#define RANK_INDEX_H
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "bitkernels.h"
+
+// The rank/select directory behind `BitArray::rank1` and `BitArray::select1`.
+// The bits are read as 64-bit chunks through a callable, `chunk ( k )` returning bits
+// [64 * k, 64 * k + 64), so the directory does not depend on the word type.
+//
+// Layout: one 64-bit entry per 2048-bit block, so the directory costs about 3% of the bits.
+//   bits  0-31  the 1-bits before the block, counted from the start of its 2^32-bit group
+//   bits 32-61  the 1-bits in each of the block's first three 512-bit sub-blocks, 10 bits apiece
+// A rank reads one entry, one group count and at most eight chunks of a single sub-block,
+// all of which sit next to each other in memory. Select narrows the blocks with a sample
+// taken every 8192 1-bits, binary searches the entries, then walks one block.
+// The tables come from `Allocator`, rebound to their element types, so an index built for an
+// array on an arena stays on that arena.
+template <class Allocator = std::allocator<std::uint64_t>>
+class RankIndex final
+{
+	template <class T>
+	using table = std::vector<T, typename std::allocator_traits<Allocator>::template rebind_alloc<T>>;
+
+	static constexpr size_t BLOCK_BITS = 2048;
+	static constexpr size_t SUB_BITS = 512;
+	static constexpr size_t BLOCK_CHUNKS = BLOCK_BITS / 64;
+	static constexpr size_t SUB_CHUNKS = SUB_BITS / 64;
+	static constexpr size_t GROUP_SHIFT = 32 - 11; // 2^21 blocks of 2048 bits make a group
+	static constexpr size_t SAMPLE_ONES = 8192;
+
+	table<std::uint64_t> blocks_; // one entry per block, as laid out above
+	table<std::uint64_t> groups_; // the 1-bits before each group
+	table<std::uint32_t> samples_; // the block holding 1-bit number `i * SAMPLE_ONES`
+	size_t nbits_ {};
+	size_t ones_ {};
+	bool built_ {};
+
+	static unsigned sub_count( std::uint64_t entry, size_t sub ) { return unsigned ( entry >> ( 32 + 10 * sub ) & 0x3FF ); }
+
+	size_t ones_before( size_t block ) const { return size_t ( groups_[block >> GROUP_SHIFT] + ( blocks_[block] & 0xFFFFFFFF ) ); }
+
+public:
+	explicit RankIndex( Allocator const& alloc = Allocator () ) : blocks_ ( alloc ), groups_ ( alloc ), samples_ ( alloc ) {}
+
+	bool built() const { return built_; }
+
+	void clear()
+	{
+		blocks_.clear ();
+		groups_.clear ();
+		samples_.clear ();
+		nbits_ = ones_ = 0;
+		built_ = false;
+	}
+
+	template <class Chunks>
+	void build( size_t const nbits, Chunks chunk )
+	{
+		auto const nchunks = ( nbits + 63 ) / 64;
+		auto const nblocks = ( nbits + BLOCK_BITS - 1 ) / BLOCK_BITS;
+		blocks_.assign ( nblocks, 0 );
+		groups_.assign ( ( nblocks + ( size_t ( 1 ) << GROUP_SHIFT ) - 1 ) >> GROUP_SHIFT, 0 );
+		samples_.clear ();
+		samples_.reserve ( nbits / SAMPLE_ONES + 1 ); // room for any count, so a rebuild after writes does not allocate
+
+		size_t total {};
+		for ( size_t b {}; b < nblocks; ++b )
+		{
+			if ( ( b & ( ( size_t ( 1 ) << GROUP_SHIFT ) - 1 ) ) == 0 ) { groups_[b >> GROUP_SHIFT] = total; }
+			auto entry = std::uint64_t ( total - groups_[b >> GROUP_SHIFT] );
+			size_t in_block {};
+			for ( size_t sub {}; sub < BLOCK_BITS / SUB_BITS; ++sub )
+			{
+				auto const first = b * BLOCK_CHUNKS + sub * SUB_CHUNKS;
+				size_t ones {};
+				for ( auto k { first }; k < std::min ( first + SUB_CHUNKS, nchunks ); ++k ) { ones += size_t ( std::popcount ( chunk ( k ) ) ); }
+				if ( sub < 3 ) { entry |= std::uint64_t ( ones ) << ( 32 + 10 * sub ); }
+				in_block += ones;
+			}
+			blocks_[b] = entry;
+			total += in_block;
+			while ( samples_.size () * SAMPLE_ONES < total ) { samples_.push_back ( std::uint32_t ( b ) ); }
+		}
+		nbits_ = nbits;
+		ones_ = total;
+		built_ = true;
+	}
+
+	// the 1-bits in [0, pos), for `pos` <= the indexed size
+	template <class Chunks>
+	size_t rank1( size_t const pos, Chunks chunk ) const
+	{
+		if ( pos == nbits_ ) { return ones_; }
+		auto const block = pos / BLOCK_BITS;
+		auto const entry = blocks_[block];
+		auto const sub = pos % BLOCK_BITS / SUB_BITS;
+		auto rank = ones_before ( block );
+		for ( size_t s {}; s < sub; ++s ) { rank += sub_count ( entry, s ); }
+
+		auto const last = pos / 64;
+		for ( auto k { block * BLOCK_CHUNKS + sub * SUB_CHUNKS }; k < last; ++k ) { rank += size_t ( std::popcount ( chunk ( k ) ) ); }
+		if ( pos % 64 ) { rank += size_t ( std::popcount ( chunk ( last ) & ( ( std::uint64_t ( 1 ) << pos % 64 ) - 1 ) ) ); }
+		return rank;
+	}
+
+	// the position of 1-bit number `k` (counting from 0), or `npos` when there are not that many
+	template <class Chunks>
+	size_t select1( size_t k, Chunks chunk, size_t const npos ) const
+	{
+		if ( k >= ones_ ) { return npos; }
+
+		// the last group and then the last block that start with at most `k` 1-bits before them
+		auto const group = size_t ( std::upper_bound ( groups_.begin (), groups_.end (), k ) - groups_.begin () ) - 1;
+		auto lo = group << GROUP_SHIFT;
+		auto hi = std::min ( blocks_.size (), ( group + 1 ) << GROUP_SHIFT );
+		if ( !samples_.empty () )
+		{
+			auto const sample = k / SAMPLE_ONES;
+			lo = std::max ( lo, size_t ( samples_[sample] ) );
+			if ( sample + 1 < samples_.size () ) { hi = std::min ( hi, size_t ( samples_[sample + 1] ) + 1 ); }
+		}
+		auto const within = std::uint64_t ( k - groups_[group] );
+		auto const block = size_t ( std::upper_bound ( blocks_.begin () + std::ptrdiff_t ( lo ), blocks_.begin () + std::ptrdiff_t ( hi ), within,
+			[]( std::uint64_t value, std::uint64_t entry ) { return value < ( entry & 0xFFFFFFFF ); } ) - blocks_.begin () ) - 1;
+
+		k -= ones_before ( block );
+		auto const entry = blocks_[block];
+		size_t sub {};
+		for ( ; sub < 3 && k >= sub_count ( entry, sub ); ++sub ) { k -= sub_count ( entry, sub ); }
+		for ( auto c { block * BLOCK_CHUNKS + sub * SUB_CHUNKS };; ++c )
+		{
+			auto const word = chunk ( c );
+			auto const ones = size_t ( std::popcount ( word ) );
+			if ( k < ones ) { return c * 64 + bitkernels::select64 ( word, unsigned ( k ) ); }
+			k -= ones;
+		}
+	}
+
+	// a single bit changed, so the counts no longer hold; the tables keep their space for the
+	// next `build`
+	void invalidate()
+	{
+		built_ = false;
+	}
+
+	size_t memory_usage() const // bytes held by the directory
+	{
+		return blocks_.capacity () * sizeof ( std::uint64_t ) + groups_.capacity () * sizeof ( std::uint64_t )
+			+ samples_.capacity () * sizeof ( std::uint32_t );
+	}
+};
+#endif // RANK_INDEX_H
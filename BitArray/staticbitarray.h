@@ -0,0 +1,283 @@
+// staticbitarray.h: a BitArray with a compile-time size
+#ifndef STATIC_BIT_ARRAY_H
+#define STATIC_BIT_ARRAY_H
+#include <array>
+#include <bit>
+#include <climits>
+#include <compare>
+#include <functional>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include "bitarray.h"
+
+// A BitArray whose size is fixed at compile time, for feature masks, permission sets and the
+// like. The words are a `std::array` inside the object, every loop runs over a constant number
+// of words, and everything but the stream and BitArray conversions is `constexpr`, so
+//    constexpr StaticBitArray<12> mask { "110000000011" };
+// is built by the compiler. The layout, the operators and the ordering are those of BitArray,
+// and a StaticBitArray converts to and from a BitArray of the same size with one copy.
+// `at` checks its index; `operator[]` does not, as with `std::bitset`.
+template <size_t N, class IType = size_t>
+class StaticBitArray
+{
+	enum { BITS_PER_WORD = CHAR_BIT * sizeof ( IType ) };
+	static constexpr size_t WORDS = ( N + BITS_PER_WORD - 1 ) / BITS_PER_WORD;
+
+	std::array<IType, WORDS> bits_ {};
+
+	static constexpr IType low_mask( size_t const nbits )
+	{
+		return nbits ? IType ( IType ( ~IType ( 0 ) ) >> ( BITS_PER_WORD - nbits ) ) : IType ( 0 );
+	}
+
+	// the bits of the last word that are in use
+	static constexpr IType TAIL_MASK = N % BITS_PER_WORD ? low_mask ( N % BITS_PER_WORD ) : IType ( ~IType ( 0 ) );
+
+	constexpr void clean_tail()
+	{
+		if constexpr ( WORDS > 0 ) { bits_[WORDS - 1] &= TAIL_MASK; }
+	}
+
+	static constexpr size_t check_index( size_t const bitpos )
+	{
+		if ( bitpos >= N ) { throw std::out_of_range ( "bit position out of range" ); }
+		return bitpos;
+	}
+
+	static constexpr IType mask1( size_t const bitpos ) { return IType ( IType ( 1 ) << bitpos % BITS_PER_WORD ); }
+
+public:
+	static constexpr size_t npos = static_cast<size_t> ( -1 );
+
+	// refers to one bit by its word and mask
+	class reference final
+	{
+		IType& word_;
+		IType mask_;
+	public:
+		constexpr reference( IType& word, IType const mask ) : word_ { word }, mask_ { mask } {}
+		constexpr reference( reference const& ) = default;
+
+		constexpr reference& operator=( bool const bit )
+		{
+			word_ = bit ? IType ( word_ | mask_ ) : IType ( word_ & ~mask_ );
+			return *this;
+		}
+
+		constexpr reference& operator=( reference const& other ) { return *this = bool ( other ); }
+
+		constexpr operator bool() const { return ( word_ & mask_ ) != 0; }
+	};
+
+	constexpr StaticBitArray() = default;
+
+	// expects exactly N characters of '0' or '1'; anything else gets `runtime_error`
+	constexpr explicit StaticBitArray( std::string_view const str )
+	{
+		if ( str.size () != N ) { throw std::runtime_error ( "string length does not match the array size" ); }
+		for ( size_t i {}; i < N; ++i )
+		{
+			if ( str[i] != '0' && str[i] != '1' ) { throw std::runtime_error ( std::string ( "invalid character found: '" ) + str[i] + "'" ); }
+			if ( str[i] == '1' ) { bits_[i / BITS_PER_WORD] |= mask1 ( i ); }
+		}
+	}
+
+	// Conversions; the dynamic side must have exactly N bits or `length_error` is thrown
+	explicit StaticBitArray( BitSpan<IType> const& s )
+	{
+		if ( s.size () != N ) { throw std::length_error ( "BitArray size does not match the static size" ); }
+		s.copy_to ( bits_.data () );
+	}
+
+	template <class Allocator, class Instrumentation>
+	explicit StaticBitArray( BitArray<IType, Allocator, Instrumentation> const& b ) : StaticBitArray ( BitSpan<IType> ( b ) ) {}
+
+	BitArray<IType> to_bitarray() const { return BitArray<IType> ( BitSpan<IType> ( *this ) ); }
+
+	operator BitSpan<IType>() const { return { bits_.data (), 0, N }; } // lets BitArray ops take it directly
+
+	// Bit access
+	constexpr reference operator[]( size_t const bitpos ) { return { bits_[bitpos / BITS_PER_WORD], mask1 ( bitpos ) }; }
+
+	constexpr bool operator[]( size_t const bitpos ) const { return ( bits_[bitpos / BITS_PER_WORD] & mask1 ( bitpos ) ) != 0; }
+
+	constexpr bool at( size_t const bitpos ) const { return ( *this )[check_index ( bitpos )]; }
+
+	constexpr StaticBitArray& set( size_t const bitpos, bool const bit = true )
+	{
+		( *this )[check_index ( bitpos )] = bit;
+		return *this;
+	}
+
+	constexpr StaticBitArray& reset( size_t const bitpos ) { return set ( bitpos, false ); }
+
+	constexpr void toggle( size_t const bitpos ) { bits_[check_index ( bitpos ) / BITS_PER_WORD] ^= mask1 ( bitpos ); }
+
+	constexpr void toggle() // Toggles all bits
+	{
+		for ( auto& word : bits_ ) { word = IType ( ~word ); }
+		clean_tail ();
+	}
+
+	constexpr StaticBitArray operator~() const
+	{
+		auto b { *this };
+		b.toggle ();
+		return b;
+	}
+
+	// Bitwise algebra
+	constexpr StaticBitArray& operator&=( StaticBitArray const& b )
+	{
+		for ( size_t i {}; i < WORDS; ++i ) { bits_[i] &= b.bits_[i]; }
+		return *this;
+	}
+
+	constexpr StaticBitArray& operator|=( StaticBitArray const& b )
+	{
+		for ( size_t i {}; i < WORDS; ++i ) { bits_[i] |= b.bits_[i]; }
+		return *this;
+	}
+
+	constexpr StaticBitArray& operator^=( StaticBitArray const& b )
+	{
+		for ( size_t i {}; i < WORDS; ++i ) { bits_[i] ^= b.bits_[i]; }
+		return *this;
+	}
+
+	constexpr StaticBitArray& and_not( StaticBitArray const& b ) // reset every bit set in `b`
+	{
+		for ( size_t i {}; i < WORDS; ++i ) { bits_[i] &= IType ( ~b.bits_[i] ); }
+		return *this;
+	}
+
+	friend constexpr StaticBitArray operator&( StaticBitArray a, StaticBitArray const& b ) { return a &= b; }
+	friend constexpr StaticBitArray operator|( StaticBitArray a, StaticBitArray const& b ) { return a |= b; }
+	friend constexpr StaticBitArray operator^( StaticBitArray a, StaticBitArray const& b ) { return a ^= b; }
+	friend constexpr StaticBitArray and_not( StaticBitArray a, StaticBitArray const& b ) { return a.and_not ( b ); }
+
+	// Shift operators; as in BitArray, `<<` slides the bits toward bit 0
+	constexpr StaticBitArray& operator<<=( size_t const shift_amt )
+	{
+		if ( shift_amt >= N )
+		{
+			bits_.fill ( 0 );
+			return *this;
+		}
+		auto const word_shift = shift_amt / BITS_PER_WORD;
+		auto const bit_shift = shift_amt % BITS_PER_WORD;
+		for ( size_t i {}; i < WORDS; ++i )
+		{
+			auto const src = i + word_shift;
+			IType const word = src < WORDS ? bits_[src] : IType ( 0 );
+			IType const carry = src + 1 < WORDS ? bits_[src + 1] : IType ( 0 );
+			bits_[i] = bit_shift ? IType ( word >> bit_shift | carry << ( BITS_PER_WORD - bit_shift ) ) : word;
+		}
+		return *this;
+	}
+
+	constexpr StaticBitArray& operator>>=( size_t const shift_amt )
+	{
+		if ( shift_amt >= N )
+		{
+			bits_.fill ( 0 );
+			return *this;
+		}
+		auto const word_shift = shift_amt / BITS_PER_WORD;
+		auto const bit_shift = shift_amt % BITS_PER_WORD;
+		for ( auto i { WORDS }; i-- > 0; )
+		{
+			IType const word = i >= word_shift ? bits_[i - word_shift] : IType ( 0 );
+			IType const carry = i > word_shift ? bits_[i - word_shift - 1] : IType ( 0 );
+			bits_[i] = bit_shift ? IType ( word << bit_shift | carry >> ( BITS_PER_WORD - bit_shift ) ) : word;
+		}
+		clean_tail ();
+		return *this;
+	}
+
+	constexpr StaticBitArray operator<<( size_t const shift_amt ) const { return StaticBitArray ( *this ) <<= shift_amt; }
+	constexpr StaticBitArray operator>>( size_t const shift_amt ) const { return StaticBitArray ( *this ) >>= shift_amt; }
+
+	// Comparison ops, in the lexicographic order of BitArray
+	friend constexpr bool operator==( StaticBitArray const& a, StaticBitArray const& b ) = default;
+
+	friend constexpr std::strong_ordering operator<=>( StaticBitArray const& a, StaticBitArray const& b )
+	{
+		for ( size_t i {}; i < WORDS; ++i )
+		{
+			if ( IType const diff = IType ( a.bits_[i] ^ b.bits_[i] ) )
+			{
+				// the lowest differing bit is the first differing character
+				return ( a.bits_[i] >> bitword::countr_zero ( diff ) & 1u ) ? std::strong_ordering::greater : std::strong_ordering::less;
+			}
+		}
+		return std::strong_ordering::equal;
+	}
+
+	// Search ops
+	constexpr size_t find_first() const { return find_from ( 0 ); }
+
+	constexpr size_t find_next( size_t const bitpos ) const { return bitpos + 1 < N ? find_from ( bitpos + 1 ) : npos; }
+
+	// Counting ops
+	static constexpr size_t size() { return N; }
+
+	constexpr size_t count() const
+	{
+		size_t ones {};
+		for ( auto const word : bits_ ) { ones += size_t ( bitword::popcount ( word ) ); }
+		return ones;
+	}
+
+	constexpr bool any() const
+	{
+		IType seen {};
+		for ( auto const word : bits_ ) { seen |= word; }
+		return seen != 0;
+	}
+
+	constexpr bool none() const { return !any (); }
+
+	constexpr bool all() const
+	{
+		for ( size_t i {}; i + 1 < WORDS; ++i ) { if ( IType ( ~bits_[i] ) ) { return false; } }
+		return WORDS == 0 || bits_[WORDS - 1] == TAIL_MASK;
+	}
+
+	// String conversion
+	constexpr std::string to_string() const
+	{
+		std::string text ( N, '0' );
+		for ( size_t i {}; i < N; ++i ) { if ( ( *this )[i] ) { text[i] = '1'; } }
+		return text;
+	}
+
+	friend std::ostream& operator<<( std::ostream& os, StaticBitArray const& b ) { return os << b.to_string (); }
+
+	friend struct std::hash<StaticBitArray>;
+
+private:
+	constexpr size_t find_from( size_t const bitpos ) const
+	{
+		for ( auto i { bitpos / BITS_PER_WORD }; i < WORDS; ++i )
+		{
+			IType word = bits_[i];
+			if ( i == bitpos / BITS_PER_WORD ) { word &= IType ( ~low_mask ( bitpos % BITS_PER_WORD ) ); }
+			if ( word ) { return i * BITS_PER_WORD + size_t ( bitword::countr_zero ( word ) ); }
+		}
+		return npos;
+	}
+};
+
+// Hashes like the BitArray of the same bits, so the two can share a hashed container's keys
+template <size_t N, class IType>
+struct std::hash<StaticBitArray<N, IType>>
+{
+	size_t operator()( StaticBitArray<N, IType> const& b ) const noexcept
+	{
+		return bitkernels::hash ( b.bits_.data (), b.bits_.size () * sizeof ( IType ), N );
+	}
+};
+#endif // STATIC_BIT_ARRAY_H
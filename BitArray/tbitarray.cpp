@@ -1,12 +1,169 @@
 // tbitarray.cpp: A cursory test for the BitArray class
+#include <atomic>
+#include <fstream>
 #include <iostream>
+#include <memory_resource>
 #include <sstream>
 #include <stdexcept>
 #include <string>
+#include <thread>
+#include <vector>
+#include "atomicbitarray.h"
 #include "bitarray.h"
+#include "bitarrayview.h"
+#include "bitmapindex.h"
+#include "bitstream.h"
+#include "bloomfilter.h"
+#include "compressedbitarray.h"
+#include "staticbitarray.h"
 #include "test.h"
 using namespace std;
 
+// a memory resource that counts the allocations it passes on
+struct counting_resource : pmr::memory_resource {
+   size_t allocations = 0;
+   void* do_allocate(size_t bytes, size_t align) override { ++allocations; return pmr::new_delete_resource()->allocate(bytes, align); }
+   void do_deallocate(void* p, size_t bytes, size_t align) override { pmr::new_delete_resource()->deallocate(p, bytes, align); }
+   bool do_is_equal(const pmr::memory_resource& other) const noexcept override { return this == &other; }
+};
+
+// Runs every op on BitArray<IType> at sizes around the word and inline boundaries, checking
+// each against the same edit on a string of '0' and '1'; a size with failures is reported
+// with the word type, since the failing lines are shared by every width
+template <class IType>
+void test_word_width(const char* type) {
+   using B = BitArray<IType>;
+   for (size_t n : {0, 1, 7, 63, 64, 65, 127, 128, 129, 255, 256, 257, 1000, 5003}) {
+      size_t const failures = nFail;
+      string text(n, '0');
+      for (size_t i = 0; i < n; ++i) if ((i * 2654435761u >> 7) % 3 == 0) text[i] = '1';
+      B const a{text};
+      size_t const ones = size_t(count(text.begin(), text.end(), '1'));
+      size_t const first_one = text.find('1'), last_one = text.rfind('1');
+      test_(a.to_string() == text);
+      test_(a.size() == n);
+      test_(a.count() == ones);
+      test_(a.any() == (ones > 0));
+      test_(a.find_first() == (first_one == string::npos ? B::npos : first_one));
+      test_(a.find_last() == (last_one == string::npos ? B::npos : last_one));
+      test_(a.find_first_zero() == (text.find('0') == string::npos ? B::npos : text.find('0')));
+      size_t visited = 0;
+      bool only_ones = true;
+      for (size_t pos : a.set_bits()) only_ones = only_ones && text[pos] == '1' && ++visited;
+      test_(only_ones && visited == ones);
+
+      // shifts, eager and lazy, by amounts inside a word and across words
+      for (size_t k : {size_t(1), size_t(5), size_t(64), size_t(131), n}) {
+         string const left = k < n ? text.substr(k) + string(k, '0') : string(n, '0');
+         string const right = k < n ? string(k, '0') + text.substr(0, n - k) : string(n, '0');
+         B l{a}, r{a};
+         l <<= unsigned(k);
+         r >>= unsigned(k);
+         test_(l.to_string() == left);
+         test_(r.to_string() == right);
+         test_((a << unsigned(k)).to_string() == left);
+         test_(B(a >> unsigned(k)) == r);
+      }
+
+      // the algebra against an operand of another size, and the complement
+      string const other_text = text.substr(0, n / 2) + "1011";
+      B const b{other_text};
+      string and_text(max(n, other_text.size()), '0'), or_text = and_text, xor_text = and_text, not_text = text;
+      for (size_t i = 0; i < and_text.size(); ++i) {
+         bool const x = i < n && text[i] == '1', y = i < other_text.size() && other_text[i] == '1';
+         and_text[i] = x && y ? '1' : '0';
+         or_text[i] = x || y ? '1' : '0';
+         xor_text[i] = x != y ? '1' : '0';
+      }
+      for (auto& c : not_text) c = c == '1' ? '0' : '1';
+      B t{a};
+      t.toggle();
+      test_(B(a & b).to_string() == and_text);
+      test_(B(a | b).to_string() == or_text);
+      test_(B(a ^ b).to_string() == xor_text);
+      test_(t.to_string() == not_text);
+      test_((~a).to_string() == not_text);
+      test_((~a).count() == n - ones);
+      test_((B{a} &= b).to_string() == and_text);
+      test_((B{a} ^= b).to_string() == xor_text);
+      bool lazy_reads = true;
+      for (size_t i = 0; i < n; ++i)
+         lazy_reads = lazy_reads && (a & b)[i] == (and_text[i] == '1') && (a ^ b)[i] == (xor_text[i] == '1') && (~a)[i] == (not_text[i] == '1');
+      test_(lazy_reads);
+
+      // edits, ranges, slices and rank/select
+      B e{a};
+      e += true;
+      e.insert(n / 2, false);
+      e.erase(n / 2);
+      test_(e.to_string() == text + "1");
+      test_(e.count() == ones + 1);
+      if (n >= 10) {
+         B r{a};
+         r.set_range(3, n - 6);
+         r.flip_range(4, 2);
+         string expect = text;
+         for (size_t i = 3; i < n - 3; ++i) expect[i] = i == 4 || i == 5 ? '0' : '1';
+         test_(r.to_string() == expect);
+         test_(a.count_range(3, n - 6) == size_t(count(text.begin() + 3, text.end() - 3, '1')));
+         test_(a.slice(3, n - 6).to_string() == text.substr(3, n - 6));
+         test_(a.span(3, n - 6).count() == a.count_range(3, n - 6));
+      }
+      B ranked{a};
+      ranked.build_rank_index();
+      test_(ranked.rank1(n) == ones);
+      test_(a.rank1(n / 2) == size_t(count(text.begin(), text.begin() + ptrdiff_t(n / 2), '1')));
+      test_(ones == 0 || (ranked.select1(ones - 1) == last_one && a.select1(0) == first_one));
+      size_t nth = 0;
+      bool selects = true;
+      for (size_t pos : a.set_bits()) selects = selects && a.select1(nth++) == pos;
+      test_(selects);
+      if (n > 200) {
+         B lone(n); // the only 1 in a high lane of a block word
+         lone[70] = lone[199] = true;
+         test_(lone.select1(0) == 70 && lone.select1(1) == 199 && lone.select1(2) == B::npos);
+      }
+
+      // comparison, hashing, binary images and conversion to the other widths
+      stringstream image;
+      a.write_binary(image);
+      B const read = B::read_binary(image);
+      test_(read == a);
+      test_((a <=> B{text + "0"}) < 0);
+      test_(hash<B>{}(read) == hash<B>{}(a));
+      test_(BitArray<uint8_t>(a).to_string() == text);
+      test_(BitArray<BitBlock<256>>(a).to_string() == text);
+      test_(B(BitArray<uint16_t>(a)) == a);
+      test_(B(BitArray<BitBlock<128>>(a)) == a);
+      test_(B(BitArray<uint64_t>(a)) == a);
+
+      // spans and views, which read the words in place, and a view of a mapped image
+      BitSpan<IType> const whole = a.span(0, n);
+      BitArrayView<IType> const view{a};
+      test_(whole.count() == ones);
+      test_(view.count() == ones);
+      test_(view.to_bitarray() == a);
+      test_(whole == a);
+      bool in_place_reads = true;
+      for (size_t i = 0; i < n; ++i) in_place_reads = in_place_reads && whole[i] == (text[i] == '1') && view[i] == (text[i] == '1');
+      test_(in_place_reads);
+      test_(view.find_first() == a.find_first());
+      if (n == 1000) {
+         auto const path = filesystem::temp_directory_path() / "tbitarray_width.bin";
+         save_binary(a, path);
+         {
+            BitArrayView<IType> const mapped{path, true};
+            test_(mapped.size() == n);
+            test_(mapped.count() == ones);
+            test_(mapped.at(first_one));
+            test_(mapped.to_bitarray() == a);
+         }
+         filesystem::remove(path);
+      }
+      if (nFail != failures) cout << "  (" << nFail - failures << " of them for BitArray<" << type << "> of " << n << " bits)" << endl;
+   }
+}
+
 // Test program
 int main() {
    // Test exceptions
@@ -19,8 +176,10 @@ int main() {
    // Test empty Bitarray properties
    test_(b.size() == 0);
    test_(b.count() == 0);
-   test_(b.capacity() == 0);
+   test_(b.capacity() == BitArray<>::INLINE_BITS); // the inline words, no allocation
    test_(!b.any());
+   test_(b.none());
+   test_(b.all());
    
    // Validate construction and to_string()
    BitArray<> b2{5};
@@ -48,11 +207,33 @@ int main() {
    BitArray<> b4b;
    b4b = move(b4);
    test_(b4b[2]);
+   {
+      // a moved-from array is empty, whether its words were on the heap or copied across allocators
+      BitArray<> big(300);
+      big[299] = true;
+      BitArray<> taken{move(big)};
+      test_(big.size() == 0 && big.count() == 0 && big.to_string() == "" && !big.any());
+      big += true;
+      test_(big.size() == 1 && big.count() == 1 && taken.count() == 1);
+      big = move(taken);
+      test_(taken.size() == 0 && taken.count() == 0 && taken.to_string() == "");
+      counting_resource one, other;
+      PmrBitArray<> from{300, &one}, to{10, &other};
+      from.fill(true);
+      from.build_rank_index();
+      to = move(from);
+      test_(from.size() == 0 && from.count() == 0 && to.count() == 300);
+      test_(!from.has_rank_index() && from.select1(0) == PmrBitArray<>::npos);
+      for (int i = 0; i < 300; ++i) from += false;
+      test_(from.count() == 0);
+   }
 
    // Test bit ops
    BitArray<> x{"011010110"}; // Also tests string constructor
    test_(x.count() == 5);
    test_(x.any());
+   test_(!x.none());
+   test_(!x.all());
    test_((x << 6).to_string() == "110000000");
    test_((x >> 6).to_string() == "000000011");
    test_((x <<= 3).to_string() == "010110000");
@@ -62,6 +243,81 @@ int main() {
    test_(x == y);
    test_(x.to_string() == "111101001");
 
+   // Test bitwise algebra
+   BitArray<> m1{"1100"};
+   BitArray<> m2{"101000"};
+   test_((m1 & m2).to_string() == "100000");
+   test_((m1 | m2).to_string() == "111000");
+   test_((m1 ^ m2).to_string() == "011000");
+   test_(and_not(m1, m2).to_string() == "010000");
+   test_(count_and(m1, m2) == 1);
+   test_(any_and(m1, m2));
+   test_(!any_and(m1, BitArray<>{"0011"}));
+   m1 |= m2;
+   test_(m1.to_string() == "111000");
+
+   // Test searching and set-bit iteration
+   BitArray<> s1{"0010010001"};
+   test_(s1.find_first() == 2);
+   test_(s1.find_next(2) == 5);
+   test_(s1.find_last() == 9);
+   test_(s1.find_first_zero() == 0);
+   test_(BitArray<>{"00"}.find_first() == BitArray<>::npos);
+   size_t positions = 0;
+   for (size_t pos : s1.set_bits()) positions = positions * 10 + pos;
+   test_(positions == 259);
+
+   // Test rank and select, with and without the index
+   test_(s1.rank1(5) == 1);
+   test_(s1.rank0(5) == 4);
+   test_(s1.select1(2) == 9);
+   test_(s1.select1(3) == BitArray<>::npos);
+   throw_(s1.rank1(11), logic_error);
+   s1.build_rank_index();
+   test_(s1.has_rank_index());
+   test_(s1.rank1(6) == 2);
+   test_(s1.rank1(10) == 3);
+   s1[0] = true;
+   test_(!s1.has_rank_index());
+   test_(s1.rank1(3) == 2);
+   test_(s1.select1(1) == 2);
+   s1.build_rank_index();
+   test_(s1.has_rank_index() && s1.rank1(3) == 2);
+   s1 <<= 1;
+   test_(!s1.has_rank_index());
+   test_(s1.select1(0) == 1);
+   {
+      // writes between queries: the queries scan until the index is built again
+      BitArray<> big(100000), plain(100000);
+      for (size_t i = 0; i < big.size(); i += 3) big[i] = plain[i] = true;
+      big.build_rank_index();
+      for (size_t i = 0; i < big.size(); i += 1000) big[i + 1] = plain[i + 1] = true;
+      big[0] = plain[0] = false;
+      test_(!big.has_rank_index() && big.rank1(50000) == plain.rank1(50000));
+      big.build_rank_index();
+      test_(big.has_rank_index() && big.rank1(50000) == plain.rank1(50000));
+      test_(big.select1(20000) == plain.select1(20000) && big.select1(0) == 1);
+      big.toggle(99999);
+      plain.toggle(99999);
+      test_(!big.has_rank_index());
+      big.build_rank_index();
+      test_(big.rank1(100000) == plain.count() && big.select1(plain.count() - 1) == plain.find_last());
+
+      // the directory sits outside the array, comes from its allocator and is not copied
+      static_assert(sizeof(BitArray<>) <= 64);
+      counting_resource arena;
+      PmrBitArray<> on_arena{100000, &arena};
+      on_arena[5] = true;
+      auto const before_index = arena.allocations;
+      test_(on_arena.rank_index_bytes() == 0);
+      on_arena.build_rank_index();
+      test_(arena.allocations > before_index && on_arena.rank_index_bytes() > 0);
+      PmrBitArray<> const copied{on_arena};
+      test_(!copied.has_rank_index() && copied.rank_index_bytes() == 0 && copied.rank1(6) == 1);
+      auto const moved = std::move(on_arena);
+      test_(moved.has_rank_index() && moved.rank1(6) == 1);
+   }
+
    b = BitArray<>{};
    test_(!b.any());
    b += 1;
@@ -107,11 +363,31 @@ int main() {
    
    BitArray<> b5{"11111111111111111111111111000000000000000000000000000011"};
    test_(b5.slice(23,10) == BitArray<>("1110000000"));
+   throw_(b5.slice(50,10), logic_error);
+   BitSpan<> window = b5.span(23,10);
+   test_(window.size() == 10);
+   test_(window.count() == 3);
+   test_(window[2] && !window[3]);
+   test_(window == BitArray<>("1110000000"));
+   test_(window < b5);
+   test_(window.subspan(3,7).none());
+   BitArray<> target{"0110000000"};
+   target ^= window;
+   test_(target.to_string() == "1000000000");
    size_t n = b2.size();
    b2.insert(3,b5);
    test_(n + b5.size() == b2.size());
    b2.erase(3, b5.size());
    b2.shrink_to_fit();
+   test_(b2.capacity() == BitArray<>::INLINE_BITS);
+   b2.reserve(1000);
+   test_(b2.capacity() >= 1000);
+   test_(b2.size() == n);
+   BitArray<> log;
+   for (int i = 0; i < 100; ++i) log += b5;
+   test_(log.size() == 100 * b5.size());
+   test_(log.count() == 100 * b5.count());
+   test_(log.slice(56, 56) == b5);
    
    // Test comparisons
    BitArray<> b6{"10101"};
@@ -124,6 +400,10 @@ int main() {
    test_(b7 >= b6);
    test_(b7 >= b7);
    test_(BitArray<>("111") > BitArray<>("10111"));
+   test_((b6 <=> b7) < 0);
+   test_((b7 <=> b8) == 0);
+   test_(hash<BitArray<>>{}(b7) == hash<BitArray<>>{}(b8));
+   test_(hash<BitArray<>>{}(BitArray<>{1}) != hash<BitArray<>>{}(BitArray<>{2}));
 
    BitArray<> b9{"11111111111111111111111111000000000000000000000000000011"};
    ostringstream ostr;
@@ -141,26 +421,547 @@ int main() {
    const BitArray<> b11{b10};
    test_(b11[0]);
 
+   // Test binary serialization and views
+   stringstream bin;
+   b9.write_binary(bin);
+   test_(BitArray<>::read_binary(bin) == b9);
+   const auto image = filesystem::temp_directory_path() / "tbitarray.bin";
+   save_binary(b9, image);
+   {
+      BitArrayView<> mapped{image, true};
+      test_(mapped.size() == b9.size());
+      test_(mapped.count() == b9.count());
+      test_(mapped[0] == b9[0]);
+      test_(count_and(mapped, b9) == b9.count());
+      test_(mapped.to_bitarray() == b9);
+   }
+   filesystem::remove(image);
+   istringstream junk{"not a bitarray"};
+   throw_(BitArray<>::read_binary(junk), runtime_error);
+   {
+      // a size near 2^64 would wrap the payload size; neither reader trusts it
+      stringstream good;
+      b9.write_binary(good);
+      string bytes = good.str();
+      for (size_t i = 16; i < 24; ++i) bytes[i] = char(0xFF);
+      istringstream wrapped{bytes};
+      throw_(BitArray<>::read_binary(wrapped), runtime_error);
+      bytes[16] = char(0xC1); // 2^64 - 63: whole words, rounding to zero bytes
+      istringstream rounded{bytes};
+      throw_(BitArray<>::read_binary(rounded), runtime_error);
+      // a claim of 2^50 bits over a few bytes of body is caught at the end of the stream
+      bytes[16] = char(0);
+      for (size_t i = 17; i < 24; ++i) bytes[i] = char(i == 22 ? 0x04 : 0);
+      istringstream huge{bytes.substr(0, 40)};
+      throw_(BitArray<>::read_binary(huge), runtime_error);
+      auto const corrupt = filesystem::temp_directory_path() / "tbitarray_corrupt.bin";
+      ofstream(corrupt, ios::binary) << bytes;
+      throw_(BitArrayView<>{corrupt}, runtime_error);
+      filesystem::remove(corrupt);
+   }
+
+   // Test the compressed form
+   CompressedBitArray c9{b9};
+   test_(c9.size() == b9.size());
+   test_(c9.count() == b9.count());
+   test_(c9.to_bitarray() == b9);
+   test_(c9[0] == b9[0]);
+   CompressedBitArray sparse{size_t(1) << 32};
+   sparse.set(5);
+   sparse.set(size_t(1) << 31);
+   test_(sparse.count() == 2);
+   test_(sparse.find_next(5) == size_t(1) << 31);
+   test_(sparse.memory_usage() < 1024);
+   test_((sparse & c9).count() == size_t(c9[5]));
+   test_(sparse.slice(4, 2).to_bitarray().to_string() == "01");
+   throw_(sparse.at(size_t(1) << 32), logic_error);
+   CompressedBitArray runs{1000};
+   for (size_t i = 0; i < 100; ++i)
+      runs.set(i);
+   for (size_t i = 1; i < 100; ++i)
+      runs.reset(i);
+   runs.optimize();
+   runs.reset(0);
+   test_(runs.count() == 0);
+   test_(!runs.any());
+   test_(!runs.at(0));
+   BitArray<> dense{70000};
+   dense.set_range(0, dense.size());
+   CompressedBitArray bitmap{dense};
+   for (size_t i = 0; i < dense.size(); ++i)
+      bitmap.reset(i);
+   test_(bitmap.count() == 0);
+   test_(!bitmap.any());
+   test_(bitmap.find_first() == CompressedBitArray::npos);
+   // single-bit edits keep a run container: a bitmap or array of 10000 bits would take 8 KiB or more
+   CompressedBitArray clustered{dense.slice(0, 20000)};
+   for (size_t i = 0; i < 5000; ++i)
+      clustered.reset(i);
+   for (size_t i = 15000; i < 20000; ++i)
+      clustered.reset(i);
+   clustered.optimize();
+   test_(clustered.memory_usage() < 1024);
+   clustered.reset(10000); // splits the run
+   clustered.reset(5000);  // shrinks it at either end
+   clustered.reset(14999);
+   clustered.set(5000);    // extends it
+   clustered.set(4999);
+   clustered.set(3000);    // a run of its own
+   clustered.set(10000);   // joins the two halves again
+   test_(clustered.memory_usage() < 1024);
+   test_(clustered.count() == 10001);
+   test_(clustered[3000] && !clustered[3001] && clustered[4999] && clustered[5000] && !clustered[14999]);
+   test_(clustered.find_next(3000) == 4999);
+   for (size_t i = 4999; i < 14999; ++i)
+      clustered.reset(i);
+   clustered.reset(3000);
+   test_(!clustered.any());
+   // a bitmap edited in place turns into an array at the array limit, and back into a bitmap past it
+   CompressedBitArray edges{dense.slice(0, 4097)};
+   edges.reset(4096);
+   test_(edges.count() == 4096 && !edges[4096] && edges.find_first() == 0);
+   edges.set(4096);
+   test_(edges.count() == 4097 && edges[4096] && edges.to_bitarray() == dense.slice(0, 4097));
+
    BitArray<> b12("11011111101");
    b12.erase(1,8);
    test_(b12.to_string() == "101");
    b12 += b12;
    test_(b12.to_string() == "101101");
+   b12.resize(300);
+   test_(b12.size() == 300 && b12.count() == 4 && b12.find_last() == 5);
+   b12.resize(4);
+   test_(b12.to_string() == "1011");
+   b12.resize(6);
+   test_(b12.to_string() == "101100"); // the dropped bits do not come back
+
+   // Test allocators: small arrays stay inline, larger ones use the resource
+   counting_resource counter;
+   {
+      PmrBitArray<> small{BitArray<>::INLINE_BITS, &counter};
+      small[3] = true;
+      small += small.slice(0, 0);
+      PmrBitArray<> copy{small, &counter};
+      test_(copy == small);
+      test_(counter.allocations == 0);
+      small += true;
+      test_(counter.allocations == 1);
+      test_(small.count() == 2);
+      test_(small.get_allocator().resource() == &counter);
+   }
+   std::pmr::monotonic_buffer_resource arena;
+   PmrBitArray<> arena_bits{"10110", &arena};
+   arena_bits.reserve(10000);
+   test_(arena_bits.capacity() >= 10000);
+   test_(arena_bits.to_string() == "10110");
+
+   // Test the fixed-size form; these are evaluated by the compiler
+   constexpr StaticBitArray<12> mask{"110000000011"};
+   static_assert(mask.count() == 4);
+   static_assert((mask << 1).to_string() == "100000000110");
+   static_assert((mask & ~mask).none());
+   StaticBitArray<12> perms;
+   perms[1] = true;
+   perms |= mask;
+   test_(perms.to_string() == "110000000011");
+   test_(perms.to_bitarray() == BitArray<>("110000000011"));
+   test_(StaticBitArray<12>{BitArray<>("010000000000")} < perms);
+   throw_(StaticBitArray<12>{BitArray<>("0")}, logic_error);
+   throw_(perms.at(12), logic_error);
+   // ... with block words, where a word holds several lanes
+   constexpr StaticBitArray<300, BitBlock<256>> blocks{string_view{string(100, '0') + string(200, '1')}};
+   static_assert(blocks.count() == 200 && blocks.find_first() == 100 && blocks.find_next(299) == blocks.npos);
+   static_assert(((blocks << 150) & blocks).count() == 50 && (~blocks).find_first() == 0);
+   test_((blocks >> 7).count() == 193 && (blocks >> 7).find_first() == 107);
+   test_((blocks >> 1) < blocks && !(blocks < blocks));
+   test_(blocks.to_bitarray().count() == 200);
+   using Blocks = StaticBitArray<300, BitBlock<256>>;
+   test_(hash<Blocks>{}(blocks) == hash<BitArray<BitBlock<256>>>{}(blocks.to_bitarray()));
+
+   // Stress the concurrent form: threads setting interleaved bits share every word, and
+   // each racing test_and_set must be won exactly once
+   {
+      const size_t nbits = 100003;
+      const unsigned nthreads = 8;
+      AtomicBitArray<uint8_t> shared{nbits};
+      AtomicBitArray<> visited{nbits / 2};
+      atomic<size_t> claims{0};
+      vector<thread> threads;
+      for (unsigned t = 0; t < nthreads; ++t) {
+         threads.emplace_back([&, t] {
+            for (size_t i = t; i < nbits; i += nthreads) shared.set(i);
+            for (size_t i = 0; i < nbits / 2; ++i)
+               if (!visited.test_and_set((i * 7919 + t) % (nbits / 2))) ++claims;
+            visited.grow(nbits / 2 + 64 * (t + 1)); // concurrent grow
+         });
+      }
+      for (auto& th : threads) th.join();
+      test_(shared.count() == nbits);
+      test_(shared.snapshot().all());
+      test_(claims == nbits / 2);
+      test_(visited.size() == nbits / 2 + 64 * nthreads);
+      test_(visited.count() == nbits / 2);
+      visited.set(visited.size() - 1);
+      test_(visited.test(visited.size() - 1));
+      throw_(visited.set(visited.size()), logic_error);
+   }
+
+   // instrumentation: the counting policy tallies what its arrays did
+   {
+      using Counted = BitArray<size_t, allocator<size_t>, bitstats::counting>;
+      Counted::reset_stats();
+      Counted c(1000); // one heap buffer of 16 words
+      auto d = c;      // a copy, with a buffer of its own
+      auto e = move(d);
+      e <<= 3;
+      test_(e.count() == 0);
+      e += true;
+      auto const s = Counted::stats();
+      test_(s.copies == 1 && s.moves == 1);
+      test_(s.reallocations == 2 && s.bytes_allocated == 2 * 16 * sizeof(size_t));
+      test_(s.calls_to(bitstats::op::shift) == 1 && s.calls_to(bitstats::op::count) == 1);
+      test_(s.calls_to(bitstats::op::append) == 1 && s.calls_to(bitstats::op::insert) == 0);
+      test_(BitArray<>::stats().moves == 0); // the default policy records nothing
+      static_assert(sizeof(Counted) == sizeof(BitArray<>));
+   }
+
+   // element access, moves, swaps and ops on temporaries never allocate
+   {
+      static_assert(is_nothrow_move_constructible_v<BitArray<>> && is_nothrow_move_assignable_v<BitArray<>>);
+      static_assert(is_nothrow_swappable_v<BitArray<>>);
+      counting_resource heap;
+      PmrBitArray<> x{1000, &heap}, y{300, &heap};
+      x.build_rank_index();
+      auto const allocations = heap.allocations;
+      for (size_t i = 0; i < x.size(); i += 7) x[i] = true;
+      x[1] = x[7];
+      x[0] = false;
+      swap(x[0], x[1]);
+      test_(x[0] && !x[1] && x.count() == 143 && x.rank1(1000) == 143);
+      y[299] = true;
+      swap(x, y);
+      test_(x.size() == 300 && y.size() == 1000 && x[299] && y.rank1(8) == 2);
+      swap(x, y);
+      auto z = ~std::move(x);
+      test_(z.count() == 1000 - 143);
+      auto w = std::move(z) << 3;
+      w = std::move(w) >> 3;
+      auto v = y & std::move(w);
+      test_(v.size() == 1000 && v.count() == 1);
+      auto const make = [&heap] { PmrBitArray<> r{2000, &heap}; r[5] = true; return r; };
+      auto const before_make = heap.allocations;
+      auto const made = make();
+      test_(heap.allocations == before_make + 1 && made[5]);
+      test_(before_make == allocations);
+   }
+
+   // lazy expressions: chains of ops agree with the eager forms, alias safely and never
+   // allocate an intermediate array
+   {
+      counting_resource heap;
+      PmrBitArray<uint32_t> x{70000, &heap}, y{50000, &heap}, z{70000, &heap};
+      for (size_t i = 0; i < x.size(); i += 3) x[i] = true;
+      for (size_t i = 0; i < y.size(); i += 7) y[i] = true;
+      for (size_t i = 0; i < z.size(); i += 11) z[i] = true;
+      auto eager = PmrBitArray<uint32_t>(x, &heap);
+      eager <<= 6;
+      auto tail = PmrBitArray<uint32_t>(y, &heap);
+      tail.toggle();
+      tail >>= 6;
+      eager &= tail;
+      eager ^= z;
+      auto trimmed = PmrBitArray<uint32_t>(x, &heap);
+      trimmed[69999] = false; // the only 1 of the last three bits
+      auto const allocations = heap.allocations;
+      auto const e = ((x << 6) & (~y >> 6)) ^ z;
+      test_(e.size() == 70000 && e.count() == eager.count() && e == eager && eager == e);
+      test_(e[6] == eager[6] && e[69999] == eager[69999] && (x & y).any() && (y & ~y).none());
+      test_(!(e == x) && e != (e ^ z) && (x << 70000).none() && ((x >> 3) << 3) == trimmed);
+      PmrBitArray<uint32_t> r{70000, &heap};
+      auto const before_assign = heap.allocations;
+      r = e;
+      r &= x | y;
+      test_(heap.allocations == before_assign && r == (eager & (x | y)));
+      test_(before_assign == allocations + 1 && (~y).to_string() == (~y).to_string() && (~y).to_string().size() == 50000);
+      PmrBitArray<uint32_t> made{~x ^ y, &heap};
+      test_(heap.allocations == before_assign + 1 && made.size() == 70000 && made.count() == (~x ^ y).count());
+
+      // an array on both sides: read in place, except through a shift
+      auto copy = PmrBitArray<uint32_t>(x, &heap);
+      copy = y & copy;
+      test_(copy == (x & y) && copy.size() == 70000);
+      copy = x;
+      copy = ~copy >> 5;
+      test_(copy == (~x >> 5) && !copy[4] && !copy[5] && copy[6]);
+      copy = x;
+      copy ^= copy << 1;
+      test_(copy == (x ^ (x << 1)));
+      copy = y & x;
+      copy = copy & z; // a shorter result keeps the words past its end zero
+      test_(copy == (x & y & z) && copy.count() == (x & y & z).count());
+
+      // ... and when the result outgrows it, so its words move: heap to heap and inline to heap
+      BitArray<> small(1000), large(100000), inline_small(100), mid(10000);
+      small[1] = inline_small[1] = large[5] = large[99999] = mid[7] = true;
+      small = small | large;
+      test_(small.size() == 100000 && small.count() == 3 && small[1] && small[99999]);
+      small = BitArray<>(1000);
+      small[1] = true;
+      small |= small ^ large;
+      test_(small.size() == 100000 && small.count() == 3);
+      inline_small = inline_small | mid;
+      test_(inline_small.size() == 10000 && inline_small.count() == 2 && inline_small[1] && inline_small[7]);
+
+      // temporaries are combined in place rather than referred to
+      PmrBitArray<uint32_t> const owned = (x << 6) & PmrBitArray<uint32_t>(y, &heap);
+      test_(owned == ((x << 6) & y));
+      BitArray<uint8_t> n("1101000011"), m("011");
+      test_((~n).to_string() == "0010111100" && (n << 3).to_string() == "1000011000" && (n >> 3).to_string() == "0001101000");
+      test_(((n ^ m) >> 1).to_string() == "0101100001" && BitArray<uint8_t>(~m & n).to_string() == "1000000000");
+   }
+
+   // bitmap indexes: queries agree with a row-by-row scan, over several evaluation blocks
+   {
+      size_t const nrows = 50003;
+      vector<int> region(nrows), status(nrows);
+      for (size_t r = 0; r < nrows; ++r) {
+         region[r] = int(r * 2654435761u % 7);
+         status[r] = int(r / 3 % 4);
+      }
+      BitmapIndex<int> by_region{region}, by_status;
+      for (auto s : status) by_status.push_back(s);
+      test_(by_region.rows() == nrows && by_status.rows() == nrows);
+      test_(by_region.cardinality() == 7 && by_status.count(2) == 12501);
+      auto const q = by_region.equals(3) & by_status.in({1, 2}) & ~by_region.equals(5);
+      auto const wide = by_region.between(2, 4) | ~by_status.equals(0) | by_region.equals(99);
+      size_t expected = 0, expected_wide = 0, first_match = BitArray<>::npos;
+      for (size_t r = 0; r < nrows; ++r) {
+         bool const hit = region[r] == 3 && (status[r] == 1 || status[r] == 2) && region[r] != 5;
+         if (hit && first_match == BitArray<>::npos) first_match = r;
+         expected += hit;
+         expected_wide += (region[r] >= 2 && region[r] <= 4) || status[r] != 0;
+      }
+      test_(q.count() == expected && q.estimate() <= by_region.count(3));
+      test_(wide.count() == expected_wide);
+      auto const hits = q.evaluate();
+      test_(hits.size() == nrows && hits.count() == expected);
+      auto const ids = q.row_ids();
+      test_(ids.size() == expected && ids.front() == first_match && hits[ids.back()]);
+      test_((~wide).count() == nrows - expected_wide);
+      test_(by_region.equals(99).count() == 0 && (by_region.equals(99) & q).evaluate().none());
+   }
+
+   // bloom filters: no false negatives, about the asked false positive rate, images and unions
+   {
+      auto filter = BloomFilter<size_t>::for_items(10000, 0.01);
+      vector<size_t> keys;
+      for (size_t k = 0; k < 10000; ++k) keys.push_back(k * 7919);
+      filter.insert_many(keys);
+      test_(filter.contains_many(keys) == keys.size() && filter.contains(7919));
+      vector<size_t> others(100000);
+      for (size_t k = 0; k < others.size(); ++k) others[k] = k * 7919 + 1;
+      vector<char> found(others.size());
+      auto const false_hits = filter.contains_many(others, reinterpret_cast<bool*>(found.data()));
+      test_(false_hits < 2000 && size_t(count(found.begin(), found.end(), 1)) == false_hits);
+      test_(filter.bit_count() % 512 == 0 && filter.estimated_items() > 9000 && filter.estimated_items() < 11000);
+      stringstream image;
+      filter.write_binary(image);
+      auto const copy = BloomFilter<size_t>::read_binary(image);
+      test_(copy.table() == filter.table() && copy.hash_count() == filter.hash_count());
+      BloomFilter<size_t> more(filter.bit_count(), filter.hash_count());
+      more.insert(12345);
+      filter |= more;
+      test_(filter.contains(12345) && filter.contains(0));
+      throw_(filter.merge(BloomFilter<size_t>(512, 3)), invalid_argument);
+      stringstream wrong_kind;
+      CountingBloomFilter<string>(1024, 3).write_binary(wrong_kind);
+      throw_(BloomFilter<size_t>::read_binary(wrong_kind), runtime_error);
+      throw_(BloomFilter<size_t>(512, 0), invalid_argument);
+
+      auto counts = CountingBloomFilter<string>::for_items(1000, 0.01);
+      counts.insert("apple");
+      counts.insert("apple");
+      counts.insert("pear");
+      test_(counts.contains("apple") && counts.count("apple") >= 2 && counts.contains("pear"));
+      test_(counts.erase("pear") && !counts.contains("pear") && !counts.erase("plum"));
+      test_(counts.erase("apple") && counts.contains("apple"));
+   }
+
+   // range ops: the ends are masked, the words between are filled whole
+   {
+      BitArray<uint8_t> r(40);
+      r.set_range(3, 30);
+      test_(r.to_string() == "0001111111111111111111111111111110000000");
+      r.reset_range(10, 12);
+      test_(r.count() == 18 && r.count_range(8, 16) == 4);
+      r.flip_range(0, 5);
+      test_(r.to_string().substr(0, 6) == "111001");
+      test_(r.any_range(10, 12) == false && r.any_range(9, 2) == true);
+      test_(r.count_range(40, 0) == 0 && !r.any_range(0, 0));
+      throw_(r.set_range(30, 11), out_of_range);
+      throw_(r.count_range(41, 0), out_of_range);
+      r.fill(true);
+      test_(r.all() && r.count() == 40);
+      r += false;
+      test_(r.count() == 40 && !r[40]);
+      r.fill(false);
+      test_(r.none());
+   }
+
+   // parallel forms: a four thread pool with no size cutoff splits even small arrays
+   {
+      bitkernels::thread_pool pool{4};
+      bitkernels::parallel_policy const par{&pool, 0};
+      atomic<size_t> covered{0};
+      bitkernels::parallel_for(10, 100, [&](size_t first, size_t last) { covered += last - first; }, &pool);
+      bitkernels::parallel_for(1000, 100, [&](size_t first, size_t last) { covered += last - first; }, &pool);
+      test_(covered == 1010);
+      // a piece that throws: the rest finish, the exception reaches the caller and the pool goes on
+      throw_(bitkernels::parallel_for(1000, 100, [&](size_t first, size_t last) {
+         covered += last - first;
+         if (first >= 500) throw runtime_error("piece");
+      }, &pool), runtime_error);
+      test_(covered == 2010);
+      throw_(bitkernels::parallel_for(1000, 100, [](size_t, size_t) { throw runtime_error("every piece"); }, &pool), runtime_error);
+      bitkernels::parallel_for(1000, 100, [&](size_t first, size_t last) { covered += last - first; }, &pool);
+      test_(covered == 3010);
+      BitArray<uint16_t> p(5000), q(3000);
+      for (size_t i = 0; i < p.size(); i += 3) p[i] = true;
+      for (size_t i = 0; i < q.size(); i += 5) q[i] = true;
+      auto ref = p;
+      test_(p.count(par) == ref.count());
+      test_(p.any(par) && !BitArray<>(9000).any(par));
+      test_(p.to_string(par) == ref.to_string());
+      p.shift_left(par, 1037);
+      test_(p == (ref << 1037));
+      p.shift_right(par, 515);
+      test_(p == ((ref << 1037) >> 515));
+      p.toggle(par);
+      ref = ~((ref << 1037) >> 515);
+      test_(p == ref && p.count(par) == ref.count());
+      p.xor_assign(par, q).and_not(bitkernels::seq, q);
+      test_(p == and_not(ref ^ q, q));
+
+      BitArray<unsigned char> e(64);
+      e.erase(0, 60);
+      e.toggle(par);
+      e += BitArray<unsigned char>(40);
+      test_(e.count() == 4); // the words left over by erase stay zero
+   }
+
+   // bit streams: fields of 0 to 64 bits appended after existing bits, then read back, on
+   // words narrower and wider than a chunk
+   {
+      auto const round_trip = []<class IType>(BitArray<IType> bits) {
+         auto const start = bits.size();
+         auto expected = bits.to_string();
+         uint64_t x = 0x9E3779B97F4A7C15;
+         {
+            BitWriter out{bits};
+            for (unsigned i = 0; i < 400; ++i) {
+               x = x * 6364136223846793005 + 1442695040888963407;
+               for (unsigned j = 0; j < i % 65; ++j) expected += (x >> j & 1) ? '1' : '0';
+               out.write(x, i % 65);
+            }
+         }
+         BitReader in{bits, start};
+         x = 0x9E3779B97F4A7C15;
+         bool same = bits.to_string() == expected && in.remaining() == expected.size() - start;
+         for (unsigned i = 0; i < 400; ++i) {
+            x = x * 6364136223846793005 + 1442695040888963407;
+            same = same && in.read(i % 65) == bitstream::low_bits(x, i % 65);
+         }
+         return same && in.at_end();
+      };
+      test_(round_trip(BitArray<>()));
+      test_(round_trip(BitArray<uint8_t>("10110")));
+      test_(round_trip(BitArray<uint16_t>(64)));
+      test_(round_trip(BitArray<BitBlock<256>>(string(70, '1'))));
+
+      BitArray<> codes;
+      vector<uint64_t> const values{1, 2, 3, 4, 7, 8, 1000, (1ull << 31) + 5, 1ull << 40, ~0ull};
+      {
+         BitWriter out{codes};
+         for (auto const v : values) out.write_gamma(v);
+         out.write_unary(0);
+         out.write_unary(70);
+         out.write_rice(1000, 4);
+         out.write_rice(5, 0);
+         out.flush();
+         test_(codes.size() == out.size());
+         throw_(out.write(0, 65), out_of_range);
+         throw_(out.write_gamma(0), out_of_range);
+      }
+      BitArray<> one;
+      BitWriter{one}.write_gamma(5);
+      test_(one.to_string() == "00110"); // unary 2, then the low bits of 101, low bit first
+      BitReader in{codes};
+      bool decoded = true;
+      for (auto const v : values) decoded = decoded && in.read_gamma() == v;
+      test_(decoded && in.read_unary() == 0 && in.read_unary() == 70);
+      test_(in.read_rice(4) == 1000 && in.read_rice(0) == 5 && in.at_end());
+      throw_(in.read(1), out_of_range);
+      in.seek(codes.size() - 3);
+      test_(in.read(3) == 0b100 && in.position() == codes.size()); // rice 5, k 0: five zeros, a one
+      BitArray<> zeros(200);
+      BitReader runs{zeros, 10};
+      throw_(runs.read_unary(), out_of_range);
+      test_(runs.position() == 10 && runs.read(64) == 0);
+      throw_(BitReader(zeros, 201), out_of_range);
+
+      // a flush that cannot allocate throws, and the destructor's attempt fails quietly
+      PmrBitArray<> no_heap{PmrBitArray<>::INLINE_BITS, pmr::null_memory_resource()};
+      {
+         BitWriter out{no_heap};
+         out.write(5, 3);
+         throw_(out.flush(), bad_alloc);
+      }
+      test_(no_heap.size() == PmrBitArray<>::INLINE_BITS && no_heap.none());
+
+      // every op that grows past the inline words leaves the size alone when it cannot allocate
+      PmrBitArray<> wide{PmrBitArray<>::INLINE_BITS + 1, pmr::new_delete_resource()};
+      wide.fill(true);
+      throw_(no_heap += true, bad_alloc);
+      throw_(no_heap += no_heap, bad_alloc);
+      throw_(no_heap.insert(3, true), bad_alloc);
+      throw_(no_heap.insert(3, no_heap), bad_alloc);
+      throw_(no_heap |= wide, bad_alloc);
+      throw_(no_heap ^= wide.span(0, wide.size()), bad_alloc);
+      throw_(no_heap &= ~wide, bad_alloc);
+      throw_(no_heap = ~wide, bad_alloc);
+      throw_(no_heap.or_assign(bitkernels::seq, wide), bad_alloc);
+      istringstream long_text{string(PmrBitArray<>::INLINE_BITS + 1, '1')};
+      throw_(long_text >> no_heap, bad_alloc);
+      test_(no_heap.size() == PmrBitArray<>::INLINE_BITS && no_heap.capacity() == PmrBitArray<>::INLINE_BITS);
+      test_(no_heap.count() == 0 && no_heap.none());
+   }
 
    BitArray<> b13("");
    test_(b13.size() == 0);
+
+   // every word width, up to the blocks the size of an SSE and an AVX register
+   test_word_width<uint8_t>("uint8_t");
+   test_word_width<uint16_t>("uint16_t");
+   test_word_width<uint32_t>("uint32_t");
+   test_word_width<uint64_t>("uint64_t");
+   test_word_width<BitBlock<128>>("BitBlock<128>");
+   test_word_width<BitBlock<256>>("BitBlock<256>");
+   {
+      // text long enough to be parsed on several threads, each writing whole block words
+      string text((size_t(1) << 24) + 100, '0');
+      for (size_t i = 0; i < text.size(); i += 97) text[i] = '1';
+      BitArray<BitBlock<256>> const parsed(text);
+      test_(parsed.count() == (text.size() + 96) / 97 && parsed.to_string() == text);
+   }
+   static_assert(sizeof(BitBlock<256>) == 32 && is_trivially_copyable_v<BitBlock<256>>);
+   test_((BitBlock<128>(1) << 100 >> 36).lane(1) == 1 && (BitBlock<256>(0) - 1).popcount() == 256);
+   test_(BitBlock<256>(-1).countl_zero() == 0 && (BitBlock<256>(1) << 200).countr_zero() == 200 && !BitBlock<128>(0));
  
    report_();
 }
 
-/* Output (should have at least 4 move assignments):
-move constructor
-move assignment      
-move assignment
-move assignment
-move assignment
-move assignment
-move assignment
+/* Output (the moves print "move constructor" / "move assignment" lines
+   only when BitArray is instantiated with bitstats::tracing):
 shrinking from 2 to 1 words   (numbers may vary)
 
 Test Report: